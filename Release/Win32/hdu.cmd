@@ -0,0 +1 @@
+@%~dp0hfs du %*
@@ -0,0 +1,90 @@
+# ****************************************************************************
+# @file bench
+# Copy throughput of "hfs copy" by transfer mode and file size
+# ****************************************************************************
+
+import os
+import sys
+import shutil
+import subprocess
+import tempfile
+import time
+
+# transfer modes: option, name
+MODES = [('-r', 'raw'), ('-t', 'text'), ('-m', 'MacBinary'),
+    ('-b', 'BinHex'), ('-s', 'AppleSingle')]
+
+# file sizes measured by default, in bytes
+SIZES = [4 << 10, 64 << 10, 1 << 20, 16 << 20, 64 << 20]
+
+# runs per measurement; the fastest one counts
+RUNS = 3
+
+
+def hfs(exe, *args):
+    subprocess.run([exe] + list(args), check=True,
+        stdout=subprocess.DEVNULL, stderr=subprocess.PIPE)
+
+
+def timed(exe, *args):
+    best = None
+    for _ in range(RUNS):
+        t = time.perf_counter()
+        hfs(exe, *args)
+        t = time.perf_counter() - t
+        best = t if best is None else min(best, t)
+    return best
+
+
+def mbps(size, secs):
+    return size / secs / (1 << 20) if secs > 0 else float('inf')
+
+
+def sample(path, size):
+    # printable lines, so that text mode round-trips them unchanged
+    line = bytes(range(32, 127)) + b'\n'
+    with open(path, 'wb') as f:
+        for _ in range(size // len(line)):
+            f.write(line)
+        f.write(line[:size % len(line)])
+
+
+def main(exe='hfs', sizes=SIZES):
+    # the image has room for the largest file plus its copies back in
+    tmp = tempfile.mkdtemp(prefix='hfsbench')
+    img = os.path.join(tmp, 'bench.hfs')
+    with open(img, 'wb') as f:
+        f.truncate(max(sizes) * 4 + (16 << 20))
+
+    env = os.environ.pop('HFSUTILS_PIPE', None)
+    try:
+        hfs(exe, 'format', '-l', 'Bench', img)
+
+        print('%-12s %10s %12s %12s' % ('mode', 'size', 'in MB/s', 'out MB/s'))
+        for size in sizes:
+            src = os.path.join(tmp, 'src')
+            sample(src, size)
+            hfs(exe, 'copy', '-r', src, ':src')
+
+            for opt, name in MODES:
+                out = os.path.join(tmp, 'out')
+                t_out = timed(exe, 'copy', opt, ':src', out)
+                t_in = timed(exe, 'copy', opt, out, ':dst')
+                print('%-12s %10d %12.1f %12.1f' % (name, size,
+                    mbps(size, t_in), mbps(size, t_out)))
+                os.remove(out)
+
+            hfs(exe, 'del', ':src', ':dst')
+    finally:
+        if env is not None:
+            os.environ['HFSUTILS_PIPE'] = env
+        subprocess.run([exe, 'umount'], stdout=subprocess.DEVNULL,
+            stderr=subprocess.DEVNULL)
+        shutil.rmtree(tmp, ignore_errors=True)
+
+
+if __name__ == '__main__':
+    # usage: bench.py [path-to-hfs.exe [size ...]]
+    args = sys.argv[1:]
+    main(args[0] if args else 'hfs',
+        [int(a) for a in args[1:]] or SIZES)
@@ -0,0 +1,431 @@
+# ****************************************************************************
+# @file libhfs
+# ctypes binding for libhfs.dll (HFS Utilities for Windows)
+# ****************************************************************************
+
+import io
+import os
+import weakref
+import ctypes
+from ctypes import (c_char, c_char_p, c_wchar_p, c_int, c_long, c_ulong,
+    c_short, c_ushort, c_int64, c_void_p, POINTER, Structure, Union)
+from datetime import datetime
+
+HFS_MAX_FLEN = 31
+HFS_MAX_VLEN = 27
+
+HFS_ISDIR = 0x0001
+HFS_ISLOCKED = 0x0002
+
+HFS_MODE_RDONLY = 0
+HFS_MODE_RDWR = 1
+HFS_MODE_ANY = 2
+
+HFS_SEEK_SET = 0
+HFS_SEEK_CUR = 1
+HFS_SEEK_END = 2
+
+HFS_DIR_CATALOG = c_ulong(-1).value
+
+# number of entries fetched per hfs_readdir_many() call
+DIRENTS = 64
+
+# HFS names are MacOS Standard Roman
+ENCODING = 'mac_roman'
+
+# MSVC's time_t is 64 bits wide on both platforms
+time_t = c_int64
+
+
+class hfsvolent (Structure):
+    _fields_ = [
+        ('name', c_char * (HFS_MAX_VLEN + 1)),
+        ('flags', c_int),
+        ('totbytes', c_ulong),
+        ('freebytes', c_ulong),
+        ('alblocksz', c_ulong),
+        ('clumpsz', c_ulong),
+        ('numfiles', c_ulong),
+        ('numdirs', c_ulong),
+        ('crdate', time_t),
+        ('mddate', time_t),
+        ('bkdate', time_t),
+        ('blessed', c_ulong),
+    ]
+
+
+class _fdlocation (Structure):
+    _fields_ = [('v', c_short), ('h', c_short)]
+
+
+class _file (Structure):
+    _fields_ = [
+        ('dsize', c_ulong),
+        ('rsize', c_ulong),
+        ('type', c_char * 5),
+        ('creator', c_char * 5),
+    ]
+
+
+class _rect (Structure):
+    _fields_ = [('top', c_short), ('left', c_short), ('bottom', c_short), ('right', c_short)]
+
+
+class _dir (Structure):
+    _fields_ = [('valence', c_ushort), ('rect', _rect)]
+
+
+class _u (Union):
+    _fields_ = [('file', _file), ('dir', _dir)]
+
+
+class hfsdirent (Structure):
+    _fields_ = [
+        ('name', c_char * (HFS_MAX_FLEN + 1)),
+        ('flags', c_int),
+        ('cnid', c_ulong),
+        ('parid', c_ulong),
+        ('crdate', time_t),
+        ('mddate', time_t),
+        ('bkdate', time_t),
+        ('fdflags', c_short),
+        ('fdlocation', _fdlocation),
+        ('u', _u),
+    ]
+
+
+class HFSError (OSError):
+    pass
+
+
+_lib = None
+
+
+def candidates():
+    ''' places libhfs.dll is looked for, the one beside hfs.exe first '''
+    here = os.path.dirname(os.path.realpath(__file__))
+    top = os.path.dirname(here)
+    # only a build for the interpreter's own platform can be loaded
+    platform = 'x64' if ctypes.sizeof(c_void_p) == 8 else 'Win32'
+    return [os.path.join(here, 'resources', 'bin', 'win', 'libhfs.dll'),
+        os.path.join(top, 'Release', platform, 'libhfs.dll'),
+        os.path.join(top, platform, 'Release', 'libhfs.dll'),
+        os.path.join(top, platform, 'Debug', 'libhfs.dll')]
+
+
+def load(path=None):
+    ''' load libhfs.dll from path, or from the first of candidates() that loads '''
+    global _lib
+    if _lib is not None:
+        return _lib
+    lib = None
+    for p in [path] if path else candidates():
+        try:
+            # libhfs.dll links the shared CRT, so its errno is the one ctypes sees
+            lib = ctypes.CDLL(p, use_errno=True)
+            break
+        except OSError:
+            if path:
+                raise
+    if lib is None:
+        raise OSError('libhfs.dll not found')
+
+    def fn(name, restype, *argtypes):
+        f = getattr(lib, name)
+        f.restype = restype
+        f.argtypes = argtypes
+
+    fn('hfs_mount', c_void_p, c_wchar_p, c_int, c_int)
+    fn('hfs_flush', c_int, c_void_p)
+    fn('hfs_umount', c_int, c_void_p)
+    fn('hfs_vstat', c_int, c_void_p, POINTER(hfsvolent))
+    fn('hfs_chdir', c_int, c_void_p, c_char_p)
+    fn('hfs_getcwd', c_ulong, c_void_p)
+    fn('hfs_getpath', c_int, c_void_p, c_ulong, c_char_p, ctypes.c_uint)
+    fn('hfs_opendir', c_void_p, c_void_p, c_char_p)
+    fn('hfs_opencat', c_void_p, c_void_p)
+    fn('hfs_readdir_many', c_int, c_void_p, POINTER(hfsdirent), c_int)
+    fn('hfs_closedir', c_int, c_void_p)
+    fn('hfs_create', c_void_p, c_void_p, c_char_p, c_char_p, c_char_p)
+    fn('hfs_open', c_void_p, c_void_p, c_char_p)
+    fn('hfs_setfork', c_int, c_void_p, c_int)
+    fn('hfs_getfork', c_int, c_void_p)
+    fn('hfs_read', c_ulong, c_void_p, c_void_p, c_ulong)
+    fn('hfs_write', c_ulong, c_void_p, c_void_p, c_ulong)
+    fn('hfs_truncate', c_int, c_void_p, c_ulong)
+    fn('hfs_seek', c_ulong, c_void_p, c_long, c_int)
+    fn('hfs_close', c_int, c_void_p)
+    fn('hfs_stat', c_int, c_void_p, c_char_p, POINTER(hfsdirent))
+    fn('hfs_fstat', c_int, c_void_p, POINTER(hfsdirent))
+    fn('hfs_mkdir', c_int, c_void_p, c_char_p)
+    fn('hfs_rmdir', c_int, c_void_p, c_char_p)
+    fn('hfs_delete', c_int, c_void_p, c_char_p)
+    fn('hfs_rename', c_int, c_void_p, c_char_p, c_char_p)
+    fn('hfs_nparts', c_int, c_wchar_p)
+
+    _lib = lib
+    return lib
+
+
+def _error():
+    err = ctypes.get_errno()
+    msg = c_char_p.in_dll(_lib, 'hfs_error').value
+    return HFSError(err, msg.decode(ENCODING) if msg else os.strerror(err))
+
+
+def _check(res):
+    if res == -1:
+        raise _error()
+    return res
+
+
+def _name(s):
+    return s.encode(ENCODING) if isinstance(s, str) else s
+
+
+class DirEntry (object):
+    ''' a catalog entry, decoded from an hfsdirent '''
+
+    __slots__ = ('name', 'flags', 'cnid', 'parid', 'crdate', 'mddate', 'bkdate',
+            'fdflags', 'dsize', 'rsize', 'type', 'creator', 'valence')
+
+    def __init__(self, ent):
+        self.name = ent.name.decode(ENCODING)
+        self.flags = ent.flags
+        self.cnid = ent.cnid
+        self.parid = ent.parid
+        self.crdate = datetime.fromtimestamp(ent.crdate) if ent.crdate else None
+        self.mddate = datetime.fromtimestamp(ent.mddate) if ent.mddate else None
+        self.bkdate = datetime.fromtimestamp(ent.bkdate) if ent.bkdate else None
+        self.fdflags = ent.fdflags & 0xffff
+        if ent.flags & HFS_ISDIR:
+            self.dsize = self.rsize = 0
+            self.type = self.creator = ''
+            self.valence = ent.u.dir.valence
+        else:
+            self.dsize = ent.u.file.dsize
+            self.rsize = ent.u.file.rsize
+            self.type = ent.u.file.type.decode(ENCODING)
+            self.creator = ent.u.file.creator.decode(ENCODING)
+            self.valence = 0
+
+    def is_dir(self):
+        return bool(self.flags & HFS_ISDIR)
+
+    def __repr__(self):
+        return '<DirEntry {!r} cnid={}>'.format(self.name, self.cnid)
+
+
+class Dir (object):
+    ''' iterator over a directory (or the whole catalog) '''
+
+    def __init__(self, handle):
+        self._dir = handle
+        self._ents = (hfsdirent * DIRENTS)()
+
+    def __iter__(self):
+        while self._dir:
+            n = _check(_lib.hfs_readdir_many(self._dir, self._ents, DIRENTS))
+            for i in range(n):
+                yield DirEntry(self._ents[i])
+            if n < DIRENTS:
+                break
+
+    def close(self):
+        if self._dir:
+            d, self._dir = self._dir, None
+            _check(_lib.hfs_closedir(d))
+
+    def _detach(self):
+        # the volume was unmounted, which closed the directory already
+        self._dir = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def __del__(self):
+        if self._dir:
+            _lib.hfs_closedir(self._dir)
+
+
+class File (io.RawIOBase):
+    ''' one fork of an HFS file as a raw binary stream '''
+
+    def __init__(self, handle, fork=0, writable=False):
+        super().__init__()
+        self._file = handle
+        self._writable = writable
+        _check(_lib.hfs_setfork(handle, fork))
+
+    def readable(self):
+        return True
+
+    def writable(self):
+        return self._writable
+
+    def seekable(self):
+        return True
+
+    def readinto(self, b):
+        ''' read directly into a writable buffer without an intermediate copy '''
+        m = memoryview(b).cast('B')
+        if not m.nbytes:
+            return 0
+        buf = (c_char * m.nbytes).from_buffer(m)
+        n = _lib.hfs_read(self._file, buf, m.nbytes)
+        if n == c_ulong(-1).value:
+            raise _error()
+        return n
+
+    def write(self, b):
+        ''' write from any buffer; writable buffers are passed through directly '''
+        m = memoryview(b).cast('B')
+        if not m.nbytes:
+            return 0
+        if m.readonly:
+            buf = bytes(m)
+        else:
+            buf = (c_char * m.nbytes).from_buffer(m)
+        n = _lib.hfs_write(self._file, buf, m.nbytes)
+        if n == c_ulong(-1).value:
+            raise _error()
+        return n
+
+    def seek(self, offset, whence=io.SEEK_SET):
+        n = _lib.hfs_seek(self._file, offset, whence)
+        if n == c_ulong(-1).value:
+            raise _error()
+        return n
+
+    def tell(self):
+        return self.seek(0, io.SEEK_CUR)
+
+    def truncate(self, size=None):
+        if size is None:
+            size = self.tell()
+        _check(_lib.hfs_truncate(self._file, size))
+        return size
+
+    def stat(self):
+        ent = hfsdirent()
+        _check(_lib.hfs_fstat(self._file, ent))
+        return DirEntry(ent)
+
+    def close(self):
+        if self._file:
+            f, self._file = self._file, None
+            super().close()
+            _check(_lib.hfs_close(f))
+
+    def _detach(self):
+        # the volume was unmounted, which closed the file already
+        self._file = None
+        super().close()
+
+
+class Volume (object):
+    ''' a mounted HFS volume '''
+
+    def __init__(self, path, partition=None, mode=HFS_MODE_RDONLY):
+        ''' mount a volume; the partition is chosen as by "hfs mount" if not given '''
+        load()
+        path = os.path.realpath(path)
+        if partition is None:
+            nparts = _lib.hfs_nparts(path)
+            if nparts > 1:
+                raise HFSError('must specify partition number')
+            partition = 0 if nparts == -1 else 1
+        self._vol = _lib.hfs_mount(path, partition, mode)
+        if not self._vol:
+            raise _error()
+        self._writable = mode != HFS_MODE_RDONLY
+        self._children = weakref.WeakSet()
+
+    def _adopt(self, child):
+        self._children.add(child)
+        return child
+
+    def vstat(self):
+        ent = hfsvolent()
+        _check(_lib.hfs_vstat(self._vol, ent))
+        return ent
+
+    def chdir(self, path):
+        _check(_lib.hfs_chdir(self._vol, _name(path)))
+
+    def getcwd(self):
+        ''' return the full path of the current directory '''
+        size = 256
+        while True:
+            buf = ctypes.create_string_buffer(size)
+            if _lib.hfs_getpath(self._vol, _lib.hfs_getcwd(self._vol), buf, size) == 0:
+                return buf.value.decode(ENCODING)
+            if size >= 65536:
+                raise _error()
+            size *= 2
+
+    def scandir(self, path=':'):
+        ''' iterate over the entries of a directory '''
+        d = _lib.hfs_opendir(self._vol, _name(path))
+        if not d:
+            raise _error()
+        return self._adopt(Dir(d))
+
+    def scancat(self):
+        ''' iterate over every file and directory record of the volume '''
+        d = _lib.hfs_opencat(self._vol)
+        if not d:
+            raise _error()
+        return self._adopt(Dir(d))
+
+    def stat(self, path):
+        ent = hfsdirent()
+        _check(_lib.hfs_stat(self._vol, _name(path), ent))
+        return DirEntry(ent)
+
+    def open(self, path, fork=0):
+        ''' open a fork (0 data, 1 resource) of an existing file '''
+        f = _lib.hfs_open(self._vol, _name(path))
+        if not f:
+            raise _error()
+        return self._adopt(File(f, fork, self._writable))
+
+    def create(self, path, type='TEXT', creator='ttxt'):
+        ''' create a new file and open its data fork '''
+        f = _lib.hfs_create(self._vol, _name(path), _name(type), _name(creator))
+        if not f:
+            raise _error()
+        return self._adopt(File(f, 0, self._writable))
+
+    def mkdir(self, path):
+        _check(_lib.hfs_mkdir(self._vol, _name(path)))
+
+    def rmdir(self, path):
+        _check(_lib.hfs_rmdir(self._vol, _name(path)))
+
+    def delete(self, path):
+        _check(_lib.hfs_delete(self._vol, _name(path)))
+
+    def rename(self, src, dst):
+        _check(_lib.hfs_rename(self._vol, _name(src), _name(dst)))
+
+    def flush(self):
+        _check(_lib.hfs_flush(self._vol))
+
+    def umount(self):
+        ''' unmount; libhfs closes the files and directories still open on it '''
+        if self._vol:
+            v, self._vol = self._vol, None
+            for child in list(self._children):
+                child._detach()
+            self._children.clear()
+            _check(_lib.hfs_umount(v))
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.umount()
@@ -14,6 +14,7 @@ import traceback
 IS_WIN = os.name == 'nt'
 if IS_WIN:
     from winreg import *
+    import libhfs
 from PyQt5.QtCore import *
 from PyQt5.QtGui import *
 from PyQt5.QtWidgets import *
@@ -72,6 +73,15 @@ class Main(QMainWindow):
         self._loaded_image = None
         self._last_dir = ''
 
+        # list directories in-process if libhfs.dll is available
+        self._libhfs = False
+        if IS_WIN:
+            try:
+                libhfs.load()
+                self._libhfs = True
+            except OSError:
+                pass
+
         self._proc = QProcess()
         self._proc.readyReadStandardError.connect(self.slot_stderr)
         self._proc.setWorkingDirectory(bin_dir)
@@ -168,9 +178,30 @@ class Main(QMainWindow):
             treeItem.setIcon(0, self._icon_folder)
         return treeItem
 
+    def _list_item(self, ent):
+        ''' create tree item for a libhfs directory entry '''
+        name = ent.name.replace('\r', '{CR}')
+        dat = ent.mddate.strftime('%d-%m-%Y') if ent.mddate else ''
+        if ent.is_dir():
+            treeItem = MyFileItem([name, '', '', dat, '', ''], TYPE_FOLDER)
+            treeItem.setIcon(0, self._icon_folder)
+        else:
+            treeItem = MyFileItem([name, str(ent.dsize), str(ent.rsize), dat, ent.type, ent.creator], TYPE_FILE)
+            treeItem.setIcon(0, self._icon_file)
+        return treeItem
+
     def _show_listing(self):
         ''' show/update directory listing '''
         self.treeWidgetHfs.clear()
+        if self._libhfs and self._loaded_image:
+            try:
+                with libhfs.Volume(self._loaded_image) as vol:
+                    with vol.scandir(self.lineEditHfsPath.text()) as d:
+                        for ent in d:
+                            self.treeWidgetHfs.addTopLevelItem(self._list_item(ent))
+                return
+            except OSError:
+                self.treeWidgetHfs.clear()
         if IS_WIN:
             res = self._cmd('hfs', ['ls', '-alU'])
         else:
@@ -199,8 +230,8 @@ class Main(QMainWindow):
             )
         )
         self.lineEditHfsPath.setText(self._cmd('hfs', ['pwd']) if IS_WIN else self._sh('hpwd'))
-        self._show_listing()
         self._loaded_image = fn
+        self._show_listing()
 
         self.treeWidgetHfs.setEnabled(True)
         self.actionClose.setEnabled(True)
@@ -0,0 +1,91 @@
+# ****************************************************************************
+# @file regress
+# Round trips through "hfs copy" at fork sizes that once broke it
+# ****************************************************************************
+
+import binascii
+import os
+import shutil
+import struct
+import subprocess
+import sys
+import tempfile
+
+# MacBinary copy-out with -R: cases of data fork size, resource fork size
+CASES = [
+    # header plus data fork padded to exactly one 256 KiB chunk
+    (262000, 5000),
+    (262016, 5000),
+    (1000, 5000),
+    (262000, 0),
+]
+
+
+def hfs(exe, *args):
+    subprocess.run([exe] + list(args), check=True,
+        stdout=subprocess.DEVNULL, stderr=subprocess.PIPE)
+
+
+def pad(data):
+    return data + b'\0' * (-len(data) % 128)
+
+
+def macbinary(name, dfork, rfork):
+    # MacBinary II header; the CRC covers its first 124 bytes
+    head = bytearray(128)
+    head[1] = len(name)
+    head[2:2 + len(name)] = name
+    head[65:73] = b'TEXTttxt'
+    struct.pack_into('>II', head, 83, len(dfork), len(rfork))
+    head[122] = head[123] = 129
+    struct.pack_into('>H', head, 124, binascii.crc_hqx(bytes(head[:124]), 0))
+    return bytes(head) + pad(dfork) + pad(rfork)
+
+
+def main(exe='hfs'):
+    tmp = tempfile.mkdtemp(prefix='hfsregress')
+    img = os.path.join(tmp, 'regress.hfs')
+    with open(img, 'wb') as f:
+        f.truncate(16 << 20)
+
+    env = os.environ.pop('HFSUTILS_PIPE', None)
+    failed = 0
+    try:
+        hfs(exe, 'format', '-l', 'Regress', img)
+
+        for dsize, rsize in CASES:
+            src = os.path.join(tmp, 'in.bin')
+            out = os.path.join(tmp, 'out.bin')
+            data = macbinary(b'f', bytes(i * 7 & 255 for i in range(dsize)),
+                bytes(i * 3 & 255 for i in range(rsize)))
+            with open(src, 'wb') as f:
+                f.write(data)
+
+            hfs(exe, 'copy', '-m', src, ':f')
+            try:
+                hfs(exe, 'copy', '-R', '-m', ':f', out)
+                with open(out, 'rb') as f:
+                    ok = f.read()[128:] == data[128:]
+            except subprocess.CalledProcessError:
+                ok = False
+
+            print('%-8s copy -R -m  dsize %8d  rsize %8d' % (
+                'ok' if ok else 'FAILED', dsize, rsize))
+            failed += not ok
+
+            hfs(exe, 'del', ':f')
+            if os.path.exists(out):
+                os.remove(out)
+    finally:
+        if env is not None:
+            os.environ['HFSUTILS_PIPE'] = env
+        subprocess.run([exe, 'umount'], stdout=subprocess.DEVNULL,
+            stderr=subprocess.DEVNULL)
+        shutil.rmtree(tmp, ignore_errors=True)
+
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    # usage: regress.py [path-to-hfs.exe]
+    sys.exit(main(*sys.argv[1:2]))
@@ -19,23 +19,49 @@
 
 # include <unistd.h>
 # include <stdio.h>
+# include <stdlib.h>
 # include <string.h>
 # include <errno.h>
 
+# if defined(_M_X64) || defined(_M_AMD64) || defined(__SSE2__)
+#  include <emmintrin.h>
+#  define HAVE_SSE2
+# endif
+
 # include "binhex.h"
 # include "crc.h"
 
-const char *bh_error = "no error";
+BH_THREAD const char *bh_error = "no error";
 
 # define __ERROR(code, str)	(bh_error = (str), errno = (code))
 
-static FILE *file;			/* input/output file */
-static char line[67];			/* ASCII line buffer */
-static int lptr;			/* next char in line buffer */
-static int state86;			/* 8->6 encoding state */
-static unsigned char lastch;		/* last encoded data byte */
-static int runlen;			/* runlength of last data byte */
-static unsigned short crc;		/* incremental CRC word */
+# define HEADERMATCH	40
+# define MAXLINELEN	64
+
+# define IOBUFSZ	65536			/* host file buffer */
+# define RLEBUFSZ	49152			/* RLE90 stream; a multiple of 3 */
+
+struct binhex {
+  int fd;				/* input/output file */
+  unsigned short crc;			/* incremental CRC word */
+  unsigned char lastch;			/* last data byte */
+  int runlen;				/* runlength of last data byte */
+
+  int col;				/* characters on the output line */
+  int olen;				/* bytes waiting in io[] */
+  int rlen;				/* bytes waiting in rle[] */
+
+  int ipos, ilen;			/* unread input in io[] */
+  int dpos, dlen;			/* decoded bytes left in rle[] */
+  unsigned int bits;			/* 6->8 decoding state */
+  int nbits;
+  int ierr;				/* why decoding stopped, once it has */
+  const char *ierrstr;
+
+  unsigned char io[IOBUFSZ];
+  unsigned char rle[RLEBUFSZ];
+  char enc[RLEBUFSZ / 3 * 4];
+};
 
 static const
 unsigned char zero[2] = { 0, 0 };
@@ -47,136 +73,226 @@ static const
 char enmap[] = "!\"#$%&'()*+,-012345689@ABCDEFGHI"
 	       "JKLMNPQRSTUVXYZ[`abcdefhijklmpqr";
 
+/* 6-bit value of each hqx character; SPC is skipped, BAD ends the data */
+
+# define SPC	0x40
+# define BAD	0x80
+
 static const
-signed char demap[256] = {
-   0,  0,  0,  0,  0,  0,  0,  0,
-   0, -1, -1,  0,  0, -1,  0,  0,
-   0,  0,  0,  0,  0,  0,  0,  0,
-   0,  0,  0,  0,  0,  0,  0,  0,
-  -1,  1,  2,  3,  4,  5,  6,  7,
-   8,  9, 10, 11, 12, 13,  0,  0,
-  14, 15, 16, 17, 18, 19, 20,  0,
-  21, 22,  0,  0,  0,  0,  0,  0,
-  23, 24, 25, 26, 27, 28, 29, 30,
-  31, 32, 33, 34, 35, 36, 37,  0,
-  38, 39, 40, 41, 42, 43, 44,  0,
-  45, 46, 47, 48,  0,  0,  0,  0,
-  49, 50, 51, 52, 53, 54, 55,  0,
-  56, 57, 58, 59, 60, 61,  0,  0,
-  62, 63, 64,  0,  0,  0,  0,  0,
-   0,  0,  0,  0,  0,  0,  0,  0
+unsigned char detab[256] = {
+  BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD,
+  BAD, SPC, SPC, BAD, BAD, SPC, BAD, BAD,
+  BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD,
+  BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD,
+  SPC,   0,   1,   2,   3,   4,   5,   6,
+    7,   8,   9,  10,  11,  12, BAD, BAD,
+   13,  14,  15,  16,  17,  18,  19, BAD,
+   20,  21, BAD, BAD, BAD, BAD, BAD, BAD,
+   22,  23,  24,  25,  26,  27,  28,  29,
+   30,  31,  32,  33,  34,  35,  36, BAD,
+   37,  38,  39,  40,  41,  42,  43, BAD,
+   44,  45,  46,  47, BAD, BAD, BAD, BAD,
+   48,  49,  50,  51,  52,  53,  54, BAD,
+   55,  56,  57,  58,  59,  60, BAD, BAD,
+   61,  62,  63, BAD, BAD, BAD, BAD, BAD,
+  BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD,
+  BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD,
+  BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD,
+  BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD,
+  BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD,
+  BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD,
+  BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD,
+  BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD,
+  BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD,
+  BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD,
+  BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD,
+  BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD,
+  BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD,
+  BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD,
+  BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD,
+  BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD,
+  BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD
 };
 
-# define HEADERMATCH	40
-# define MAXLINELEN	64
-# define ISRETURN(c)	(demap[(unsigned char) (c)] == -1)
+# define ISRETURN(c)	(detab[(unsigned char) (c)] == SPC)
 
 /* BinHex Encoding ========================================================= */
 
 /*
- * NAME:	bh->start()
- * DESCRIPTION:	begin BinHex encoding
+ * NAME:	flushout()
+ * DESCRIPTION:	write the output buffer to the output file
  */
-int bh_start(int fd)
+static
+int flushout(binhex *bh)
 {
-  int dupfd;
+  const unsigned char *ptr = bh->io;
+  int bytes;
 
-  dupfd = dup(fd);
-  if (dupfd == -1)
+  while (bh->olen)
     {
-      __ERROR(errno, "error duplicating output stream");
-      return -1;
+      bytes = write(bh->fd, ptr, bh->olen);
+      if (bytes <= 0)
+	{
+	  __ERROR(bytes ? errno : EIO, "error writing output data");
+	  return -1;
+	}
+
+      ptr      += bytes;
+      bh->olen -= bytes;
     }
 
-  file = fdopen(dupfd, "ab");
-  if (file == 0)
+  return 0;
+}
+
+/*
+ * NAME:	putout()
+ * DESCRIPTION:	buffer bytes for the output file
+ */
+static
+int putout(binhex *bh, const char *ptr, int len)
+{
+  int chunk;
+
+  while (len)
     {
-      __ERROR(errno, "error creating output buffer");
+      chunk = IOBUFSZ - bh->olen;
+      if (chunk > len)
+	chunk = len;
 
-      close(dupfd);
-      return -1;
-    }
+      memcpy(bh->io + bh->olen, ptr, chunk);
 
-  line[0] = ':';
-  lptr = 1;
+      bh->olen += chunk;
+      ptr      += chunk;
+      len      -= chunk;
 
-  state86 = 0;
-  runlen  = 0;
+      if (bh->olen == IOBUFSZ &&
+	  flushout(bh) == -1)
+	return -1;
+    }
 
-  crc = 0x0000;
+  return 0;
+}
 
-  if (fputs(hqxheader, file) == EOF)
+/*
+ * NAME:	putchars()
+ * DESCRIPTION:	output encoded characters, breaking lines
+ */
+static
+int putchars(binhex *bh, const char *ptr, int len)
+{
+  int chunk;
+
+  while (len)
     {
-      __ERROR(EIO, "error writing hqx header");
+      if (bh->col == MAXLINELEN)
+	{
+	  if (putout(bh, "\n", 1) == -1)
+	    return -1;
 
-      fclose(file);
-      return -1;
+	  bh->col = 0;
+	}
+
+      chunk = MAXLINELEN - bh->col;
+      if (chunk > len)
+	chunk = len;
+
+      if (putout(bh, ptr, chunk) == -1)
+	return -1;
+
+      bh->col += chunk;
+      ptr     += chunk;
+      len     -= chunk;
     }
 
   return 0;
 }
 
 /*
- * NAME:	flushline()
- * DESCRIPTION:	flush a line to the output file
+ * NAME:	enc6()
+ * DESCRIPTION:	encode groups of three bytes as four hqx characters
  */
 static
-int flushline(void)
+void enc6(const unsigned char *in, int groups, char *out)
 {
-  line[lptr++] = '\n';
-  line[lptr++] = 0;
+  unsigned long w;
 
-  if (fputs(line, file) == EOF)
+  while (groups--)
     {
-      __ERROR(EIO, "error writing output data");
-      return -1;
-    }
+      w = ((unsigned long) in[0] << 16) | (in[1] << 8) | in[2];
 
-  lptr = 0;
+      out[0] = enmap[(w >> 18) & 0x3f];
+      out[1] = enmap[(w >> 12) & 0x3f];
+      out[2] = enmap[(w >>  6) & 0x3f];
+      out[3] = enmap[(w >>  0) & 0x3f];
 
-  return 0;
+      in  += 3;
+      out += 4;
+    }
 }
 
 /*
- * NAME:	addchars()
- * DESCRIPTION:	insert bytes of data to the output stream
+ * NAME:	encflush()
+ * DESCRIPTION:	encode the buffered RLE90 stream, padding it at the end
  */
 static
-int addchars(const unsigned char *data, register int len)
+int encflush(binhex *bh, int final)
 {
-  register unsigned char c;
+  unsigned char pad[3];
+  int groups, left;
 
-  while (len--)
+  groups = bh->rlen / 3;
+  left   = bh->rlen % 3;
+
+  enc6(bh->rle, groups, bh->enc);
+
+  if (putchars(bh, bh->enc, groups * 4) == -1)
+    return -1;
+
+  memmove(bh->rle, bh->rle + groups * 3, left);
+  bh->rlen = left;
+
+  if (final && left)
     {
-      c = *data++;
+      /* one trailing byte takes two characters, two take four */
+
+      memset(pad, 0, sizeof(pad));
+      memcpy(pad, bh->rle, left);
+
+      enc6(pad, 1, bh->enc);
 
-      if (lptr == MAXLINELEN &&
-	  flushline() == -1)
+      if (putchars(bh, bh->enc, left == 1 ? 2 : 4) == -1)
 	return -1;
 
-      switch (state86 & 0xff00)
-	{
-	case 0x0000:
-	  line[lptr++] = enmap[c >> 2];
-	  state86 = 0x0100 | (c & 0x03);
-	  break;
+      bh->rlen = 0;
+    }
 
-	case 0x0100:
-	  line[lptr++] = enmap[((state86 & 0x03) << 4) | (c >> 4)];
-	  state86 = 0x0200 | (c & 0x0f);
-	  break;
+  return 0;
+}
 
-	case 0x0200:
-	  line[lptr++] = enmap[((state86 & 0x0f) << 2) | (c >> 6)];
+/*
+ * NAME:	rleput()
+ * DESCRIPTION:	append bytes to the RLE90 stream
+ */
+static
+int rleput(binhex *bh, const unsigned char *ptr, int len)
+{
+  int chunk;
 
-	  if (lptr == MAXLINELEN &&
-	      flushline() == -1)
-	    return -1;
+  while (len)
+    {
+      chunk = RLEBUFSZ - bh->rlen;
+      if (chunk > len)
+	chunk = len;
 
-	  line[lptr++] = enmap[c & 0x3f];
-	  state86 = 0;
-	  break;
-	}
+      memcpy(bh->rle + bh->rlen, ptr, chunk);
+
+      bh->rlen += chunk;
+      ptr      += chunk;
+      len      -= chunk;
+
+      if (bh->rlen == RLEBUFSZ &&
+	  encflush(bh, 0) == -1)
+	return -1;
     }
 
   return 0;
@@ -187,25 +303,25 @@ int addchars(const unsigned char *data, register int len)
  * DESCRIPTION:	run-length encode data
  */
 static
-int rleflush(void)
+int rleflush(binhex *bh)
 {
   unsigned char rle[] = { 0x90, 0x00, 0x90, 0x00 };
 
-  if ((lastch != 0x90 && runlen < 4) ||
-      (lastch == 0x90 && runlen < 3))
+  if ((bh->lastch != 0x90 && bh->runlen < 4) ||
+      (bh->lastch == 0x90 && bh->runlen < 3))
     {
       /* self representation */
 
-      if (lastch == 0x90)
+      if (bh->lastch == 0x90)
 	{
-	  while (runlen--)
-	    if (addchars(rle, 2) == -1)
+	  while (bh->runlen--)
+	    if (rleput(bh, rle, 2) == -1)
 	      return -1;
 	}
       else
 	{
-	  while (runlen--)
-	    if (addchars(&lastch, 1) == -1)
+	  while (bh->runlen--)
+	    if (rleput(bh, &bh->lastch, 1) == -1)
 	      return -1;
 	}
     }
@@ -213,57 +329,154 @@ int rleflush(void)
     {
       /* run-length encoded */
 
-      if (lastch == 0x90)
+      if (bh->lastch == 0x90)
 	{
-	  rle[3] = runlen;
+	  rle[3] = bh->runlen;
 
-	  if (addchars(rle, 4) == -1)
+	  if (rleput(bh, rle, 4) == -1)
 	    return -1;
 	}
       else
 	{
-	  rle[1] = lastch;
-	  rle[3] = runlen;
+	  rle[1] = bh->lastch;
+	  rle[3] = bh->runlen;
 
-	  if (addchars(&rle[1], 3) == -1)
+	  if (rleput(bh, &rle[1], 3) == -1)
 	    return -1;
 	}
     }
 
-  runlen = 0;
+  bh->runlen = 0;
 
   return 0;
 }
 
+/*
+ * NAME:	literals()
+ * DESCRIPTION:	count leading bytes that differ from their predecessor and
+ *		from the RLE90 marker, and so stand for themselves
+ */
+static
+int literals(const unsigned char *data, int len, unsigned char prev)
+{
+  int i = 1;
+
+  if (len == 0 || data[0] == prev || data[0] == 0x90)
+    return 0;
+
+# ifdef HAVE_SSE2
+  {
+    __m128i marker = _mm_set1_epi8((char) 0x90);
+
+    for ( ; i + 16 <= len; i += 16)
+      {
+	__m128i v = _mm_loadu_si128((const __m128i *) (data + i));
+	__m128i p = _mm_loadu_si128((const __m128i *) (data + i - 1));
+
+	if (_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, p),
+					   _mm_cmpeq_epi8(v, marker))))
+	  break;
+      }
+  }
+# endif
+
+  for ( ; i < len; ++i)
+    {
+      if (data[i] == data[i - 1] || data[i] == 0x90)
+	break;
+    }
+
+  return i;
+}
+
+/*
+ * NAME:	bh->start()
+ * DESCRIPTION:	begin BinHex encoding
+ */
+binhex *bh_start(int fd)
+{
+  binhex *bh;
+
+  bh = malloc(sizeof(binhex));
+  if (bh == 0)
+    {
+      __ERROR(ENOMEM, 0);
+      return 0;
+    }
+
+  bh->fd = fd;
+
+  bh->crc    = 0x0000;
+  bh->lastch = 0;
+  bh->runlen = 0;
+
+  bh->olen = 0;
+  bh->rlen = 0;
+
+  if (putout(bh, hqxheader, sizeof(hqxheader) - 1) == -1 ||
+      putout(bh, ":", 1) == -1)
+    {
+      __ERROR(errno, "error writing hqx header");
+
+      free(bh);
+      return 0;
+    }
+
+  bh->col = 1;
+
+  return bh;
+}
+
 /*
  * NAME:	bh->insert()
  * DESCRIPTION:	encode bytes of data, buffering lines and flushing
  */
-int bh_insert(const void *buf, register int len)
+int bh_insert(binhex *bh, const void *buf, register int len)
 {
   register const unsigned char *data = buf;
+  int count;
 
-  crc = crc_binh(data, len, crc);
+  bh->crc = crc_binh(data, len, bh->crc);
 
-  for ( ; len--; ++data)
+  while (len)
     {
-      if (runlen)
+      /* a single pending byte followed by bytes that stand for themselves */
+
+      if (bh->runlen == 1 && bh->lastch != 0x90 &&
+	  (count = literals(data, len, bh->lastch)) > 0)
+	{
+	  if (rleput(bh, &bh->lastch, 1) == -1 ||
+	      rleput(bh, data, count - 1) == -1)
+	    return -1;
+
+	  bh->lastch = data[count - 1];
+
+	  data += count;
+	  len  -= count;
+
+	  continue;
+	}
+
+      if (bh->runlen)
 	{
-	  if (runlen == 0xff || lastch != *data)
+	  if (bh->runlen == 0xff || bh->lastch != *data)
 	    {
-	      if (rleflush() == -1)
+	      if (rleflush(bh) == -1)
 		return -1;
 	    }
 
-	  if (lastch == *data)
+	  if (bh->lastch == *data)
 	    {
-	      ++runlen;
+	      ++bh->runlen;
+	      ++data;
+	      --len;
 	      continue;
 	    }
 	}
 
-      lastch = *data;
-      runlen = 1;
+      bh->lastch = *data++;
+      bh->runlen = 1;
+      --len;
     }
 
   return 0;
@@ -273,19 +486,19 @@ int bh_insert(const void *buf, register int len)
  * NAME:	bh->insertcrc()
  * DESCRIPTION:	insert a two-byte CRC checksum
  */
-int bh_insertcrc(void)
+int bh_insertcrc(binhex *bh)
 {
   unsigned char word[2];
 
-  crc = crc_binh(zero, 2, crc);
+  bh->crc = crc_binh(zero, 2, bh->crc);
 
-  word[0] = (crc & 0xff00) >> 8;
-  word[1] = (crc & 0x00ff) >> 0;
+  word[0] = (bh->crc & 0xff00) >> 8;
+  word[1] = (bh->crc & 0x00ff) >> 0;
 
-  if (bh_insert(word, 2) == -1)
+  if (bh_insert(bh, word, 2) == -1)
     return -1;
 
-  crc = 0x0000;
+  bh->crc = 0x0000;
 
   return 0;
 }
@@ -294,77 +507,102 @@ int bh_insertcrc(void)
  * NAME:	bh->end()
  * DESCRIPTION:	finish BinHex encoding
  */
-int bh_end(void)
+int bh_end(binhex *bh)
 {
   int result = 0;
 
-  if (runlen &&
-      rleflush() == -1)
+  if (bh->runlen &&
+      rleflush(bh) == -1)
     result = -1;
 
-  if (state86 && result == 0 &&
-      addchars(zero, 1) == -1)
+  if (result == 0 &&
+      encflush(bh, 1) == -1)
     result = -1;
 
-  line[lptr++] = ':';
-
   if (result == 0 &&
-      flushline() == -1)
+      (putout(bh, ":\n", 2) == -1 || flushout(bh) == -1))
     result = -1;
 
-  if (fclose(file) == EOF && result == 0)
-    {
-      __ERROR(errno, "error flushing output data");
-      result = -1;
-    }
+  free(bh);
 
   return result;
 }
 
 /* BinHex Decoding ========================================================= */
 
+/*
+ * NAME:	fillin()
+ * DESCRIPTION:	refill the input buffer; return the number of bytes read
+ */
+static
+int fillin(binhex *bh)
+{
+  bh->ilen = read(bh->fd, bh->io, IOBUFSZ);
+  bh->ipos = 0;
+
+  if (bh->ilen <= 0)
+    {
+      bh->ierr    = bh->ilen ? errno : EINVAL;
+      bh->ierrstr = bh->ilen ? "error reading input file" :
+			       "unexpected end of file";
+      bh->ilen = 0;
+    }
+
+  return bh->ilen;
+}
+
+/*
+ * NAME:	getch()
+ * DESCRIPTION:	return the next byte of the input file, or EOF
+ */
+static
+int getch(binhex *bh)
+{
+  if (bh->ipos == bh->ilen && fillin(bh) == 0)
+    return EOF;
+
+  return bh->io[bh->ipos++];
+}
+
 /*
  * NAME:	bh->open()
  * DESCRIPTION:	begin BinHex decoding
  */
-int bh_open(int fd)
+binhex *bh_open(int fd)
 {
-  int dupfd, c;
+  binhex *bh;
+  int c;
   const char *ptr;
 
-  dupfd = dup(fd);
-  if (dupfd == -1)
+  bh = malloc(sizeof(binhex));
+  if (bh == 0)
     {
-      __ERROR(errno, "error duplicating input stream");
-      return -1;
+      __ERROR(ENOMEM, 0);
+      return 0;
     }
 
-  file = fdopen(dupfd, "rb");
-  if (file == 0)
-    {
-      __ERROR(errno, "error creating input buffer");
+  bh->fd = fd;
 
-      close(dupfd);
-      return -1;
-    }
-
-  state86 = 0;
-  runlen  = 0;
+  bh->crc    = 0x0000;
+  bh->lastch = 0;
+  bh->runlen = 0;
 
-  crc = 0x0000;
+  bh->ipos  = bh->ilen = 0;
+  bh->dpos  = bh->dlen = 0;
+  bh->bits  = 0;
+  bh->nbits = 0;
+  bh->ierr  = 0;
 
   /* find hqx header */
 
   ptr = hqxheader;
   while (ptr == 0 || ptr - hqxheader < HEADERMATCH)
     {
-      c = getc(file);
+      c = getch(bh);
       if (c == EOF)
 	{
 	  __ERROR(EINVAL, "hqx file header not found");
-
-	  fclose(file);
-	  return -1;
+	  goto fail;
 	}
 
       if (c == '\n' || c == '\r')
@@ -381,13 +619,11 @@ int bh_open(int fd)
 
   do
     {
-      c = getc(file);
+      c = getch(bh);
       if (c == EOF)
 	{
 	  __ERROR(EINVAL, "corrupt hqx file");
-
-	  fclose(file);
-	  return -1;
+	  goto fail;
 	}
     }
   while (c != '\n' && c != '\r');
@@ -396,13 +632,11 @@ int bh_open(int fd)
 
   do
     {
-      c = getc(file);
+      c = getch(bh);
       if (c == EOF)
 	{
 	  __ERROR(EINVAL, "corrupt hqx file");
-
-	  fclose(file);
-	  return -1;
+	  goto fail;
 	}
     }
   while (ISRETURN(c));
@@ -410,154 +644,194 @@ int bh_open(int fd)
   if (c != ':')
     {
       __ERROR(EINVAL, "corrupt hqx file");
-
-      fclose(file);
-      return -1;
+      goto fail;
     }
 
+  return bh;
+
+fail:
+  free(bh);
   return 0;
 }
 
 /*
- * NAME:	hqxchar()
- * DESCRIPTION:	return the next hqx character from the input stream
+ * NAME:	dec6()
+ * DESCRIPTION:	decode hqx characters into the RLE90 buffer; return count
  */
 static
-int hqxchar(void)
+int dec6(binhex *bh)
 {
+  unsigned char *out = bh->rle, *end = bh->rle + RLEBUFSZ;
+  const unsigned char *in, *lim;
+  unsigned long w;
   int c;
 
-  do
-    c = getc(file);
-  while (c != EOF && ISRETURN(c));
+  bh->dpos = 0;
 
-  if (c == EOF)
+  while (bh->ierr == 0 && end - out >= 3)
     {
-      if (feof(file))
-	__ERROR(EINVAL, "unexpected end of file");
-      else
-	__ERROR(EIO, "error reading input file");
+      if (bh->ipos == bh->ilen && fillin(bh) == 0)
+	break;
 
-      return -1;
-    }
+      in  = bh->io + bh->ipos;
+      lim = bh->io + bh->ilen;
 
-  c = demap[(unsigned char) c];
-  if (c == 0)
-    {
-      __ERROR(EINVAL, "illegal character in hqx file");
-      return -1;
-    }
+      /* whole groups of four characters between line breaks */
 
-  return c - 1;
-}
+      if (bh->nbits == 0)
+	{
+	  while (lim - in >= 4 && end - out >= 3)
+	    {
+	      if ((detab[in[0]] | detab[in[1]] |
+		   detab[in[2]] | detab[in[3]]) & (SPC | BAD))
+		break;
 
-/*
- * NAME:	nextchar()
- * DESCRIPTION:	decode one character from the hqx stream
- */
-static
-int nextchar(void)
-{
-  int c, c2, ch;
+	      w = ((unsigned long) detab[in[0]] << 18) | (detab[in[1]] << 12) |
+		  (detab[in[2]] << 6) | detab[in[3]];
 
-  c = hqxchar();
-  if (c == -1)
-    return -1;
+	      out[0] = (unsigned char) (w >> 16);
+	      out[1] = (unsigned char) (w >>  8);
+	      out[2] = (unsigned char) (w >>  0);
 
-  switch (state86 & 0xff00)
-    {
-    case 0x0000:
-      c2 = hqxchar();
-      if (c2 == -1)
-	return -1;
+	      in  += 4;
+	      out += 3;
+	    }
+	}
+
+      /* a single character at the end of a line, group, or buffer */
 
-      ch = (c << 2) | (c2 >> 4);
-      state86 = 0x0100 | (c2 & 0x0f);
-      break;
+      if (in < lim && end - out >= 3)
+	{
+	  c = detab[*in];
 
-    case 0x0100:
-      ch = ((state86 & 0x0f) << 4) | (c >> 2);
-      state86 = 0x0200 | (c & 0x03);
-      break;
+	  if (c == BAD)
+	    {
+	      bh->ierr    = EINVAL;
+	      bh->ierrstr = "illegal character in hqx file";
+	    }
+	  else
+	    {
+	      ++in;
+
+	      if (c != SPC)
+		{
+		  bh->bits   = ((bh->bits << 6) | c) & 0x3fff;
+		  bh->nbits += 6;
+
+		  if (bh->nbits >= 8)
+		    {
+		      bh->nbits -= 8;
+		      *out++ = (unsigned char) (bh->bits >> bh->nbits);
+		    }
+		}
+	    }
+	}
 
-    case 0x0200:
-      ch = ((state86 & 0x03) << 6) | c;
-      state86 = 0;
-      break;
+      bh->ipos = in - bh->io;
     }
 
-  return ch;
+  bh->dlen = out - bh->rle;
+
+  return bh->dlen;
 }
 
 /*
  * NAME:	bh->read()
  * DESCRIPTION:	decode and return bytes from the hqx stream
  */
-int bh_read(void *buf, register int len)
+int bh_read(binhex *bh, void *buf, register int len)
 {
   register unsigned char *data = buf;
-  const unsigned char *ptr = data;
-  int c, rl, count = len;
+  const unsigned char *src, *mark;
+  int count = len, chunk;
 
-  while (len--)
+  while (len)
     {
-      if (runlen)
+      if (bh->runlen)
 	{
-	  *data++ = lastch;
-	  --runlen;
+	  chunk = (bh->runlen < len) ? bh->runlen : len;
+
+	  memset(data, bh->lastch, chunk);
+
+	  bh->runlen -= chunk;
+	  data       += chunk;
+	  len        -= chunk;
+
 	  continue;
 	}
 
-      c = nextchar();
-      if (c == -1)
-	return -1;
+      if (bh->dpos == bh->dlen && dec6(bh) == 0)
+	goto fail;
 
-      if (c == 0x90)
+      /* copy through to the next RLE90 marker */
+
+      src   = bh->rle + bh->dpos;
+      chunk = bh->dlen - bh->dpos;
+      if (chunk > len)
+	chunk = len;
+
+      mark = memchr(src, 0x90, chunk);
+      if (mark)
+	chunk = mark - src;
+
+      if (chunk)
 	{
-	  rl = nextchar();
-	  if (rl == -1)
-	    return -1;
+	  memcpy(data, src, chunk);
 
-	  if (rl > 0)
-	    {
-	      runlen = rl - 1;
-	      ++len;
-	      continue;
-	    }
+	  bh->lastch = src[chunk - 1];
+	  bh->dpos  += chunk;
+	  data      += chunk;
+	  len       -= chunk;
+
+	  continue;
 	}
 
-      *data++ = lastch = c;
+      if (++bh->dpos == bh->dlen && dec6(bh) == 0)
+	goto fail;
+
+      chunk = bh->rle[bh->dpos++];
+      if (chunk > 0)
+	bh->runlen = chunk - 1;
+      else
+	{
+	  *data++ = bh->lastch = 0x90;
+	  --len;
+	}
     }
 
-  crc = crc_binh(ptr, count, crc);
+  bh->crc = crc_binh(buf, count, bh->crc);
 
   return count;
+
+fail:
+  __ERROR(bh->ierr, bh->ierrstr);
+  return -1;
 }
 
 /*
  * NAME:	bh->readcrc()
  * DESCRIPTION:	read and compare CRC bytes
  */
-int bh_readcrc(void)
+int bh_readcrc(binhex *bh)
 {
   unsigned short check;
   unsigned char word[2];
 
-  check = crc_binh(zero, 2, crc);
+  check = crc_binh(zero, 2, bh->crc);
 
-  if (bh_read(word, 2) < 2)
+  if (bh_read(bh, word, 2) < 2)
     return -1;
 
-  crc = (word[0] << 8) |
-        (word[1] << 0);
+  bh->crc = (word[0] << 8) |
+            (word[1] << 0);
 
-  if (crc != check)
+  if (bh->crc != check)
     {
       __ERROR(EINVAL, "CRC checksum error");
       return -1;
     }
 
-  crc = 0x0000;
+  bh->crc = 0x0000;
 
   return 0;
 }
@@ -566,14 +840,19 @@ int bh_readcrc(void)
  * NAME:	bh->close()
  * DESCRIPTION:	finish BinHex decoding
  */
-int bh_close(void)
+int bh_close(binhex *bh)
 {
   int c, result = 0;
 
+  /*
+   * Decoding reads ahead up to the first character that is not hqx data,
+   * so at most a padding character is left before the trailing colon.
+   */
+
   /* skip whitespace */
 
   do
-    c = getc(file);
+    c = getch(bh);
   while (c != EOF && ISRETURN(c));
 
   /* skip optional exclamation */
@@ -581,7 +860,7 @@ int bh_close(void)
   if (c == '!')
     {
       do
-	c = getc(file);
+	c = getch(bh);
       while (c != EOF && ISRETURN(c));
     }
 
@@ -593,11 +872,7 @@ int bh_close(void)
       result = -1;
     }
 
-  if (fclose(file) == EOF && result == 0)
-    {
-      __ERROR(errno, "error closing input file");
-      result = -1;
-    }
+  free(bh);
 
   return result;
 }
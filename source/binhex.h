@@ -17,14 +17,24 @@
  * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 
-extern const char *bh_error;
+typedef struct binhex binhex;
 
-int bh_start(int);
-int bh_insert(const void *, register int);
-int bh_insertcrc(void);
-int bh_end(void);
+/* each thread has its own, as the batch copies run BinHex on several */
 
-int bh_open(int);
-int bh_read(void *, register int);
-int bh_readcrc(void);
-int bh_close(void);
+# ifdef _MSC_VER
+#  define BH_THREAD	__declspec(thread)
+# else
+#  define BH_THREAD	__thread
+# endif
+
+extern BH_THREAD const char *bh_error;
+
+binhex *bh_start(int);
+int bh_insert(binhex *, const void *, register int);
+int bh_insertcrc(binhex *);
+int bh_end(binhex *);
+
+binhex *bh_open(int);
+int bh_read(binhex *, void *, register int);
+int bh_readcrc(binhex *);
+int bh_close(binhex *);
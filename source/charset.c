@@ -18,6 +18,9 @@
  */
 
 # include "charset.h"
+
+# ifdef _WIN32
+
 # include <windows.h>
 
 char *utf16ToMacRoman(const wchar_t *input)
@@ -79,140 +82,269 @@ wchar_t *macRomanToUtf16(const char *input)
 	return output;
 }
 
-// input *not* null-terminated
-char *macRomanToUtf8Chunk(const char *input, int chunk_size, int * result_size)
+# endif
+
+/*
+ * Streaming text transcoding
+ *
+ * Text-mode copies convert whole files a chunk at a time without going
+ * through UTF-16: MacRoman bytes map to UTF-8 by table, and UTF-8 is
+ * decoded with its state carried from one chunk to the next so that
+ * sequences split across a chunk boundary come out whole. Line endings
+ * are translated in the same pass. Runs of ASCII are handled 16 bytes
+ * at a time where SSE2 is available.
+ */
+
+# if defined(_M_X64) || defined(_M_AMD64) || defined(__SSE2__)
+#  include <emmintrin.h>
+#  define HAVE_SSE2
+# endif
+
+// UTF-8 encodings of MacRoman 0x80-0xFF: length, then the bytes
+static const unsigned char macutf8[128][4] = {
+	{ 2, 0xc3, 0x84, 0 }, { 2, 0xc3, 0x85, 0 }, { 2, 0xc3, 0x87, 0 }, { 2, 0xc3, 0x89, 0 },	/* 80 */
+	{ 2, 0xc3, 0x91, 0 }, { 2, 0xc3, 0x96, 0 }, { 2, 0xc3, 0x9c, 0 }, { 2, 0xc3, 0xa1, 0 },	/* 84 */
+	{ 2, 0xc3, 0xa0, 0 }, { 2, 0xc3, 0xa2, 0 }, { 2, 0xc3, 0xa4, 0 }, { 2, 0xc3, 0xa3, 0 },	/* 88 */
+	{ 2, 0xc3, 0xa5, 0 }, { 2, 0xc3, 0xa7, 0 }, { 2, 0xc3, 0xa9, 0 }, { 2, 0xc3, 0xa8, 0 },	/* 8C */
+	{ 2, 0xc3, 0xaa, 0 }, { 2, 0xc3, 0xab, 0 }, { 2, 0xc3, 0xad, 0 }, { 2, 0xc3, 0xac, 0 },	/* 90 */
+	{ 2, 0xc3, 0xae, 0 }, { 2, 0xc3, 0xaf, 0 }, { 2, 0xc3, 0xb1, 0 }, { 2, 0xc3, 0xb3, 0 },	/* 94 */
+	{ 2, 0xc3, 0xb2, 0 }, { 2, 0xc3, 0xb4, 0 }, { 2, 0xc3, 0xb6, 0 }, { 2, 0xc3, 0xb5, 0 },	/* 98 */
+	{ 2, 0xc3, 0xba, 0 }, { 2, 0xc3, 0xb9, 0 }, { 2, 0xc3, 0xbb, 0 }, { 2, 0xc3, 0xbc, 0 },	/* 9C */
+	{ 3, 0xe2, 0x80, 0xa0 }, { 2, 0xc2, 0xb0, 0 }, { 2, 0xc2, 0xa2, 0 }, { 2, 0xc2, 0xa3, 0 },	/* A0 */
+	{ 2, 0xc2, 0xa7, 0 }, { 3, 0xe2, 0x80, 0xa2 }, { 2, 0xc2, 0xb6, 0 }, { 2, 0xc3, 0x9f, 0 },	/* A4 */
+	{ 2, 0xc2, 0xae, 0 }, { 2, 0xc2, 0xa9, 0 }, { 3, 0xe2, 0x84, 0xa2 }, { 2, 0xc2, 0xb4, 0 },	/* A8 */
+	{ 2, 0xc2, 0xa8, 0 }, { 3, 0xe2, 0x89, 0xa0 }, { 2, 0xc3, 0x86, 0 }, { 2, 0xc3, 0x98, 0 },	/* AC */
+	{ 3, 0xe2, 0x88, 0x9e }, { 2, 0xc2, 0xb1, 0 }, { 3, 0xe2, 0x89, 0xa4 }, { 3, 0xe2, 0x89, 0xa5 },	/* B0 */
+	{ 2, 0xc2, 0xa5, 0 }, { 2, 0xc2, 0xb5, 0 }, { 3, 0xe2, 0x88, 0x82 }, { 3, 0xe2, 0x88, 0x91 },	/* B4 */
+	{ 3, 0xe2, 0x88, 0x8f }, { 2, 0xcf, 0x80, 0 }, { 3, 0xe2, 0x88, 0xab }, { 2, 0xc2, 0xaa, 0 },	/* B8 */
+	{ 2, 0xc2, 0xba, 0 }, { 2, 0xce, 0xa9, 0 }, { 2, 0xc3, 0xa6, 0 }, { 2, 0xc3, 0xb8, 0 },	/* BC */
+	{ 2, 0xc2, 0xbf, 0 }, { 2, 0xc2, 0xa1, 0 }, { 2, 0xc2, 0xac, 0 }, { 3, 0xe2, 0x88, 0x9a },	/* C0 */
+	{ 2, 0xc6, 0x92, 0 }, { 3, 0xe2, 0x89, 0x88 }, { 3, 0xe2, 0x88, 0x86 }, { 2, 0xc2, 0xab, 0 },	/* C4 */
+	{ 2, 0xc2, 0xbb, 0 }, { 3, 0xe2, 0x80, 0xa6 }, { 2, 0xc2, 0xa0, 0 }, { 2, 0xc3, 0x80, 0 },	/* C8 */
+	{ 2, 0xc3, 0x83, 0 }, { 2, 0xc3, 0x95, 0 }, { 2, 0xc5, 0x92, 0 }, { 2, 0xc5, 0x93, 0 },	/* CC */
+	{ 3, 0xe2, 0x80, 0x93 }, { 3, 0xe2, 0x80, 0x94 }, { 3, 0xe2, 0x80, 0x9c }, { 3, 0xe2, 0x80, 0x9d },	/* D0 */
+	{ 3, 0xe2, 0x80, 0x98 }, { 3, 0xe2, 0x80, 0x99 }, { 2, 0xc3, 0xb7, 0 }, { 3, 0xe2, 0x97, 0x8a },	/* D4 */
+	{ 2, 0xc3, 0xbf, 0 }, { 2, 0xc5, 0xb8, 0 }, { 3, 0xe2, 0x81, 0x84 }, { 3, 0xe2, 0x82, 0xac },	/* D8 */
+	{ 3, 0xe2, 0x80, 0xb9 }, { 3, 0xe2, 0x80, 0xba }, { 3, 0xef, 0xac, 0x81 }, { 3, 0xef, 0xac, 0x82 },	/* DC */
+	{ 3, 0xe2, 0x80, 0xa1 }, { 2, 0xc2, 0xb7, 0 }, { 3, 0xe2, 0x80, 0x9a }, { 3, 0xe2, 0x80, 0x9e },	/* E0 */
+	{ 3, 0xe2, 0x80, 0xb0 }, { 2, 0xc3, 0x82, 0 }, { 2, 0xc3, 0x8a, 0 }, { 2, 0xc3, 0x81, 0 },	/* E4 */
+	{ 2, 0xc3, 0x8b, 0 }, { 2, 0xc3, 0x88, 0 }, { 2, 0xc3, 0x8d, 0 }, { 2, 0xc3, 0x8e, 0 },	/* E8 */
+	{ 2, 0xc3, 0x8f, 0 }, { 2, 0xc3, 0x8c, 0 }, { 2, 0xc3, 0x93, 0 }, { 2, 0xc3, 0x94, 0 },	/* EC */
+	{ 3, 0xef, 0xa3, 0xbf }, { 2, 0xc3, 0x92, 0 }, { 2, 0xc3, 0x9a, 0 }, { 2, 0xc3, 0x9b, 0 },	/* F0 */
+	{ 2, 0xc3, 0x99, 0 }, { 2, 0xc4, 0xb1, 0 }, { 2, 0xcb, 0x86, 0 }, { 2, 0xcb, 0x9c, 0 },	/* F4 */
+	{ 2, 0xc2, 0xaf, 0 }, { 2, 0xcb, 0x98, 0 }, { 2, 0xcb, 0x99, 0 }, { 2, 0xcb, 0x9a, 0 },	/* F8 */
+	{ 2, 0xc2, 0xb8, 0 }, { 2, 0xcb, 0x9d, 0 }, { 2, 0xcb, 0x9b, 0 }, { 2, 0xcb, 0x87, 0 }	/* FC */
+};
+
+// MacRoman for each Unicode character it has, by code point
+static const struct {
+	unsigned short uc;
+	unsigned char mac;
+} unimac[129] = {
+	{ 0x00a0, 0xca }, { 0x00a1, 0xc1 }, { 0x00a2, 0xa2 }, { 0x00a3, 0xa3 }, { 0x00a4, 0xdb },
+	{ 0x00a5, 0xb4 }, { 0x00a7, 0xa4 }, { 0x00a8, 0xac }, { 0x00a9, 0xa9 }, { 0x00aa, 0xbb },
+	{ 0x00ab, 0xc7 }, { 0x00ac, 0xc2 }, { 0x00ae, 0xa8 }, { 0x00af, 0xf8 }, { 0x00b0, 0xa1 },
+	{ 0x00b1, 0xb1 }, { 0x00b4, 0xab }, { 0x00b5, 0xb5 }, { 0x00b6, 0xa6 }, { 0x00b7, 0xe1 },
+	{ 0x00b8, 0xfc }, { 0x00ba, 0xbc }, { 0x00bb, 0xc8 }, { 0x00bf, 0xc0 }, { 0x00c0, 0xcb },
+	{ 0x00c1, 0xe7 }, { 0x00c2, 0xe5 }, { 0x00c3, 0xcc }, { 0x00c4, 0x80 }, { 0x00c5, 0x81 },
+	{ 0x00c6, 0xae }, { 0x00c7, 0x82 }, { 0x00c8, 0xe9 }, { 0x00c9, 0x83 }, { 0x00ca, 0xe6 },
+	{ 0x00cb, 0xe8 }, { 0x00cc, 0xed }, { 0x00cd, 0xea }, { 0x00ce, 0xeb }, { 0x00cf, 0xec },
+	{ 0x00d1, 0x84 }, { 0x00d2, 0xf1 }, { 0x00d3, 0xee }, { 0x00d4, 0xef }, { 0x00d5, 0xcd },
+	{ 0x00d6, 0x85 }, { 0x00d8, 0xaf }, { 0x00d9, 0xf4 }, { 0x00da, 0xf2 }, { 0x00db, 0xf3 },
+	{ 0x00dc, 0x86 }, { 0x00df, 0xa7 }, { 0x00e0, 0x88 }, { 0x00e1, 0x87 }, { 0x00e2, 0x89 },
+	{ 0x00e3, 0x8b }, { 0x00e4, 0x8a }, { 0x00e5, 0x8c }, { 0x00e6, 0xbe }, { 0x00e7, 0x8d },
+	{ 0x00e8, 0x8f }, { 0x00e9, 0x8e }, { 0x00ea, 0x90 }, { 0x00eb, 0x91 }, { 0x00ec, 0x93 },
+	{ 0x00ed, 0x92 }, { 0x00ee, 0x94 }, { 0x00ef, 0x95 }, { 0x00f1, 0x96 }, { 0x00f2, 0x98 },
+	{ 0x00f3, 0x97 }, { 0x00f4, 0x99 }, { 0x00f5, 0x9b }, { 0x00f6, 0x9a }, { 0x00f7, 0xd6 },
+	{ 0x00f8, 0xbf }, { 0x00f9, 0x9d }, { 0x00fa, 0x9c }, { 0x00fb, 0x9e }, { 0x00fc, 0x9f },
+	{ 0x00ff, 0xd8 }, { 0x0131, 0xf5 }, { 0x0152, 0xce }, { 0x0153, 0xcf }, { 0x0178, 0xd9 },
+	{ 0x0192, 0xc4 }, { 0x02c6, 0xf6 }, { 0x02c7, 0xff }, { 0x02d8, 0xf9 }, { 0x02d9, 0xfa },
+	{ 0x02da, 0xfb }, { 0x02db, 0xfe }, { 0x02dc, 0xf7 }, { 0x02dd, 0xfd }, { 0x03a9, 0xbd },
+	{ 0x03c0, 0xb9 }, { 0x2013, 0xd0 }, { 0x2014, 0xd1 }, { 0x2018, 0xd4 }, { 0x2019, 0xd5 },
+	{ 0x201a, 0xe2 }, { 0x201c, 0xd2 }, { 0x201d, 0xd3 }, { 0x201e, 0xe3 }, { 0x2020, 0xa0 },
+	{ 0x2021, 0xe0 }, { 0x2022, 0xa5 }, { 0x2026, 0xc9 }, { 0x2030, 0xe4 }, { 0x2039, 0xdc },
+	{ 0x203a, 0xdd }, { 0x2044, 0xda }, { 0x20ac, 0xdb }, { 0x2122, 0xaa }, { 0x2202, 0xb6 },
+	{ 0x2206, 0xc6 }, { 0x220f, 0xb8 }, { 0x2211, 0xb7 }, { 0x221a, 0xc3 }, { 0x221e, 0xb0 },
+	{ 0x222b, 0xba }, { 0x2248, 0xc5 }, { 0x2260, 0xad }, { 0x2264, 0xb2 }, { 0x2265, 0xb3 },
+	{ 0x25ca, 0xd7 }, { 0xf8ff, 0xf0 }, { 0xfb01, 0xde }, { 0xfb02, 0xdf }
+};
+
+static
+int toMacRoman(unsigned long uc)
 {
-	// Get size of destination buffer (in wchar_ts)
-	int utf16_len = MultiByteToWideChar(CP_MACCP, 0, input, chunk_size, NULL, 0);
-	if (!utf16_len) return NULL;
+	int lo = 0, hi = sizeof(unimac) / sizeof(unimac[0]) - 1, mid;
 
-	// Allocate destination buffer
-	wchar_t * utf16 = malloc(utf16_len * sizeof(wchar_t));
-	if (!utf16) return NULL;
+	while (lo <= hi)
+	{
+		mid = (lo + hi) / 2;
+
+		if (unimac[mid].uc == uc)
+			return unimac[mid].mac;
+		else if (unimac[mid].uc < uc)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
 
-	// MacRoman to UTF-16
-	int result = MultiByteToWideChar(
-		CP_MACCP,	// convert from MacRoman
-		0,
+	return '?';
+}
 
-		input,		// source string
-		chunk_size,	// total length of source string, in CHARs (= bytes), including end-of-string
+// copy ASCII from in to out replacing from with to, up to the first
+// byte with the high bit set; return the number of bytes copied
+static
+int asciiRun(const unsigned char *in, int len, unsigned char *out, char from, char to)
+{
+	int i = 0;
 
-		utf16,		// destination buffer
-		utf16_len	// size of destination buffer, in WCHARs
-	);
+# ifdef HAVE_SSE2
+	__m128i match = _mm_set1_epi8(from);
+	__m128i flip  = _mm_set1_epi8(from ^ to);
 
-	if (!result)
+	for (; i + 16 <= len; i += 16)
 	{
-		free(utf16);
-		return NULL;
-	}
+		__m128i v = _mm_loadu_si128((const __m128i *) (in + i));
 
-	// Get size of destination buffer
-	int utf8_len = WideCharToMultiByte(CP_UTF8, 0, utf16, -1, NULL, 0, NULL, NULL);
-	if (!utf8_len)
-	{
-		free(utf16);
-		return NULL;
-	}
+		if (_mm_movemask_epi8(v))
+			break;
 
-	// Allocate destination buffer
-	char * utf8 = malloc(utf8_len + 1);
-	if (!utf8)
-	{
-		free(utf16);
-		return NULL;
+		v = _mm_xor_si128(v, _mm_and_si128(_mm_cmpeq_epi8(v, match), flip));
+		_mm_storeu_si128((__m128i *) (out + i), v);
 	}
+# endif
 
-	// UTF-16 to UTF-8
-	*result_size = WideCharToMultiByte(
-		CP_UTF8,    // convert to UTF-8
-		0,
-
-		utf16,      // source UTF-16 string
-		utf16_len,  // total length of source UTF-8 string, in WCHARs (= bytes), including end-of-string
+	for (; i < len && in[i] < 0x80; ++i)
+		out[i] = (in[i] == (unsigned char) from) ? to : in[i];
 
-		utf8,       // destination buffer
-		utf8_len,   // size of destination buffer, in WCHARs
+	return i;
+}
 
-		NULL,
-		NULL
-	);
+// input *not* null-terminated; out must hold 3 * len bytes
+int macRomanToUtf8Text(const char *input, int len, char *out)
+{
+	const unsigned char *in = (const unsigned char *) input;
+	unsigned char *ptr = (unsigned char *) out;
+	const unsigned char *enc;
+	int i = 0, n;
 
-	free(utf16);
-	if (!*result_size)
+	while (i < len)
 	{
-		free(utf8);
-		return NULL;
+		n = asciiRun(in + i, len - i, ptr, '\r', '\n');
+		i   += n;
+		ptr += n;
+
+		for (; i < len && in[i] >= 0x80; ++i)
+		{
+			enc = macutf8[in[i] - 0x80];
+
+			*ptr++ = enc[1];
+			*ptr++ = enc[2];
+			if (enc[0] == 3)
+				*ptr++ = enc[3];
+		}
 	}
-	return utf8;
+
+	return (int) (ptr - (unsigned char *) out);
 }
 
-// input *not* null-terminated
-char *utf8ToMacRomanChunk(const char *input, int chunk_size, int * result_size)
+void utf8StateInit(utf8state *state)
 {
-	// Get size of destination buffer (in wchar_ts)
-	int utf16_len = MultiByteToWideChar(CP_UTF8, 0, input, chunk_size, NULL, 0);
-	if (!utf16_len) return NULL;
-
-	// Allocate destination buffer
-	wchar_t * utf16 = malloc(utf16_len * sizeof(wchar_t));
-	if (!utf16) return NULL;
-
-	// UTF-8 to UTF-16
-	int result = MultiByteToWideChar(
-		CP_UTF8,     // convert from UTF-8
-		0,
-
-		input,       // source UTF-8 string
-		chunk_size,  // total length of source UTF-8 string
-
-		utf16,       // destination buffer
-		utf16_len    // size of destination buffer (in wchar_ts)
-	);
-
-	if (!result)
-	{
-		free(utf16);
-		return NULL;
-	}
+	state->uc   = 0;
+	state->need = 0;
+	state->lo   = 0x80;
+	state->hi   = 0xbf;
+}
 
-	// Get size of destination buffer
-	int macroman_len = WideCharToMultiByte(CP_MACCP, 0, utf16, -1, NULL, 0, NULL, NULL);
-	if (!macroman_len)
-	{
-		free(utf16);
-		return NULL;
-	}
+// input *not* null-terminated; out must hold len + 1 bytes
+int utf8ToMacRomanText(utf8state *state, const char *input, int len, char *out)
+{
+	const unsigned char *in = (const unsigned char *) input;
+	unsigned char *ptr = (unsigned char *) out;
+	unsigned char c;
+	int i = 0, n;
 
-	// Allocate destination buffer
-	char * macroman = malloc(macroman_len);
-	if (!macroman)
+	while (i < len)
 	{
-		free(utf16);
-		return NULL;
+		if (state->need == 0)
+		{
+			n = asciiRun(in + i, len - i, ptr, '\n', '\r');
+			i   += n;
+			ptr += n;
+
+			if (i == len)
+				break;
+		}
+
+		c = in[i];
+
+		if (state->need)
+		{
+			if (c >= state->lo && c <= state->hi)
+			{
+				state->uc = (state->uc << 6) | (c & 0x3f);
+				state->lo = 0x80;
+				state->hi = 0xbf;
+				++i;
+
+				if (--state->need == 0)
+					*ptr++ = (unsigned char) toMacRoman(state->uc);
+
+				continue;
+			}
+
+			// truncated sequence; c starts over
+			*ptr++ = '?';
+			state->need = 0;
+			state->lo   = 0x80;
+			state->hi   = 0xbf;
+		}
+
+		++i;
+
+		if (c < 0x80)
+			*ptr++ = (c == '\n') ? '\r' : c;
+		else if (c >= 0xc2 && c <= 0xdf)
+		{
+			state->uc   = c & 0x1f;
+			state->need = 1;
+		}
+		else if (c >= 0xe0 && c <= 0xef)
+		{
+			state->uc   = c & 0x0f;
+			state->need = 2;
+
+			// no overlong forms or surrogates
+			if (c == 0xe0)
+				state->lo = 0xa0;
+			else if (c == 0xed)
+				state->hi = 0x9f;
+		}
+		else if (c >= 0xf0 && c <= 0xf4)
+		{
+			state->uc   = c & 0x07;
+			state->need = 3;
+
+			// no overlong forms or code points past U+10FFFF
+			if (c == 0xf0)
+				state->lo = 0x90;
+			else if (c == 0xf4)
+				state->hi = 0x8f;
+		}
+		else
+			*ptr++ = '?';
 	}
 
-	// UTF-16 to MacRoman
-	*result_size = WideCharToMultiByte(
-		CP_MACCP,    // convert to MacRoman
-		0,
+	return (int) (ptr - (unsigned char *) out);
+}
 
-		utf16,       // source UTF-16 string
-		utf16_len,	 // total length of source string (in wchar_ts)
+// finish a UTF-8 stream; out must hold 1 byte
+int utf8ToMacRomanEnd(utf8state *state, char *out)
+{
+	int len = 0;
 
-		macroman,    // destination buffer
-		macroman_len,  // size of destination buffer
+	if (state->need)
+		out[len++] = '?';
 
-		NULL,
-		NULL
-	);
+	utf8StateInit(state);
 
-	free(utf16);
-	if (!*result_size)
-	{
-		free(macroman);
-		return NULL;
-	}
-	return macroman;
+	return len;
 }
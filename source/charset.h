@@ -22,5 +22,14 @@
 char *utf16ToMacRoman(const wchar_t *utf16);
 wchar_t *macRomanToUtf16(const char *input);
 
-char *macRomanToUtf8Chunk(const char *input, int chunk_size, int * result_size);
-char *utf8ToMacRomanChunk(const char *input, int chunk_size, int * result_size);
+typedef struct {
+	unsigned long uc;	// code point decoded so far
+	int need;		// continuation bytes still to come
+	unsigned char lo, hi;	// range allowed for the next one
+} utf8state;
+
+int macRomanToUtf8Text(const char *input, int len, char *out);
+
+void utf8StateInit(utf8state *state);
+int utf8ToMacRomanText(utf8state *state, const char *input, int len, char *out);
+int utf8ToMacRomanEnd(utf8state *state, char *out);
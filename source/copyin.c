@@ -19,16 +19,21 @@
 
 # include <fcntl.h>
 # include <unistd.h>
+# include <io.h>
 # include <stdlib.h>
 # include <string.h>
 # include <errno.h>
+# include <windows.h>
+# include <process.h>
 
 # include "hfs.h"
 # include "data.h"
+# include "queue.h"
 # include "copyin.h"
 # include "charset.h"
 # include "binhex.h"
 # include "crc.h"
+# include "iobuf.h"
 
 const char *cpi_error = "no error";
 
@@ -44,6 +49,56 @@ const char *cpi_error = "no error";
 # define RAW_TYPE	"????"
 # define RAW_CREA	"UNIX"
 
+# define AS_MAGIC	0x00051600	/* AppleSingle */
+# define AD_MAGIC	0x00051607	/* AppleDouble */
+# define AS_VERSION1	0x00010000
+# define AS_VERSION	0x00020000
+
+# define AS_DATA	1		/* entry IDs */
+# define AS_RSRC	2
+# define AS_NAME	3
+# define AS_DATES	8
+# define AS_FINFO	9
+
+# define AS_HEADERSZ	26
+# define AS_MAXENTRIES	64
+# define AS_EPOCH	946684800L	/* 2000-01-01 00:00 GMT */
+# define AS_NODATE	0x80000000UL
+# define AS_TOEOF	((unsigned long) -1)
+
+# define BATCH_CHUNKSZ	(256 * 1024)	/* bytes per host read */
+# define BATCH_CHUNKS	16		/* chunks in flight */
+# define BATCH_READERS	4		/* host reader threads */
+
+typedef struct {
+	int job;		/* index of the file this data belongs to */
+	int last;		/* no more chunks follow for this file */
+	int error;		/* errno if the source couldn't be read */
+	const char *errstr;
+	long size;		/* host length, in a file's first chunk only */
+	unsigned long len;
+	char *data;
+} bchunk;
+
+typedef struct {
+	char name[HFS_MAX_FLEN + 1];	/* empty if the header has none */
+	char type[5], creator[5];
+	short fdflags;
+	int finfo;			/* Finder info was present */
+	unsigned long crdate, mddate;	/* AppleSingle dates, or AS_NODATE */
+	unsigned long doff, dsize;
+	unsigned long roff, rsize;
+	int data;			/* the header describes a data fork */
+} asinfo;
+
+typedef struct {
+	cpijob *jobs;
+	int njobs;
+	volatile LONG next;	/* next job for a reader to claim */
+	queue free;		/* empty chunks */
+	queue full;		/* chunks waiting for the writer */
+} batch;
+
 /* Copy routines =========================================================== */
 
 /*
@@ -51,15 +106,15 @@ const char *cpi_error = "no error";
  * DESCRIPTION:	copy a single fork for MacBinary II
  */
 static
-int fork_macb(int ifile, hfsfile *ofile, unsigned long size)
+int fork_macb(int ifile, hfsfile *ofile, unsigned long size,
+	char *buf, unsigned long bufsz)
 {
-	char buf[HFS_BLOCKSZ * 4];
 	unsigned long chunk, bytes;
 
 	while (size)
 		{
-			chunk = (size < sizeof(buf)) ?
-	(size + (MACB_BLOCKSZ - 1)) & ~(MACB_BLOCKSZ - 1) : sizeof(buf);
+			chunk = (size < bufsz) ?
+	(size + (MACB_BLOCKSZ - 1)) & ~(MACB_BLOCKSZ - 1) : bufsz;
 
 			bytes = read(ifile, buf, chunk);
 			if (bytes == (unsigned long) -1)
@@ -94,29 +149,59 @@ int fork_macb(int ifile, hfsfile *ofile, unsigned long size)
 }
 
 /*
- * NAME:	do_macb()
- * DESCRIPTION:	perform copy using MacBinary II translation
+ * NAME:	fork->reserve()
+ * DESCRIPTION:	select a fork and allocate its full size ahead of writing
  */
 static
-int do_macb(int ifile, hfsfile *ofile,
-			unsigned long dsize, unsigned long rsize)
+int fork_reserve(hfsfile *ofile, int fork, unsigned long size)
 {
-	if (hfs_setfork(ofile, 0) == -1)
+	/*
+	 * hfs_setfork() returns the unused space of the fork left behind, so
+	 * each fork is reserved as it is selected. The allocator continues
+	 * where it last stopped, which puts the resource fork right after
+	 * the data fork, and streaming then allocates nothing further.
+	 */
+
+	if (hfs_setfork(ofile, fork) == -1 ||
+		(size > 0 && hfs_allocate(ofile, size) == -1))
 		{
 			__ERROR(errno, hfs_error);
 			return -1;
 		}
 
-	if (fork_macb(ifile, ofile, dsize) == -1)
-		return -1;
+	return 0;
+}
+
+/*
+ * NAME:	do_macb()
+ * DESCRIPTION:	perform copy using MacBinary II translation
+ */
+static
+int do_macb(hfsvol *vol, int ifile, hfsfile *ofile,
+			unsigned long dsize, unsigned long rsize)
+{
+	unsigned long bufsz;
+	char *buf;
+
+	bufsz = iobuf_size(vol, (dsize > rsize) ? dsize : rsize);
 
-	if (hfs_setfork(ofile, 1) == -1)
+	buf = iobuf_get(bufsz);
+	if (buf == 0)
 		{
-			__ERROR(errno, hfs_error);
+			__ERROR(ENOMEM, 0);
 			return -1;
 		}
 
-	if (fork_macb(ifile, ofile, rsize) == -1)
+	if (fork_reserve(ofile, 0, dsize) == -1)
+		return -1;
+
+	if (fork_macb(ifile, ofile, dsize, buf, bufsz) == -1)
+		return -1;
+
+	if (fork_reserve(ofile, 1, rsize) == -1)
+		return -1;
+
+	if (fork_macb(ifile, ofile, rsize, buf, bufsz) == -1)
 		return -1;
 
 	return 0;
@@ -127,16 +212,16 @@ int do_macb(int ifile, hfsfile *ofile,
  * DESCRIPTION:	copy a single fork for BinHex
  */
 static
-int fork_binh(hfsfile *ofile, unsigned long size)
+int fork_binh(binhex *bh, hfsfile *ofile, unsigned long size,
+	char *buf, unsigned long bufsz)
 {
-	char buf[HFS_BLOCKSZ * 4];
 	long chunk, bytes;
 
 	while (size)
 		{
-			chunk = (size > sizeof(buf)) ? sizeof(buf) : size;
+			chunk = (size > bufsz) ? bufsz : size;
 
-			bytes = bh_read(buf, chunk);
+			bytes = bh_read(bh, buf, chunk);
 			if (bytes == -1)
 	{
 		__ERROR(errno, bh_error);
@@ -163,7 +248,7 @@ int fork_binh(hfsfile *ofile, unsigned long size)
 			size -= chunk;
 		}
 
-	if (bh_readcrc() == -1)
+	if (bh_readcrc(bh) == -1)
 		{
 			__ERROR(errno, bh_error);
 			return -1;
@@ -177,24 +262,31 @@ int fork_binh(hfsfile *ofile, unsigned long size)
  * DESCRIPTION:	perform copy using BinHex translation
  */
 static
-int do_binh(hfsfile *ofile, unsigned long dsize, unsigned long rsize)
+int do_binh(hfsvol *vol, binhex *bh, hfsfile *ofile,
+	unsigned long dsize, unsigned long rsize)
 {
-	if (hfs_setfork(ofile, 0) == -1)
+	unsigned long bufsz;
+	char *buf;
+
+	bufsz = iobuf_size(vol, (dsize > rsize) ? dsize : rsize);
+
+	buf = iobuf_get(bufsz);
+	if (buf == 0)
 		{
-			__ERROR(errno, hfs_error);
+			__ERROR(ENOMEM, 0);
 			return -1;
 		}
 
-	if (fork_binh(ofile, dsize) == -1)
+	if (fork_reserve(ofile, 0, dsize) == -1)
 		return -1;
 
-	if (hfs_setfork(ofile, 1) == -1)
-		{
-			__ERROR(errno, hfs_error);
-			return -1;
-		}
+	if (fork_binh(bh, ofile, dsize, buf, bufsz) == -1)
+		return -1;
+
+	if (fork_reserve(ofile, 1, rsize) == -1)
+		return -1;
 
-	if (fork_binh(ofile, rsize) == -1)
+	if (fork_binh(bh, ofile, rsize, buf, bufsz) == -1)
 		return -1;
 
 	return 0;
@@ -205,53 +297,64 @@ int do_binh(hfsfile *ofile, unsigned long dsize, unsigned long rsize)
  * DESCRIPTION:	perform copy using text translation
  */
 static
-int do_text(int ifile, hfsfile *ofile)
+int do_text(hfsvol *vol, int ifile, hfsfile *ofile)
 {
-	char buf[HFS_BLOCKSZ * 4], *ptr;
+	ioreader reader;
+	utf8state state;
+	unsigned long bufsz;
+	char *buf, *out;
 	long chunk_size, bytes;
-	int len;
+	int len, result = 0;
+
+	/* the transcoder never makes more than one byte per byte, plus one */
+
+	bufsz = iobuf_size(vol, _filelength(ifile));
+
+	out = iobuf_startread(&reader, ifile, bufsz, bufsz + 1);
+	if (out == 0)
+	{
+		__ERROR(ENOMEM, 0);
+		return -1;
+	}
+
+	utf8StateInit(&state);
 
 	while (1)
 	{
-		chunk_size = read(ifile, buf, sizeof(buf));
+		chunk_size = iobuf_read(&reader, &buf);
 		if (chunk_size == -1)
 		{
 			__ERROR(errno, "error reading source file");
-			return -1;
-		}
-		else if (chunk_size == 0)
+			result = -1;
 			break;
-
-		// LF to CR
-		for (ptr = buf; ptr < buf + chunk_size; ++ptr)
-		{
-			if (*ptr == '\n')
-				*ptr = '\r';
 		}
 
-		// NEW: UTF-8 to MacRoman
-		ptr = utf8ToMacRomanChunk(buf, chunk_size, &len);
-		if (ptr == 0)
-		{
-			__ERROR(ENOMEM, 0);
-			return -1;
-		}
-		bytes = hfs_write(ofile, ptr, len);
-		free(ptr);
+		if (chunk_size == 0)
+			len = utf8ToMacRomanEnd(&state, out);
+		else
+			len = utf8ToMacRomanText(&state, buf, chunk_size, out);
 
+		bytes = hfs_write(ofile, out, len);
 		if (bytes == -1)
 		{
 			__ERROR(errno, hfs_error);
-			return -1;
+			result = -1;
+			break;
 		}
 		else if (bytes != len)
 		{
 			__ERROR(EIO, "wrote incomplete chunk");
-			return -1;
+			result = -1;
+			break;
 		}
+
+		if (chunk_size == 0)
+			break;
 	}
 
-	return 0;
+	iobuf_endread(&reader);
+
+	return result;
 }
 
 /*
@@ -259,19 +362,41 @@ int do_text(int ifile, hfsfile *ofile)
  * DESCRIPTION:	perform copy using no translation
  */
 static
-int do_raw(int ifile, hfsfile *ofile)
+int do_raw(hfsvol *vol, int ifile, hfsfile *ofile)
 {
-	char buf[HFS_BLOCKSZ * 4];
-	long chunk, bytes;
+	ioreader reader;
+	char *buf;
+	long size, chunk, bytes;
+	int result = 0;
+
+	/*
+	 * Reserving the whole fork first keeps it in as few extents as the
+	 * volume allows, so hfs_write() can pass each large chunk straight
+	 * to the medium. Pipes have no length and grow as they are read.
+	 */
+
+	size = _filelength(ifile);
+	if (size > 0 && hfs_allocate(ofile, size) == -1)
+	{
+		__ERROR(errno, hfs_error);
+		return -1;
+	}
+
+	if (iobuf_startread(&reader, ifile, iobuf_size(vol, size), 0) == 0)
+	{
+		__ERROR(ENOMEM, 0);
+		return -1;
+	}
 
 	while (1)
 	{
-		chunk = read(ifile, buf, sizeof(buf));
+		chunk = iobuf_read(&reader, &buf);
 
 		if (chunk == -1)
 		{
 			__ERROR(errno, "error reading source file");
-			return -1;
+			result = -1;
+			break;
 		}
 		else if (chunk == 0)
 			break;
@@ -281,18 +406,145 @@ int do_raw(int ifile, hfsfile *ofile)
 		if (bytes == -1)
 		{
 			__ERROR(errno, hfs_error);
-			return -1;
+			result = -1;
+			break;
 		}
 		else if (bytes != chunk)
+		{
+			__ERROR(EIO, "wrote incomplete chunk");
+			result = -1;
+			break;
+		}
+	}
+
+	iobuf_endread(&reader);
+
+	return result;
+}
+
+/*
+ * NAME:	fork->as()
+ * DESCRIPTION:	copy a fork through a large buffer, to EOF if size is AS_TOEOF
+ */
+static
+int fork_as(int ifile, hfsfile *ofile, unsigned long size,
+	char *buf, unsigned long bufsz)
+{
+	unsigned long chunk;
+	long bytes;
+
+	while (size)
+	{
+		chunk = (size > bufsz) ? bufsz : size;
+
+		bytes = read(ifile, buf, chunk);
+		if (bytes == -1)
+		{
+			__ERROR(errno, "error reading data");
+			return -1;
+		}
+		else if (bytes == 0 && size == AS_TOEOF)
+			break;
+		else if (bytes == 0)
+		{
+			__ERROR(EIO, "read incomplete chunk");
+			return -1;
+		}
+
+		chunk = hfs_write(ofile, buf, bytes);
+		if (chunk == (unsigned long) -1)
+		{
+			__ERROR(errno, hfs_error);
+			return -1;
+		}
+		else if (chunk != (unsigned long) bytes)
 		{
 			__ERROR(EIO, "wrote incomplete chunk");
 			return -1;
 		}
+
+		if (size != AS_TOEOF)
+			size -= bytes;
+	}
+
+	return 0;
+}
+
+/*
+ * NAME:	seekas()
+ * DESCRIPTION:	position a UNIX file at an AppleSingle entry
+ */
+static
+int seekas(int ifile, unsigned long offset)
+{
+	if (lseek(ifile, offset, SEEK_SET) == -1)
+	{
+		__ERROR(errno, "error seeking in AppleSingle file");
+		return -1;
 	}
 
 	return 0;
 }
 
+/*
+ * NAME:	do_as()
+ * DESCRIPTION:	perform copy from an AppleSingle file, or AppleDouble pair
+ */
+static
+int do_as(hfsvol *vol, int dfile, int rfile, hfsfile *ofile, const asinfo *info)
+{
+	unsigned long bufsz;
+	char *buf;
+	int result = -1;
+
+	bufsz = iobuf_size(vol, (info->dsize > info->rsize) ? info->dsize : info->rsize);
+
+	buf = iobuf_get(bufsz);
+	if (buf == 0)
+	{
+		__ERROR(ENOMEM, 0);
+		return -1;
+	}
+
+	/* an AppleDouble data file is the data fork in its entirety */
+
+	if (hfs_setfork(ofile, 0) == -1)
+	{
+		__ERROR(errno, hfs_error);
+		goto done;
+	}
+
+	if (dfile != rfile)
+	{
+		if (fork_as(dfile, ofile, AS_TOEOF, buf, bufsz) == -1)
+			goto done;
+	}
+	else if (info->data)
+	{
+		if (seekas(dfile, info->doff) == -1 ||
+				fork_as(dfile, ofile, info->dsize, buf, bufsz) == -1)
+			goto done;
+	}
+
+	if (rfile != -1 && info->rsize)
+	{
+		if (hfs_setfork(ofile, 1) == -1)
+		{
+			__ERROR(errno, hfs_error);
+			goto done;
+		}
+
+		if (seekas(rfile, info->roff) == -1 ||
+				fork_as(rfile, ofile, info->rsize, buf, bufsz) == -1)
+			goto done;
+	}
+
+	result = 0;
+
+done:
+	return result;
+}
+
 /* Utility Routines ======================================================== */
 
 /*
@@ -426,6 +678,189 @@ hfsfile *opendst(hfsvol *vol, const char *dstname, const char *hint,
 	return file;
 }
 
+/*
+ * NAME:	initas()
+ * DESCRIPTION:	describe a file with a data fork and no metadata
+ */
+static
+void initas(asinfo *info)
+{
+	memset(info, 0, sizeof(*info));
+
+	strcpy(info->type,    RAW_TYPE);
+	strcpy(info->creator, RAW_CREA);
+
+	info->crdate = info->mddate = AS_NODATE;
+}
+
+/*
+ * NAME:	readas()
+ * DESCRIPTION:	read an AppleSingle or AppleDouble header
+ */
+static
+int readas(int ifile, unsigned long magic, asinfo *info)
+{
+	unsigned char head[AS_HEADERSZ], *desc = 0, *ptr, buf[32];
+	unsigned long id, offset, length;
+	int count, i;
+
+	initas(info);
+
+	if (read(ifile, head, AS_HEADERSZ) < AS_HEADERSZ)
+	{
+		__ERROR(errno, "error reading AppleSingle file header");
+		return -1;
+	}
+
+	if (d_getul(&head[0]) != magic ||
+			(d_getul(&head[4]) != AS_VERSION && d_getul(&head[4]) != AS_VERSION1))
+	{
+		__ERROR(EINVAL, "unknown, unsupported, or corrupt AppleSingle file");
+		return -1;
+	}
+
+	count = d_getuw(&head[24]);
+	if (count > AS_MAXENTRIES)
+	{
+		__ERROR(EINVAL, "invalid AppleSingle file header (too many entries)");
+		return -1;
+	}
+
+	desc = malloc(count * 12 + 1);
+	if (desc == 0)
+	{
+		__ERROR(ENOMEM, 0);
+		return -1;
+	}
+
+	if (read(ifile, desc, count * 12) < count * 12)
+	{
+		__ERROR(errno, "error reading AppleSingle file header");
+		goto fail;
+	}
+
+	for (i = 0, ptr = desc; i < count; ++i, ptr += 12)
+	{
+		id     = d_getul(&ptr[0]);
+		offset = d_getul(&ptr[4]);
+		length = d_getul(&ptr[8]);
+
+		switch (id)
+		{
+			case AS_DATA:
+				info->data  = 1;
+				info->doff  = offset;
+				info->dsize = length;
+				break;
+
+			case AS_RSRC:
+				info->roff  = offset;
+				info->rsize = length;
+				break;
+
+			case AS_NAME:
+				if (length < 1 || length > HFS_MAX_FLEN)
+					break;
+
+				if (seekas(ifile, offset) == -1)
+					goto fail;
+
+				if (read(ifile, info->name, length) < (long) length)
+				{
+					__ERROR(errno, "error reading AppleSingle file name");
+					goto fail;
+				}
+
+				info->name[length] = 0;
+				break;
+
+			case AS_DATES:
+				if (length < 8)
+					break;
+
+				if (seekas(ifile, offset) == -1)
+					goto fail;
+
+				if (read(ifile, buf, 8) < 8)
+				{
+					__ERROR(errno, "error reading AppleSingle file dates");
+					goto fail;
+				}
+
+				info->crdate = d_getul(&buf[0]);
+				info->mddate = d_getul(&buf[4]);
+				break;
+
+			case AS_FINFO:
+				if (length < 10)
+					break;
+
+				if (seekas(ifile, offset) == -1)
+					goto fail;
+
+				if (read(ifile, buf, 10) < 10)
+				{
+					__ERROR(errno, "error reading AppleSingle Finder info");
+					goto fail;
+				}
+
+				memcpy(info->type,    &buf[0], 4);
+				memcpy(info->creator, &buf[4], 4);
+				info->fdflags = d_getsw(&buf[8]);
+				info->finfo   = 1;
+				break;
+		}
+	}
+
+	if (info->dsize > 0x7fffffff || info->rsize > 0x7fffffff)
+	{
+		__ERROR(EINVAL, "invalid AppleSingle file header (bad file length)");
+		goto fail;
+	}
+
+	free(desc);
+
+	return 0;
+
+fail:
+	free(desc);
+
+	return -1;
+}
+
+/*
+ * NAME:	setas()
+ * DESCRIPTION:	apply AppleSingle Finder info and dates to a new HFS file
+ */
+static
+int setas(hfsfile *ofile, const asinfo *info)
+{
+	hfsdirent ent;
+
+	if (hfs_fstat(ofile, &ent) == -1)
+	{
+		__ERROR(errno, hfs_error);
+		return -1;
+	}
+
+	if (info->finfo)
+		ent.fdflags = info->fdflags &
+			~(HFS_FNDR_ISONDESK | HFS_FNDR_HASBEENINITED | HFS_FNDR_RESERVED);
+
+	if (info->crdate != AS_NODATE)
+		ent.crdate = (long) info->crdate + AS_EPOCH;
+	if (info->mddate != AS_NODATE)
+		ent.mddate = (long) info->mddate + AS_EPOCH;
+
+	if (hfs_fsetattr(ofile, &ent) == -1)
+	{
+		__ERROR(errno, hfs_error);
+		return -1;
+	}
+
+	return 0;
+}
+
 /*
  * NAME:	closefiles()
  * DESCRIPTION:	close source and destination files
@@ -537,7 +972,7 @@ int cpi_macb(const wchar_t *srcname, hfsvol *vol, const char *dstname)
 		return -1;
 	}
 
-	result = do_macb(ifile, ofile, dsize, rsize);
+	result = do_macb(vol, ifile, ofile, dsize, rsize);
 
 	if (result == 0 && hfs_fstat(ofile, &ent) == -1)
 	{
@@ -567,13 +1002,13 @@ int cpi_macb(const wchar_t *srcname, hfsvol *vol, const char *dstname)
  * DESCRIPTION:	auxiliary BinHex routine
  */
 static
-int binhx(char *fname, char *type, char *creator, short *fdflags,
+int binhx(binhex *bh, char *fname, char *type, char *creator, short *fdflags,
 		unsigned long *dsize, unsigned long *rsize)
 {
 	int len;
 	unsigned char byte, word[2], lword[4];
 
-	if (bh_read(&byte, 1) < 1)
+	if (bh_read(bh, &byte, 1) < 1)
 	{
 		__ERROR(errno, bh_error);
 		return -1;
@@ -587,7 +1022,7 @@ int binhx(char *fname, char *type, char *creator, short *fdflags,
 		return -1;
 	}
 
-	if (bh_read(fname, len + 1) < len + 1)
+	if (bh_read(bh, fname, len + 1) < len + 1)
 	{
 		__ERROR(errno, bh_error);
 		return -1;
@@ -599,23 +1034,23 @@ int binhx(char *fname, char *type, char *creator, short *fdflags,
 		return -1;
 	}
 
-	if (bh_read(type, 4) < 4 ||
-			bh_read(creator, 4) < 4 ||
-			bh_read(word, 2) < 2)
+	if (bh_read(bh, type, 4) < 4 ||
+			bh_read(bh, creator, 4) < 4 ||
+			bh_read(bh, word, 2) < 2)
 	{
 		__ERROR(errno, bh_error);
 		return -1;
 	}
 	*fdflags = d_getsw(word);
 
-	if (bh_read(lword, 4) < 4)
+	if (bh_read(bh, lword, 4) < 4)
 	{
 		__ERROR(errno, bh_error);
 		return -1;
 	}
 	*dsize = d_getul(lword);
 
-	if (bh_read(lword, 4) < 4)
+	if (bh_read(bh, lword, 4) < 4)
 	{
 		__ERROR(errno, bh_error);
 		return -1;
@@ -628,7 +1063,7 @@ int binhx(char *fname, char *type, char *creator, short *fdflags,
 		return -1;
 	}
 
-	if (bh_readcrc() == -1)
+	if (bh_readcrc(bh) == -1)
 	{
 		__ERROR(errno, bh_error);
 		return -1;
@@ -644,6 +1079,7 @@ int binhx(char *fname, char *type, char *creator, short *fdflags,
 int cpi_binh(const wchar_t *srcname, hfsvol *vol, const char *dstname)
 {
 	int ifile, result;
+	binhex *bh;
 	hfsfile *ofile;
 	hfsdirent ent;
 	const wchar_t *dsthint;
@@ -655,7 +1091,8 @@ int cpi_binh(const wchar_t *srcname, hfsvol *vol, const char *dstname)
 	if (ifile == -1)
 		return -1;
 
-	if (bh_open(ifile) == -1)
+	bh = bh_open(ifile);
+	if (bh == 0)
 	{
 		__ERROR(errno, bh_error);
 
@@ -663,9 +1100,9 @@ int cpi_binh(const wchar_t *srcname, hfsvol *vol, const char *dstname)
 		return -1;
 	}
 
-	if (binhx(fname, type, creator, &fdflags, &dsize, &rsize) == -1)
+	if (binhx(bh, fname, type, creator, &fdflags, &dsize, &rsize) == -1)
 	{
-		bh_close();
+		bh_close(bh);
 		close(ifile);
 		return -1;
 	}
@@ -673,14 +1110,14 @@ int cpi_binh(const wchar_t *srcname, hfsvol *vol, const char *dstname)
 	ofile = opendst(vol, dstname, fname, type, creator);
 	if (ofile == 0)
 	{
-		bh_close();
+		bh_close(bh);
 		close(ifile);
 		return -1;
 	}
 
-	result = do_binh(ofile, dsize, rsize);
+	result = do_binh(vol, bh, ofile, dsize, rsize);
 
-	if (bh_close() == -1 && result == 0)
+	if (bh_close(bh) == -1 && result == 0)
 	{
 		__ERROR(errno, bh_error);
 		result = -1;
@@ -732,7 +1169,7 @@ int cpi_text(const wchar_t *srcname, hfsvol *vol, const char *dstname)
 		return -1;
 	}
 
-	result = do_text(ifile, ofile);
+	result = do_text(vol, ifile, ofile);
 
 	closefiles(ifile, ofile, &result);
 
@@ -766,9 +1203,421 @@ int cpi_raw(const wchar_t *srcname, hfsvol *vol, const char *dstname)
 		return -1;
 	}
 
-	result = do_raw(ifile, ofile);
+	result = do_raw(vol, ifile, ofile);
+
+	closefiles(ifile, ofile, &result);
+
+	return result;
+}
+
+/*
+ * NAME:	cpi->asgl()
+ * DESCRIPTION:	copy an AppleSingle file to an HFS file
+ */
+int cpi_asgl(const wchar_t *srcname, hfsvol *vol, const char *dstname)
+{
+	int ifile, result = 0;
+	hfsfile *ofile;
+	asinfo info;
+	const wchar_t *dsthint;
+	char *dsthint_macroman;
+
+	ifile = opensrc(srcname, &dsthint, ".as", 1);
+	if (ifile == -1)
+		return -1;
+
+	dsthint_macroman = utf16ToMacRoman(dsthint);
+	free((wchar_t *) dsthint);
+
+	if (dsthint_macroman == 0)
+	{
+		__ERROR(ENOMEM, 0);
+
+		close(ifile);
+		return -1;
+	}
+
+	if (readas(ifile, AS_MAGIC, &info) == -1)
+	{
+		free(dsthint_macroman);
+
+		close(ifile);
+		return -1;
+	}
+
+	/* the original Macintosh name is preferred to the UNIX one */
+
+	ofile = opendst(vol, dstname, info.name[0] ? info.name : dsthint_macroman,
+		info.type, info.creator);
+	free(dsthint_macroman);
+	if (ofile == 0)
+	{
+		close(ifile);
+		return -1;
+	}
+
+	result = do_as(vol, ifile, ifile, ofile, &info);
+
+	if (result == 0)
+		result = setas(ofile, &info);
+
+	closefiles(ifile, ofile, &result);
+
+	return result;
+}
+
+/*
+ * NAME:	cpi->adbl()
+ * DESCRIPTION:	copy a UNIX file and its AppleDouble header file to an HFS file
+ */
+int cpi_adbl(const wchar_t *srcname, hfsvol *vol, const char *dstname)
+{
+	int ifile, sfile = -1, result = 0;
+	hfsfile *ofile;
+	asinfo info;
+	const wchar_t *dsthint;
+	wchar_t *side;
+	char *dsthint_macroman;
+
+	ifile = opensrc(srcname, &dsthint, 0, 1);
+	if (ifile == -1)
+		return -1;
+
+	dsthint_macroman = utf16ToMacRoman(dsthint);
+	free((wchar_t *) dsthint);
+
+	side = cpi_sidecar(srcname);
+
+	if (dsthint_macroman == 0 || side == 0)
+	{
+		if (dsthint_macroman == 0)
+			__ERROR(ENOMEM, 0);
+
+		free(dsthint_macroman);
+		free(side);
+
+		close(ifile);
+		return -1;
+	}
+
+	/* without a header file there is only a data fork */
+
+	sfile = _wopen(side, O_RDONLY | O_BINARY);
+	free(side);
+
+	if (sfile == -1 && errno != ENOENT)
+	{
+		__ERROR(errno, "error opening AppleDouble header file");
+		goto fail;
+	}
+
+	if (sfile == -1)
+		initas(&info);
+	else if (readas(sfile, AD_MAGIC, &info) == -1)
+		goto fail;
+
+	ofile = opendst(vol, dstname, info.name[0] ? info.name : dsthint_macroman,
+		info.type, info.creator);
+	if (ofile == 0)
+		goto fail;
+
+	free(dsthint_macroman);
+
+	result = do_as(vol, ifile, sfile, ofile, &info);
+
+	if (result == 0)
+		result = setas(ofile, &info);
+
+	if (sfile != -1 && close(sfile) == -1 && result == 0)
+	{
+		__ERROR(errno, "error closing AppleDouble header file");
+		result = -1;
+	}
 
 	closefiles(ifile, ofile, &result);
 
 	return result;
+
+fail:
+	free(dsthint_macroman);
+
+	if (sfile != -1)
+		close(sfile);
+
+	close(ifile);
+
+	return -1;
+}
+
+/*
+ * NAME:	cpi->sidecar()
+ * DESCRIPTION:	return the path of the AppleDouble header file for a UNIX file
+ */
+wchar_t *cpi_sidecar(const wchar_t *path)
+{
+	const wchar_t *name, *ptr;
+	wchar_t *side;
+
+	name = path;
+	for (ptr = path; *ptr; ++ptr)
+	{
+		if (*ptr == L'\\' || *ptr == L'/' || *ptr == L':')
+			name = ptr + 1;
+	}
+
+	side = malloc((wcslen(path) + 3) * sizeof(wchar_t));
+	if (side == 0)
+	{
+		__ERROR(ENOMEM, 0);
+		return 0;
+	}
+
+	wcsncpy(side, path, name - path);
+	wcscpy(side + (name - path), L"._");
+	wcscat(side, name);
+
+	return side;
+}
+
+/*
+ * NAME:	reader()
+ * DESCRIPTION:	read whole source files into chunks for the HFS writer
+ */
+static
+unsigned __stdcall reader(void *arg)
+{
+	batch *b = arg;
+	bchunk *c;
+	int i, ifile, err = 0, last;
+	long size, bytes;
+
+	while ((i = InterlockedIncrement(&b->next) - 1) < b->njobs)
+	{
+		ifile = -1;
+		size  = -1;
+
+		/* translated copies are made by the writer itself */
+
+		if (b->jobs[i].copyfile == 0)
+		{
+			ifile = _wopen(b->jobs[i].src, O_RDONLY | O_BINARY);
+			err   = errno;
+
+			if (ifile != -1)
+				size = _filelength(ifile);
+		}
+
+		do
+		{
+			c = q_get(&b->free);
+
+			c->job    = i;
+			c->size   = size;
+			c->len    = 0;
+			c->error  = 0;
+			c->errstr = 0;
+
+			size = -1;
+
+			if (b->jobs[i].copyfile)
+				last = 1;
+			else if (ifile == -1)
+			{
+				c->error  = err;
+				c->errstr = "error opening source file";
+				last = 1;
+			}
+			else
+			{
+				bytes = read(ifile, c->data, BATCH_CHUNKSZ);
+				if (bytes == -1)
+				{
+					c->error  = errno;
+					c->errstr = "error reading source file";
+					last = 1;
+				}
+				else
+				{
+					/* a regular file reads short only at its end */
+
+					c->len = bytes;
+					last = (bytes < BATCH_CHUNKSZ);
+				}
+			}
+
+			c->last = last;
+			q_put(&b->full, c);
+		}
+		while (! last);
+
+		if (ifile != -1)
+			close(ifile);
+	}
+
+	return 0;
+}
+
+/*
+ * NAME:	failjob()
+ * DESCRIPTION:	record the first error for a batch job
+ */
+static
+void failjob(cpijob *job, int code, const char *str)
+{
+	if (job->error == 0)
+	{
+		job->error  = code ? code : EIO;
+		job->errstr = str;
+	}
+}
+
+/*
+ * NAME:	cpi->batch()
+ * DESCRIPTION:	copy many UNIX files, reading ahead on worker threads
+ */
+int cpi_batch(hfsvol *vol, cpijob *jobs, int njobs)
+{
+	batch b;
+	bchunk *chunks = 0, *c;
+	hfsfile **files = 0;
+	HANDLE threads[BATCH_READERS];
+	cpijob *job;
+	unsigned long bytes;
+	int nthreads = 0, done = 0, i, result = 0;
+
+	if (njobs == 0)
+		return 0;
+
+	b.jobs  = jobs;
+	b.njobs = njobs;
+	b.next  = 0;
+
+	if (q_init(&b.free, BATCH_CHUNKS) == -1)
+		goto nomem0;
+
+	if (q_init(&b.full, BATCH_CHUNKS) == -1)
+		goto nomem1;
+
+	chunks = calloc(BATCH_CHUNKS, sizeof(bchunk));
+	files  = calloc(njobs, sizeof(hfsfile *));
+	if (chunks == 0 || files == 0)
+		goto nomem2;
+
+	for (i = 0; i < BATCH_CHUNKS; ++i)
+	{
+		chunks[i].data = malloc(BATCH_CHUNKSZ);
+		if (chunks[i].data == 0)
+			goto nomem2;
+
+		q_put(&b.free, &chunks[i]);
+	}
+
+	for (i = 0; i < BATCH_READERS && i < njobs; ++i)
+	{
+		threads[nthreads] = (HANDLE) _beginthreadex(0, 0, reader, &b, 0, 0);
+		if (threads[nthreads] != 0)
+			++nthreads;
+	}
+
+	if (nthreads == 0)
+	{
+		for (i = 0; i < njobs; ++i)
+			failjob(&jobs[i], errno, "can't start reader thread");
+
+		result = -1;
+		goto done;
+	}
+
+	/* this thread alone uses the volume */
+
+	while (done < njobs)
+	{
+		c   = q_get(&b.full);
+		job = &jobs[c->job];
+
+		if (job->copyfile)
+		{
+			if (job->copyfile(job->src, vol, job->dst) == -1)
+				failjob(job, errno, cpi_error);
+		}
+		else
+		{
+			if (c->error)
+				failjob(job, c->error, c->errstr);
+			else if (job->error == 0)
+			{
+				if (files[c->job] == 0)
+				{
+					hfs_delete(vol, job->dst);
+
+					files[c->job] = hfs_create(vol, job->dst, RAW_TYPE, RAW_CREA);
+					if (files[c->job] == 0)
+						failjob(job, errno, hfs_error);
+
+					/* reserve the whole fork up front, as do_raw() does */
+
+					else if (c->size > 0 &&
+						hfs_allocate(files[c->job], c->size) == -1)
+						failjob(job, errno, hfs_error);
+				}
+
+				if (files[c->job] && c->len)
+				{
+					bytes = hfs_write(files[c->job], c->data, c->len);
+					if (bytes == (unsigned long) -1)
+						failjob(job, errno, hfs_error);
+					else if (bytes != c->len)
+						failjob(job, EIO, "wrote incomplete chunk");
+				}
+			}
+
+			if (c->last && files[c->job])
+			{
+				if (hfs_close(files[c->job]) == -1)
+					failjob(job, errno, hfs_error);
+
+				files[c->job] = 0;
+			}
+		}
+
+		if (job->error)
+			result = -1;
+
+		if (c->last)
+			++done;
+
+		q_put(&b.free, c);
+	}
+
+	WaitForMultipleObjects(nthreads, threads, TRUE, INFINITE);
+
+done:
+	for (i = 0; i < nthreads; ++i)
+		CloseHandle(threads[i]);
+
+	for (i = 0; i < BATCH_CHUNKS; ++i)
+		free(chunks[i].data);
+
+	free(chunks);
+	free(files);
+	q_free(&b.full);
+	q_free(&b.free);
+
+	return result;
+
+nomem2:
+	if (chunks)
+	{
+		for (i = 0; i < BATCH_CHUNKS; ++i)
+			free(chunks[i].data);
+	}
+
+	free(chunks);
+	free(files);
+	q_free(&b.full);
+nomem1:
+	q_free(&b.free);
+nomem0:
+	__ERROR(ENOMEM, 0);
+	return -1;
 }
@@ -25,3 +25,17 @@ int cpi_macb(const wchar_t *, hfsvol *, const char *);
 int cpi_binh(const wchar_t *, hfsvol *, const char *);
 int cpi_text(const wchar_t *, hfsvol *, const char *);
 int cpi_raw(const wchar_t *, hfsvol *, const char *);
+int cpi_adbl(const wchar_t *, hfsvol *, const char *);
+int cpi_asgl(const wchar_t *, hfsvol *, const char *);
+
+wchar_t *cpi_sidecar(const wchar_t *);
+
+typedef struct {
+	wchar_t *src;		/* UNIX path */
+	char *dst;		/* HFS path of the file to create */
+	cpifunc copyfile;	/* translation, or 0 for a raw data fork copy */
+	int error;		/* errno if the copy failed, else 0 */
+	const char *errstr;	/* explanation of the failure, or 0 */
+} cpijob;
+
+int cpi_batch(hfsvol *, cpijob *, int);
@@ -23,13 +23,17 @@
 # include <string.h>
 # include <errno.h>
 # include <sys/stat.h>
+# include <windows.h>
+# include <process.h>
 
 # include "hfs.h"
 # include "data.h"
+# include "queue.h"
 # include "copyout.h"
 # include "charset.h"
 # include "binhex.h"
 # include "crc.h"
+# include "iobuf.h"
 
 const char *cpo_error = "no error";
 
@@ -39,6 +43,43 @@ const char *cpo_error = "no error";
 
 # define MACB_BLOCKSZ	128
 
+# define AS_MAGIC	0x00051600	/* AppleSingle */
+# define AD_MAGIC	0x00051607	/* AppleDouble */
+# define AS_VERSION	0x00020000
+
+# define AS_DATA	1		/* entry IDs */
+# define AS_RSRC	2
+# define AS_NAME	3
+# define AS_DATES	8
+# define AS_FINFO	9
+
+# define AS_HEADERSZ	26
+# define AS_EPOCH	946684800L	/* 2000-01-01 00:00 GMT */
+# define AS_NODATE	0x80000000UL
+
+# define RAW_RANGES	16		/* ranges looked up at once */
+
+# define BATCH_CHUNKSZ	(256 * 1024)	/* bytes per HFS read */
+# define BATCH_CHUNKS	16		/* chunks in flight */
+# define BATCH_WRITERS	4		/* host writer threads */
+
+typedef struct {
+	int job;		/* index of the file this data belongs to */
+	int last;		/* no more chunks follow for this file */
+	int crc;		/* BinHex: a CRC follows this chunk's data */
+	int error;		/* errno if the source couldn't be read */
+	const char *errstr;
+	unsigned long len;
+	char *data;		/* room for BATCH_CHUNKSZ + MACB_BLOCKSZ bytes */
+} bchunk;
+
+typedef struct {
+	cpojob *jobs;
+	queue *free;		/* empty chunks */
+	queue *idle;		/* writers waiting for another file */
+	queue work;		/* chunks for this writer; 0 to stop */
+} bwriter;
+
 /* Copy Routines =========================================================== */
 
 /*
@@ -46,15 +87,15 @@ const char *cpo_error = "no error";
  * DESCRIPTION:	copy a single fork for MacBinary II
  */
 static
-int fork_macb(hfsfile *ifile, int ofile, unsigned long size)
+int fork_macb(hfsfile *ifile, int ofile, unsigned long size,
+	char *buf, unsigned long bufsz)
 {
-	char buf[HFS_BLOCKSZ * 4];
 	long chunk, bytes;
 	unsigned long total = 0;
 
 	while (1)
 	{
-		chunk = hfs_read(ifile, buf, sizeof(buf));
+		chunk = hfs_read(ifile, buf, bufsz);
 		if (chunk == -1)
 		{
 			__ERROR(errno, hfs_error);
@@ -104,15 +145,46 @@ int fork_macb(hfsfile *ifile, int ofile, unsigned long size)
 	return 0;
 }
 
+/*
+ * NAME:	macbheader()
+ * DESCRIPTION:	fill in a MacBinary II header for a file
+ */
+static
+void macbheader(unsigned char *buf, const hfsdirent *ent)
+{
+	memset(buf, 0, MACB_BLOCKSZ);
+
+	buf[1] = strlen(ent->name);
+	strcpy((char *) &buf[2], ent->name);
+
+	memcpy(&buf[65], ent->u.file.type,		4);
+	memcpy(&buf[69], ent->u.file.creator, 4);
+
+	buf[73] = ent->fdflags >> 8;
+
+	d_putul(&buf[83], ent->u.file.dsize);
+	d_putul(&buf[87], ent->u.file.rsize);
+
+	d_putul(&buf[91], d_mtime(ent->crdate));
+	d_putul(&buf[95], d_mtime(ent->mddate));
+
+	buf[101] = ent->fdflags & 0xff;
+	buf[122] = buf[123] = 129;
+
+	d_putuw(&buf[124], crc_macb(buf, 124, 0x0000));
+}
+
 /*
  * NAME:	do_macb()
  * DESCRIPTION:	perform copy using MacBinary II translation
  */
 static
-int do_macb(hfsfile *ifile, int ofile)
+int do_macb(hfsvol *vol, hfsfile *ifile, int ofile)
 {
 	hfsdirent ent;
 	unsigned char buf[MACB_BLOCKSZ];
+	unsigned long bufsz;
+	char *data;
 	long bytes;
 
 	if (hfs_fstat(ifile, &ent) == -1)
@@ -121,26 +193,17 @@ int do_macb(hfsfile *ifile, int ofile)
 		return -1;
 	}
 
-	memset(buf, 0, MACB_BLOCKSZ);
-
-	buf[1] = strlen(ent.name);
-	strcpy((char *) &buf[2], ent.name);
-
-	memcpy(&buf[65], ent.u.file.type,		4);
-	memcpy(&buf[69], ent.u.file.creator, 4);
+	bufsz = iobuf_size(vol, (ent.u.file.dsize > ent.u.file.rsize) ?
+		ent.u.file.dsize : ent.u.file.rsize);
 
-	buf[73] = ent.fdflags >> 8;
-
-	d_putul(&buf[83], ent.u.file.dsize);
-	d_putul(&buf[87], ent.u.file.rsize);
-
-	d_putul(&buf[91], d_mtime(ent.crdate));
-	d_putul(&buf[95], d_mtime(ent.mddate));
-
-	buf[101] = ent.fdflags & 0xff;
-	buf[122] = buf[123] = 129;
+	data = iobuf_get(bufsz);
+	if (data == 0)
+	{
+		__ERROR(ENOMEM, 0);
+		return -1;
+	}
 
-	d_putuw(&buf[124], crc_macb(buf, 124, 0x0000));
+	macbheader(buf, &ent);
 
 	bytes = write(ofile, buf, MACB_BLOCKSZ);
 	if (bytes == -1)
@@ -160,7 +223,7 @@ int do_macb(hfsfile *ifile, int ofile)
 		return -1;
 	}
 
-	if (fork_macb(ifile, ofile, ent.u.file.dsize) == -1)
+	if (fork_macb(ifile, ofile, ent.u.file.dsize, data, bufsz) == -1)
 		return -1;
 
 	if (hfs_setfork(ifile, 1) == -1)
@@ -169,7 +232,7 @@ int do_macb(hfsfile *ifile, int ofile)
 		return -1;
 	}
 
-	if (fork_macb(ifile, ofile, ent.u.file.rsize) == -1)
+	if (fork_macb(ifile, ofile, ent.u.file.rsize, data, bufsz) == -1)
 		return -1;
 
 	return 0;
@@ -180,15 +243,15 @@ int do_macb(hfsfile *ifile, int ofile)
  * DESCRIPTION:	copy a single fork for BinHex
  */
 static
-int fork_binh(hfsfile *ifile, unsigned long size)
+int fork_binh(binhex *bh, hfsfile *ifile, unsigned long size,
+	char *buf, unsigned long bufsz)
 {
-	char buf[HFS_BLOCKSZ * 4];
 	long bytes;
 	unsigned long total = 0;
 
 	while (1)
 	{
-		bytes = hfs_read(ifile, buf, sizeof(buf));
+		bytes = hfs_read(ifile, buf, bufsz);
 		if (bytes == -1)
 		{
 			__ERROR(errno, hfs_error);
@@ -197,7 +260,7 @@ int fork_binh(hfsfile *ifile, unsigned long size)
 		else if (bytes == 0)
 			break;
 
-		if (bh_insert(buf, bytes) == -1)
+		if (bh_insert(bh, buf, bytes) == -1)
 		{
 			__ERROR(errno, bh_error);
 			return -1;
@@ -212,7 +275,7 @@ int fork_binh(hfsfile *ifile, unsigned long size)
 		return -1;
 	}
 
-	if (bh_insertcrc() == -1)
+	if (bh_insertcrc(bh) == -1)
 	{
 		__ERROR(errno, bh_error);
 		return -1;
@@ -221,15 +284,40 @@ int fork_binh(hfsfile *ifile, unsigned long size)
 	return 0;
 }
 
+/*
+ * NAME:	binhheader()
+ * DESCRIPTION:	fill a BinHex header for a file; return its length
+ */
+static
+int binhheader(unsigned char *buf, const hfsdirent *ent)
+{
+	int len;
+
+	len = strlen(ent->name);
+
+	buf[0] = len;
+	memcpy(buf + 1, ent->name, len + 1);
+	memcpy(buf + 2 + len, ent->u.file.type, 4);
+	memcpy(buf + 6 + len, ent->u.file.creator, 4);
+
+	d_putsw(buf + 10 + len, ent->fdflags);
+	d_putul(buf + 12 + len, ent->u.file.dsize);
+	d_putul(buf + 16 + len, ent->u.file.rsize);
+
+	return 20 + len;
+}
+
 /*
  * NAME:	binhx()
  * DESCRIPTION:	auxiliary BinHex routine
  */
 static
-int binhx(hfsfile *ifile)
+int binhx(hfsvol *vol, binhex *bh, hfsfile *ifile)
 {
 	hfsdirent ent;
-	unsigned char byte, word[2], lword[4];
+	unsigned char buf[HFS_MAX_FLEN + 20];
+	unsigned long bufsz;
+	char *data;
 
 	if (hfs_fstat(ifile, &ent) == -1)
 	{
@@ -237,32 +325,18 @@ int binhx(hfsfile *ifile)
 		return -1;
 	}
 
-	byte = strlen(ent.name);
-	if (bh_insert(&byte, 1) == -1 ||
-			bh_insert(ent.name, byte + 1) == -1 ||
-			bh_insert(ent.u.file.type, 4) == -1 ||
-			bh_insert(ent.u.file.creator, 4) == -1)
-	{
-		__ERROR(errno, bh_error);
-		return -1;
-	}
+	bufsz = iobuf_size(vol, (ent.u.file.dsize > ent.u.file.rsize) ?
+		ent.u.file.dsize : ent.u.file.rsize);
 
-	d_putsw(word, ent.fdflags);
-	if (bh_insert(word, 2) == -1)
+	data = iobuf_get(bufsz);
+	if (data == 0)
 	{
-		__ERROR(errno, bh_error);
+		__ERROR(ENOMEM, 0);
 		return -1;
 	}
 
-	d_putul(lword, ent.u.file.dsize);
-	if (bh_insert(lword, 4) == -1)
-	{
-		__ERROR(errno, bh_error);
-		return -1;
-	}
-
-	d_putul(lword, ent.u.file.rsize);
-	if (bh_insert(lword, 4) == -1 || bh_insertcrc() == -1)
+	if (bh_insert(bh, buf, binhheader(buf, &ent)) == -1 ||
+			bh_insertcrc(bh) == -1)
 	{
 		__ERROR(errno, bh_error);
 		return -1;
@@ -274,7 +348,7 @@ int binhx(hfsfile *ifile)
 		return -1;
 	}
 
-	if (fork_binh(ifile, ent.u.file.dsize) == -1)
+	if (fork_binh(bh, ifile, ent.u.file.dsize, data, bufsz) == -1)
 		return -1;
 
 	if (hfs_setfork(ifile, 1) == -1)
@@ -283,7 +357,7 @@ int binhx(hfsfile *ifile)
 		return -1;
 	}
 
-	if (fork_binh(ifile, ent.u.file.rsize) == -1)
+	if (fork_binh(bh, ifile, ent.u.file.rsize, data, bufsz) == -1)
 		return -1;
 
 	return 0;
@@ -294,19 +368,21 @@ int binhx(hfsfile *ifile)
  * DESCRIPTION:	perform copy using BinHex translation
  */
 static
-int do_binh(hfsfile *ifile, int ofile)
+int do_binh(hfsvol *vol, hfsfile *ifile, int ofile)
 {
+	binhex *bh;
 	int result;
 
-	if (bh_start(ofile) == -1)
+	bh = bh_start(ofile);
+	if (bh == 0)
 	{
 		__ERROR(errno, bh_error);
 		return -1;
 	}
 
-	result = binhx(ifile);
+	result = binhx(vol, bh, ifile);
 
-	if (bh_end() == -1 && result == 0)
+	if (bh_end(bh) == -1 && result == 0)
 	{
 		__ERROR(errno, bh_error);
 		result = -1;
@@ -320,15 +396,36 @@ int do_binh(hfsfile *ifile, int ofile)
  * DESCRIPTION:	perform copy using text translation
  */
 static
-int do_text(hfsfile *ifile, int ofile)
+int do_text(hfsvol *vol, hfsfile *ifile, int ofile)
 {
-	char buf[HFS_BLOCKSZ * 4], *ptr;
+	hfsdirent ent;
+	unsigned long bufsz;
+	char *buf, *out;
 	long chunk_size, bytes;
 	int len;
 
+	if (hfs_fstat(ifile, &ent) == -1)
+	{
+		__ERROR(errno, hfs_error);
+		return -1;
+	}
+
+	/* UTF-8 takes up to three bytes for each MacRoman byte */
+
+	bufsz = iobuf_size(vol, ent.u.file.dsize);
+
+	buf = iobuf_get(bufsz * 4);
+	if (buf == 0)
+	{
+		__ERROR(ENOMEM, 0);
+		return -1;
+	}
+
+	out = buf + bufsz;
+
 	while (1)
 	{
-		chunk_size = hfs_read(ifile, buf, sizeof(buf));
+		chunk_size = hfs_read(ifile, buf, bufsz);
 		if (chunk_size == -1)
 		{
 			__ERROR(errno, hfs_error);
@@ -337,23 +434,9 @@ int do_text(hfsfile *ifile, int ofile)
 		else if (chunk_size == 0)
 			break;
 
-		// CR to LF
-		for (ptr = buf; ptr < buf + chunk_size; ++ptr)
-		{
-			if (*ptr == '\r')
-				*ptr = '\n';
-		}
-
-		// NEW: MacRoman to UTF-8
-		ptr = macRomanToUtf8Chunk(buf, chunk_size, &len);
-		if (ptr == 0)
-		{
-			__ERROR(ENOMEM, 0);
-			return -1;
-		}
-		bytes = write(ofile, ptr, len);
-		free(ptr);
+		len = macRomanToUtf8Text(buf, chunk_size, out);
 
+		bytes = write(ofile, out, len);
 		if (bytes == -1)
 		{
 			__ERROR(errno, "error writing data");
@@ -369,42 +452,234 @@ int do_text(hfsfile *ifile, int ofile)
 	return 0;
 }
 
+/*
+ * NAME:	asdate()
+ * DESCRIPTION:	convert a UNIX time to an AppleSingle date
+ */
+static
+unsigned long asdate(time_t date)
+{
+	/* a never-set HFS date lies well before the AppleSingle range */
+
+	if (date - AS_EPOCH < -0x7fffffffL || date - AS_EPOCH > 0x7fffffffL)
+		return AS_NODATE;
+
+	return (unsigned long) (date - AS_EPOCH) & 0xffffffffUL;
+}
+
+/*
+ * NAME:	putbytes()
+ * DESCRIPTION:	write a block of data to a UNIX file
+ */
+static
+int putbytes(int ofile, const void *buf, long len)
+{
+	long bytes;
+
+	bytes = write(ofile, buf, len);
+	if (bytes == -1)
+	{
+		__ERROR(errno, "error writing data");
+		return -1;
+	}
+	else if (bytes != len)
+	{
+		__ERROR(EIO, "wrote incomplete chunk");
+		return -1;
+	}
+
+	return 0;
+}
+
 /*
  * NAME:	do_raw()
  * DESCRIPTION:	perform copy using no translation
  */
 static
-int do_raw(hfsfile *ifile, int ofile)
+int do_raw(hfsvol *vol, hfsfile *ifile, int ofile)
 {
-	char buf[HFS_BLOCKSZ * 4];
-	long chunk_size, bytes;
+	hfsdirent ent;
+	hfsrange ranges[RAW_RANGES], *list = ranges;
+	unsigned long start, left, bytes, nblocks, bufsz;
+	char *buf;
+	int count, i, result = 0;
+
+	/*
+	 * The fork is read straight from where its extents lie on the
+	 * medium, in large runs, rather than a block at a time through
+	 * the volume's cache.
+	 */
+
+	count = hfs_ranges(ifile, list, RAW_RANGES);
+	if (count == -1)
+	{
+		__ERROR(errno, hfs_error);
+		return -1;
+	}
 
-	while (1)
+	if (count > RAW_RANGES)
 	{
-		chunk_size = hfs_read(ifile, buf, sizeof(buf));
-		if (chunk_size == -1)
+		list = malloc(count * sizeof(hfsrange));
+		if (list == 0)
 		{
-			__ERROR(errno, hfs_error);
+			__ERROR(ENOMEM, 0);
 			return -1;
 		}
-		else if (chunk_size == 0)
-			break;
 
-		bytes = write(ofile, buf, chunk_size);
-		if (bytes == -1)
+		if (hfs_ranges(ifile, list, count) == -1)
 		{
-			__ERROR(errno, "error writing data");
+			__ERROR(errno, hfs_error);
+			free(list);
 			return -1;
 		}
-		else if (bytes != chunk_size)
+	}
+
+	if (hfs_fstat(ifile, &ent) == -1)
+	{
+		__ERROR(errno, hfs_error);
+		result = -1;
+	}
+	else
+	{
+		bufsz = iobuf_size(vol, ent.u.file.dsize);
+
+		buf = iobuf_get(bufsz);
+		if (buf == 0)
 		{
-			__ERROR(EIO, "wrote incomplete chunk");
+			__ERROR(ENOMEM, 0);
+			result = -1;
+		}
+	}
+
+	for (i = 0; i < count && result == 0; ++i)
+	{
+		start = list[i].start;
+
+		for (left = list[i].length; left; left -= bytes)
+		{
+			bytes = (left < bufsz) ? left : bufsz;
+
+			/* the tail of the last block is read but not written */
+
+			nblocks = (bytes + HFS_BLOCKSZ - 1) >> HFS_BLOCKSZ_BITS;
+
+			if (hfs_readblocks(vol, start, buf, nblocks) == -1)
+			{
+				__ERROR(errno, hfs_error);
+				result = -1;
+				break;
+			}
+
+			if (putbytes(ofile, buf, bytes) == -1)
+			{
+				result = -1;
+				break;
+			}
+
+			start += nblocks;
+		}
+	}
+
+	if (list != ranges)
+		free(list);
+
+	return result;
+}
+
+/*
+ * NAME:	fork->as()
+ * DESCRIPTION:	copy a whole fork through a large buffer
+ */
+static
+int fork_as(hfsfile *ifile, int fork, int ofile, unsigned long size,
+	char *buf, unsigned long bufsz)
+{
+	long bytes;
+	unsigned long total = 0;
+
+	if (hfs_setfork(ifile, fork) == -1)
+	{
+		__ERROR(errno, hfs_error);
+		return -1;
+	}
+
+	while (1)
+	{
+		bytes = hfs_read(ifile, buf, bufsz);
+		if (bytes == -1)
+		{
+			__ERROR(errno, hfs_error);
 			return -1;
 		}
+		else if (bytes == 0)
+			break;
+
+		if (putbytes(ofile, buf, bytes) == -1)
+			return -1;
+
+		total += bytes;
 	}
+
+	if (total != size)
+	{
+		__ERROR(EIO, "inconsistent fork length");
+		return -1;
+	}
+
 	return 0;
 }
 
+/*
+ * NAME:	do_as()
+ * DESCRIPTION:	perform copy using AppleSingle, or AppleDouble if sfile != -1
+ */
+static
+int do_as(hfsvol *vol, hfsfile *ifile, int ofile, int sfile)
+{
+	hfsdirent ent;
+	unsigned char head[CPO_ASHEADERMAX];
+	unsigned long bufsz;
+	char *buf;
+	int result = 0;
+
+	if (hfs_fstat(ifile, &ent) == -1)
+	{
+		__ERROR(errno, hfs_error);
+		return -1;
+	}
+
+	bufsz = iobuf_size(vol, (ent.u.file.dsize > ent.u.file.rsize) ?
+		ent.u.file.dsize : ent.u.file.rsize);
+
+	buf = iobuf_get(bufsz);
+	if (buf == 0)
+	{
+		__ERROR(ENOMEM, 0);
+		return -1;
+	}
+
+	if (sfile == -1)
+	{
+		/* header, resource fork, data fork in a single file */
+
+		if (putbytes(ofile, head, cpo_asheader(head, &ent, 1)) == -1 ||
+				fork_as(ifile, 1, ofile, ent.u.file.rsize, buf, bufsz) == -1 ||
+				fork_as(ifile, 0, ofile, ent.u.file.dsize, buf, bufsz) == -1)
+			result = -1;
+	}
+	else
+	{
+		/* the data fork alone, and everything else beside it */
+
+		if (fork_as(ifile, 0, ofile, ent.u.file.dsize, buf, bufsz) == -1 ||
+				putbytes(sfile, head, cpo_asheader(head, &ent, 0)) == -1 ||
+				fork_as(ifile, 1, sfile, ent.u.file.rsize, buf, bufsz) == -1)
+			result = -1;
+	}
+
+	return result;
+}
+
 /* Utility Routines ======================================================== */
 
 /*
@@ -459,6 +734,66 @@ hfsfile *opensrc(hfsvol *vol, const char *srcname,
 	return file;
 }
 
+/*
+ * NAME:	dstpath()
+ * DESCRIPTION:	return the UNIX path a copy to dstname creates
+ */
+static
+wchar_t *dstpath(const wchar_t *dstname, const wchar_t *hint)
+{
+	struct _stat64i32 sbuf;
+	wchar_t *path;
+
+	if (_wstat(dstname, &sbuf) != -1 && S_ISDIR(sbuf.st_mode))
+	{
+		path = malloc((wcslen(dstname) + 1 + wcslen(hint) + 1) * sizeof(wchar_t));
+		if (path)
+		{
+			wcscpy(path, dstname);
+			wcscat(path, L"\\");
+			wcscat(path, hint);
+		}
+	}
+	else
+		path = _wcsdup(dstname);
+
+	if (path == 0)
+		__ERROR(ENOMEM, 0);
+
+	return path;
+}
+
+/*
+ * NAME:	sidecar()
+ * DESCRIPTION:	return the path of the AppleDouble header file for a UNIX file
+ */
+static
+wchar_t *sidecar(const wchar_t *path)
+{
+	const wchar_t *name, *ptr;
+	wchar_t *side;
+
+	name = path;
+	for (ptr = path; *ptr; ++ptr)
+	{
+		if (*ptr == L'\\' || *ptr == L'/' || *ptr == L':')
+			name = ptr + 1;
+	}
+
+	side = malloc((wcslen(path) + 3) * sizeof(wchar_t));
+	if (side == 0)
+	{
+		__ERROR(ENOMEM, 0);
+		return 0;
+	}
+
+	wcsncpy(side, path, name - path);
+	wcscpy(side + (name - path), L"._");
+	wcscat(side, name);
+
+	return side;
+}
+
 /*
  * NAME:	opendst()
  * DESCRIPTION:	open the destination file
@@ -472,29 +807,15 @@ int opendst(const wchar_t *dstname, const wchar_t *hint, BOOL binary)
 		fd = dup(STDOUT_FILENO);
 	else
 	{
-		struct _stat64i32 sbuf;
-		wchar_t *path = 0;
-
-		if (_wstat(dstname, &sbuf) != -1 && S_ISDIR(sbuf.st_mode))
-		{
-			path = malloc((wcslen(dstname) + 1 + wcslen(hint) + 1) * sizeof(wchar_t));
-			if (path == 0)
-			{
-				__ERROR(ENOMEM, 0);
-				return -1;
-			}
+		wchar_t *path;
 
-			wcscpy(path, dstname);
-			wcscat(path, L"\\");
-			wcscat(path, hint);
-
-			dstname = path;
-		}
+		path = dstpath(dstname, hint);
+		if (path == 0)
+			return -1;
 
-		fd = _wopen(dstname, binary ? O_WRONLY | O_CREAT | O_TRUNC | O_BINARY : O_WRONLY | O_CREAT | O_TRUNC, 0666);
+		fd = _wopen(path, binary ? O_WRONLY | O_CREAT | O_TRUNC | O_BINARY : O_WRONLY | O_CREAT | O_TRUNC, 0666);
 
-		if (path)
-			free(path);
+		free(path);
 	}
 
 	if (fd == -1)
@@ -560,6 +881,69 @@ void closefiles(hfsfile *ifile, int ofile, int *result)
 
 /* Interface Routines ====================================================== */
 
+/*
+ * NAME:	cpo->asheader()
+ * DESCRIPTION:	fill in an AppleSingle or AppleDouble header; return its length
+ */
+int cpo_asheader(unsigned char *buf, const hfsdirent *ent, int single)
+{
+	unsigned long ids[5], lens[5], offset;
+	unsigned char *ptr;
+	int count = 0, namelen, i;
+
+	namelen = strlen(ent->name);
+
+	ids[count] = AS_NAME;  lens[count++] = namelen;
+	ids[count] = AS_DATES; lens[count++] = 16;
+	ids[count] = AS_FINFO; lens[count++] = 32;
+	ids[count] = AS_RSRC;  lens[count++] = ent->u.file.rsize;
+
+	if (single)
+	{
+		ids[count] = AS_DATA; lens[count++] = ent->u.file.dsize;
+	}
+
+	memset(buf, 0, AS_HEADERSZ);
+
+	d_putul(&buf[0], single ? AS_MAGIC : AD_MAGIC);
+	d_putul(&buf[4], AS_VERSION);
+	d_putuw(&buf[24], count);
+
+	/* the entries are laid out in order, forks last */
+
+	ptr    = buf + AS_HEADERSZ;
+	offset = AS_HEADERSZ + count * 12;
+
+	for (i = 0; i < count; ++i)
+	{
+		d_putul(&ptr[0], ids[i]);
+		d_putul(&ptr[4], offset);
+		d_putul(&ptr[8], lens[i]);
+
+		ptr    += 12;
+		offset += lens[i];
+	}
+
+	memcpy(ptr, ent->name, namelen);
+	ptr += namelen;
+
+	d_putul(&ptr[0],  asdate(ent->crdate));
+	d_putul(&ptr[4],  asdate(ent->mddate));
+	d_putul(&ptr[8],  asdate(ent->bkdate));
+	d_putul(&ptr[12], AS_NODATE);
+	ptr += 16;
+
+	memset(ptr, 0, 32);
+	memcpy(&ptr[0], ent->u.file.type,    4);
+	memcpy(&ptr[4], ent->u.file.creator, 4);
+	d_putsw(&ptr[8],  ent->fdflags);
+	d_putsw(&ptr[10], ent->fdlocation.v);
+	d_putsw(&ptr[12], ent->fdlocation.h);
+	ptr += 32;
+
+	return ptr - buf;
+}
+
 /*
  * NAME:	cpo->macb()
  * DESCRIPTION:	copy an HFS file to a UNIX file using MacBinary II translation
@@ -572,7 +956,7 @@ int cpo_macb(hfsvol *vol, const char *srcname, const wchar_t *dstname)
 	if (openfiles(vol, srcname, dstname, ".bin", &ifile, &ofile, 1) == -1)
 		return -1;
 
-	result = do_macb(ifile, ofile);
+	result = do_macb(vol, ifile, ofile);
 
 	closefiles(ifile, ofile, &result);
 
@@ -591,7 +975,7 @@ int cpo_binh(hfsvol *vol, const char *srcname, const wchar_t *dstname)
 	if (openfiles(vol, srcname, dstname, ".hqx", &ifile, &ofile, 0) == -1)
 		return -1;
 
-	result = do_binh(ifile, ofile);
+	result = do_binh(vol, ifile, ofile);
 
 	closefiles(ifile, ofile, &result);
 
@@ -614,7 +998,7 @@ int cpo_text(hfsvol *vol, const char *srcname, const wchar_t *dstname)
 	if (openfiles(vol, srcname, dstname, ext, &ifile, &ofile, 0) == -1)
 		return -1;
 
-	result = do_text(ifile, ofile);
+	result = do_text(vol, ifile, ofile);
 
 	closefiles(ifile, ofile, &result);
 
@@ -633,9 +1017,508 @@ int cpo_raw(hfsvol *vol, const char *srcname, const wchar_t *dstname)
 	if (openfiles(vol, srcname, dstname, 0, &ifile, &ofile, 1) == -1)
 		return -1;
 
-	result = do_raw(ifile, ofile);
+	result = do_raw(vol, ifile, ofile);
+
+	closefiles(ifile, ofile, &result);
+
+	return result;
+}
+
+/*
+ * NAME:	cpo->asgl()
+ * DESCRIPTION:	copy an HFS file to a UNIX file in AppleSingle format
+ */
+int cpo_asgl(hfsvol *vol, const char *srcname, const wchar_t *dstname)
+{
+	hfsfile *ifile;
+	int ofile, result = 0;
+
+	if (openfiles(vol, srcname, dstname, ".as", &ifile, &ofile, 1) == -1)
+		return -1;
+
+	result = do_as(vol, ifile, ofile, -1);
+
+	closefiles(ifile, ofile, &result);
+
+	return result;
+}
+
+/*
+ * NAME:	cpo->adbl()
+ * DESCRIPTION:	copy an HFS file to a UNIX data file and AppleDouble header file
+ */
+int cpo_adbl(hfsvol *vol, const char *srcname, const wchar_t *dstname)
+{
+	hfsfile *ifile;
+	const char *dsthint_macroman;
+	wchar_t *dsthint, *path = 0, *side = 0;
+	int ofile = -1, sfile = -1, result = 0;
+
+	if (wcscmp(dstname, L"-") == 0)
+	{
+		__ERROR(EINVAL, "AppleDouble can't be written to standard output");
+		return -1;
+	}
+
+	ifile = opensrc(vol, srcname, &dsthint_macroman, 0);
+	if (ifile == 0)
+		return -1;
+
+	dsthint = macRomanToUtf16(dsthint_macroman);
+	if (dsthint == 0)
+	{
+		__ERROR(ENOMEM, 0);
+		goto fail;
+	}
+
+	path = dstpath(dstname, dsthint);
+	free(dsthint);
+
+	if (path == 0 || (side = sidecar(path)) == 0)
+		goto fail;
+
+	ofile = _wopen(path, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0666);
+	if (ofile == -1)
+	{
+		__ERROR(errno, "error opening destination file");
+		goto fail;
+	}
+
+	sfile = _wopen(side, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0666);
+	if (sfile == -1)
+	{
+		__ERROR(errno, "error opening AppleDouble header file");
+		goto fail;
+	}
+
+	result = do_as(vol, ifile, ofile, sfile);
+
+	if (close(sfile) == -1 && result == 0)
+	{
+		__ERROR(errno, "error closing AppleDouble header file");
+		result = -1;
+	}
 
 	closefiles(ifile, ofile, &result);
 
+	free(path);
+	free(side);
+
+	return result;
+
+fail:
+	if (ofile != -1)
+		close(ofile);
+
+	hfs_close(ifile);
+
+	free(path);
+	free(side);
+
+	return -1;
+}
+
+/*
+ * NAME:	failjob()
+ * DESCRIPTION:	record the first error for a batch job
+ */
+static
+void failjob(cpojob *job, int code, const char *str)
+{
+	if (job->error == 0)
+	{
+		job->error  = code ? code : EIO;
+		job->errstr = str;
+	}
+}
+
+/*
+ * NAME:	pipelined()
+ * DESCRIPTION:	return 1 iff a translation can be made by the writer threads
+ */
+static
+int pipelined(cpofunc copyfile)
+{
+	return copyfile == cpo_raw || copyfile == cpo_macb ||
+		copyfile == cpo_binh || copyfile == cpo_text;
+}
+
+/*
+ * NAME:	writer()
+ * DESCRIPTION:	write the chunks of one file after another to UNIX files
+ */
+static
+unsigned __stdcall writer(void *arg)
+{
+	bwriter *w = arg;
+	bchunk *c;
+	cpojob *job;
+	binhex *bh = 0;
+	char *ptr, *text = 0;
+	int ofile = -1, len, last;
+	long bytes;
+
+	while ((c = q_get(&w->work)) != 0)
+	{
+		job = &w->jobs[c->job];
+
+		if (c->error)
+			failjob(job, c->error, c->errstr);
+
+		if (ofile == -1 && job->error == 0)
+		{
+			if (job->copyfile == cpo_text || job->copyfile == cpo_binh)
+				ofile = _wopen(job->dst, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+			else
+				ofile = _wopen(job->dst, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0666);
+
+			if (ofile == -1)
+				failjob(job, errno, "error opening destination file");
+			else if (job->copyfile == cpo_binh)
+			{
+				bh = bh_start(ofile);
+				if (bh == 0)
+					failjob(job, errno, bh_error);
+			}
+		}
+
+		if (bh && job->error == 0)
+		{
+			if ((c->len && bh_insert(bh, c->data, c->len) == -1) ||
+					(c->crc && bh_insertcrc(bh) == -1))
+				failjob(job, errno, bh_error);
+		}
+		else if (ofile != -1 && c->len && job->error == 0)
+		{
+			ptr = c->data;
+			len = c->len;
+
+			if (job->copyfile == cpo_text)
+			{
+				if (text == 0)
+					text = malloc(BATCH_CHUNKSZ * 3);
+
+				if (text == 0)
+				{
+					failjob(job, ENOMEM, 0);
+					ptr = 0;
+				}
+				else
+				{
+					len = macRomanToUtf8Text(c->data, c->len, text);
+					ptr = text;
+				}
+			}
+
+			if (ptr)
+			{
+				bytes = write(ofile, ptr, len);
+				if (bytes == -1)
+					failjob(job, errno, "error writing data");
+				else if (bytes != len)
+					failjob(job, EIO, "wrote incomplete chunk");
+			}
+		}
+
+		last = c->last;
+
+		if (last)
+		{
+			if (bh && bh_end(bh) == -1)
+				failjob(job, errno, bh_error);
+
+			bh = 0;
+
+			if (ofile != -1 && close(ofile) == -1)
+				failjob(job, errno, "error closing destination file");
+
+			ofile = -1;
+		}
+
+		q_put(w->free, c);
+
+		if (last)
+			q_put(w->idle, w);
+	}
+
+	free(text);
+
+	return 0;
+}
+
+/*
+ * NAME:	getchunk()
+ * DESCRIPTION:	take an empty chunk for a file
+ */
+static
+bchunk *getchunk(bwriter *w, int n)
+{
+	bchunk *c;
+
+	c = q_get(w->free);
+
+	c->job    = n;
+	c->last   = 0;
+	c->crc    = 0;
+	c->error  = 0;
+	c->errstr = 0;
+	c->len    = 0;
+
+	return c;
+}
+
+/*
+ * NAME:	feed()
+ * DESCRIPTION:	read an HFS file into chunks for a writer thread
+ */
+static
+void feed(hfsvol *vol, cpojob *jobs, int n, bwriter *w)
+{
+	hfsfile *ifile;
+	hfsdirent ent;
+	bchunk *c = 0;
+	int macb, binh, fork, error = 0;
+	const char *errstr = 0;
+	unsigned long total, size, pad;
+	long bytes;
+
+	macb = (jobs[n].copyfile == cpo_macb);
+	binh = (jobs[n].copyfile == cpo_binh);
+
+	ifile = hfs_open(vol, jobs[n].src);
+	if (ifile == 0 || hfs_fstat(ifile, &ent) == -1)
+	{
+		error  = errno;
+		errstr = hfs_error;
+		goto done;
+	}
+
+	/* the BinHex header and each fork are followed by their CRC */
+
+	if (binh)
+	{
+		c = getchunk(w, n);
+
+		c->len = binhheader((unsigned char *) c->data, &ent);
+		c->crc = 1;
+
+		q_put(&w->work, c);
+		c = 0;
+	}
+
+	for (fork = 0; fork < (macb || binh ? 2 : 1); ++fork)
+	{
+		if (hfs_setfork(ifile, fork) == -1)
+		{
+			error  = errno;
+			errstr = hfs_error;
+			goto done;
+		}
+
+		total = 0;
+
+		while (1)
+		{
+			if (c == 0)
+			{
+				c = getchunk(w, n);
+
+				if (macb && fork == 0 && total == 0)
+				{
+					macbheader((unsigned char *) c->data, &ent);
+					c->len = MACB_BLOCKSZ;
+				}
+			}
+
+			bytes = hfs_read(ifile, c->data + c->len, BATCH_CHUNKSZ - c->len);
+			if (bytes == -1)
+			{
+				error  = errno;
+				errstr = hfs_error;
+				goto done;
+			}
+			else if (bytes == 0)
+				break;
+
+			c->len += bytes;
+			total  += bytes;
+
+			if (c->len == BATCH_CHUNKSZ)
+			{
+				q_put(&w->work, c);
+				c = 0;
+			}
+		}
+
+		if (macb || binh)
+		{
+			size = fork ? ent.u.file.rsize : ent.u.file.dsize;
+			if (total != size)
+			{
+				error  = EIO;
+				errstr = "inconsistent fork length";
+				goto done;
+			}
+		}
+
+		/*
+		 * The chunk is never full here, and as chunks are a multiple of
+		 * the block size it has room for the padding; the padding may
+		 * fill it, though, which leaves nothing to read the next fork into.
+		 */
+
+		if (macb)
+		{
+			pad = total % MACB_BLOCKSZ;
+			if (pad)
+			{
+				memset(c->data + c->len, 0, MACB_BLOCKSZ - pad);
+				c->len += MACB_BLOCKSZ - pad;
+			}
+
+			if (c->len == BATCH_CHUNKSZ)
+			{
+				q_put(&w->work, c);
+				c = 0;
+			}
+		}
+		else if (binh)
+		{
+			c->crc = 1;
+
+			q_put(&w->work, c);
+			c = 0;
+		}
+	}
+
+done:
+	if (ifile && hfs_close(ifile) == -1 && error == 0)
+	{
+		error  = errno;
+		errstr = hfs_error;
+	}
+
+	if (c == 0)
+		c = getchunk(w, n);
+
+	c->last   = 1;
+	c->error  = error;
+	c->errstr = errstr;
+
+	q_put(&w->work, c);
+}
+
+/*
+ * NAME:	cpo->batch()
+ * DESCRIPTION:	copy many HFS files, writing them out on worker threads
+ */
+int cpo_batch(hfsvol *vol, cpojob *jobs, int njobs)
+{
+	queue empty, idle;
+	bchunk *chunks = 0;
+	bwriter writers[BATCH_WRITERS];
+	HANDLE threads[BATCH_WRITERS];
+	int nthreads = 0, i, result = 0;
+
+	if (njobs == 0)
+		return 0;
+
+	if (q_init(&empty, BATCH_CHUNKS) == -1)
+		goto nomem0;
+
+	if (q_init(&idle, BATCH_WRITERS) == -1)
+		goto nomem1;
+
+	chunks = calloc(BATCH_CHUNKS, sizeof(bchunk));
+	if (chunks == 0)
+		goto nomem2;
+
+	for (i = 0; i < BATCH_CHUNKS; ++i)
+	{
+		chunks[i].data = malloc(BATCH_CHUNKSZ + MACB_BLOCKSZ);
+		if (chunks[i].data == 0)
+			goto nomem2;
+
+		q_put(&empty, &chunks[i]);
+	}
+
+	for (i = 0; i < BATCH_WRITERS && i < njobs; ++i)
+	{
+		bwriter *w = &writers[nthreads];
+
+		w->jobs = jobs;
+		w->free = &empty;
+		w->idle = &idle;
+
+		if (q_init(&w->work, BATCH_CHUNKS + 1) == -1)
+			break;
+
+		threads[nthreads] = (HANDLE) _beginthreadex(0, 0, writer, w, 0, 0);
+		if (threads[nthreads] == 0)
+		{
+			q_free(&w->work);
+			break;
+		}
+
+		q_put(&idle, w);
+		++nthreads;
+	}
+
+	/*
+	 * This thread alone uses the volume. It reads each file in turn and
+	 * hands its chunks to whichever writer is free.
+	 */
+
+	for (i = 0; i < njobs; ++i)
+	{
+		if (nthreads == 0 || ! pipelined(jobs[i].copyfile))
+		{
+			if (jobs[i].copyfile(vol, jobs[i].src, jobs[i].dst) == -1)
+				failjob(&jobs[i], errno, cpo_error);
+		}
+		else
+			feed(vol, jobs, i, q_get(&idle));
+	}
+
+	for (i = 0; i < nthreads; ++i)
+		q_put(&writers[i].work, 0);
+
+	if (nthreads)
+		WaitForMultipleObjects(nthreads, threads, TRUE, INFINITE);
+
+	for (i = 0; i < nthreads; ++i)
+	{
+		CloseHandle(threads[i]);
+		q_free(&writers[i].work);
+	}
+
+	for (i = 0; i < njobs; ++i)
+	{
+		if (jobs[i].error)
+			result = -1;
+	}
+
+	for (i = 0; i < BATCH_CHUNKS; ++i)
+		free(chunks[i].data);
+
+	free(chunks);
+	q_free(&idle);
+	q_free(&empty);
+
 	return result;
+
+nomem2:
+	if (chunks)
+	{
+		for (i = 0; i < BATCH_CHUNKS; ++i)
+			free(chunks[i].data);
+	}
+
+	free(chunks);
+	q_free(&idle);
+nomem1:
+	q_free(&empty);
+nomem0:
+	__ERROR(ENOMEM, 0);
+	return -1;
 }
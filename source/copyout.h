@@ -25,3 +25,19 @@ int cpo_macb(hfsvol *, const char *, const wchar_t *);
 int cpo_binh(hfsvol *, const char *, const wchar_t *);
 int cpo_text(hfsvol *, const char *, const wchar_t *);
 int cpo_raw(hfsvol *, const char *, const wchar_t *);
+int cpo_adbl(hfsvol *, const char *, const wchar_t *);
+int cpo_asgl(hfsvol *, const char *, const wchar_t *);
+
+# define CPO_ASHEADERMAX	(26 + 5 * 12 + HFS_MAX_FLEN + 16 + 32)
+
+int cpo_asheader(unsigned char *, const hfsdirent *, int);
+
+typedef struct {
+	char *src;		/* HFS path */
+	wchar_t *dst;		/* UNIX path of the file to create */
+	cpofunc copyfile;	/* translation */
+	int error;		/* errno if the copy failed, else 0 */
+	const char *errstr;	/* explanation of the failure, or 0 */
+} cpojob;
+
+int cpo_batch(hfsvol *, cpojob *, int);
@@ -26,299 +26,478 @@
 # include "glob.h"
 # include "charset.h"
 
+# define GLOB_DIRENTS	16	/* directory entries read per call */
+
+enum {
+	G_CHAR,		/* one character, compared by hfs_charorder */
+	G_ANY,		/* ? */
+	G_STAR,		/* * */
+	G_SET		/* [...]; an empty set never matches */
+};
+
+typedef struct {
+	unsigned char op;
+	unsigned char ch;		/* hfs_charorder value for G_CHAR */
+	unsigned char set[32];	/* member bytes for G_SET */
+} globop;
+
+struct globpat {
+	int nops;
+	globop ops[1];
+};
+
 /*
- * NAME:	strmatch()
- * DESCRIPTION:	return 1 iff a string matches a given (glob) pattern
+ * NAME:	addset()
+ * DESCRIPTION:	add the bytes collating between two characters to a set
  */
 static
-int strmatch(const char *str, const char *pat)
+void addset(unsigned char *set, unsigned char c0, unsigned char c1)
 {
-	while (1)
+	unsigned char lo, hi;
+	int c;
+
+	lo = hfs_charorder[c0];
+	hi = hfs_charorder[c1];
+
+	if (lo > hi)
 	{
-		if (*str == 0 && *pat != 0 && *pat != '*')
-			return 0;
+		lo = hfs_charorder[c1];
+		hi = hfs_charorder[c0];
+	}
+
+	for (c = 0; c < 256; ++c)
+	{
+		if (hfs_charorder[c] >= lo && hfs_charorder[c] <= hi)
+			set[c >> 3] |= 1 << (c & 7);
+	}
+}
+
+/*
+ * NAME:	glob->compile()
+ * DESCRIPTION:	translate a glob pattern for repeated matching
+ */
+globpat *glob_compile(const char *pattern)
+{
+	const unsigned char *pat = (const unsigned char *) pattern;
+	globpat *gp;
+	globop *op;
+
+	/* no character compiles to more than one operation */
 
+	gp = malloc(sizeof(globpat) + strlen(pattern) * sizeof(globop));
+	if (gp == 0)
+		return 0;
+
+	op = gp->ops;
+
+	while (*pat)
+	{
 		switch (*pat)
 		{
-		case 0:
-			return (*str == 0);
-
 		case '*':
-			if (*++pat == 0)
-				return 1;
+			++pat;
 
-			while (1)
-			{
-				if (strmatch(str, pat))
-					return 1;
+			/* a run of stars matches what one does */
 
-				if (*str++ == 0)
-					return 0;
-			}
+			if (op > gp->ops && op[-1].op == G_STAR)
+				continue;
+
+			op->op = G_STAR;
+			break;
 
 		case '?':
+			++pat;
+			op->op = G_ANY;
 			break;
 
 		case '[':
-			{
-				++pat;
+			op->op = G_SET;
+			memset(op->set, 0, sizeof(op->set));
 
-				while (1)
+			for (++pat; *pat && *pat != ']'; ++pat)
+			{
+				if (pat[1] != '-' || pat[2] == ']')
+					addset(op->set, pat[0], pat[0]);
+				else if (pat[2])
 				{
-					unsigned char p0, p1, s;
+					addset(op->set, pat[0], pat[2]);
+					pat += 2;
+				}
+				else
+				{
+					/* an unfinished range ends the pattern */
 
-					p0 = *pat;
+					addset(op->set, pat[0], pat[0]);
+					pat += 1;
+				}
+			}
 
-					if (p0 == ']' || p0 == 0)
-						return 0;
+			if (*pat)
+				++pat;
+			break;
 
-					s = *str;
+		case '\\':
+			if (pat[1] == 0)
+			{
+				/* a trailing escape can't match anything */
 
-					if (hfs_charorder[p0] == hfs_charorder[s])
-						break;
+				++pat;
+				op->op = G_SET;
+				memset(op->set, 0, sizeof(op->set));
+				break;
+			}
+			++pat;
 
-					if (pat[1] == '-')
-					{
-						p1 = pat[2];
+		/* fall through */
+		default:
+			op->op = G_CHAR;
+			op->ch = hfs_charorder[*pat++];
+			break;
+		}
 
-						if (p1 == 0)
-							return 0;
+		++op;
+	}
 
-						if ((hfs_charorder[p0] <= hfs_charorder[s] &&
-							 hfs_charorder[p1] >= hfs_charorder[s]) ||
-							(hfs_charorder[p0] >= hfs_charorder[s] &&
-							 hfs_charorder[p1] <= hfs_charorder[s]))
-							break;
+	gp->nops = op - gp->ops;
 
-						pat += 2;
-					}
+	return gp;
+}
 
-					++pat;
-				}
+/*
+ * NAME:	glob->match()
+ * DESCRIPTION:	return 1 iff a string matches a compiled pattern
+ */
+int glob_match(const globpat *gp, const char *str)
+{
+	const unsigned char *s = (const unsigned char *) str, *mark = 0;
+	const globop *op, *end, *star = 0;
 
-				while (*pat != ']')
-				{
-					if (*pat == 0)
-					{
-						--pat;
-						break;
-					}
-					++pat;
-				}
-			}
-			break;
+	op  = gp->ops;
+	end = gp->ops + gp->nops;
 
-		case '\\':
-			if (*++pat == 0)
-				return 0;
+	while (*s)
+	{
+		if (op < end)
+		{
+			if (op->op == G_STAR)
+			{
+				star = ++op;
+				mark = s;
+				continue;
+			}
 
-		/* fall through */
-		default:
-			if (hfs_charorder[(unsigned char) *pat] != hfs_charorder[(unsigned char) *str])
-				return 0;
+			if (op->op == G_ANY ||
+				(op->op == G_CHAR && op->ch == hfs_charorder[*s]) ||
+				(op->op == G_SET && (op->set[*s >> 3] & (1 << (*s & 7)))))
+			{
+				++op, ++s;
+				continue;
+			}
 		}
 
-		++pat, ++str;
+		/* let the last star take one more character and go on from there */
+
+		if (star == 0)
+			return 0;
+
+		op = star;
+		s  = ++mark;
 	}
+
+	while (op < end && op->op == G_STAR)
+		++op;
+
+	return op == end;
 }
 
 /*
- * NAME:	doglob()
- * DESCRIPTION:	perform recursive depth-first traversal of path to be globbed
+ * NAME:	glob->free()
+ * DESCRIPTION:	dispose of a compiled pattern
+ */
+void glob_free(globpat *gp)
+{
+	free(gp);
+}
+
+/*
+ * NAME:	expand()
+ * DESCRIPTION:	append each brace alternative of a string to a list
  */
 static
-int doglob(hfsvol *vol, dlist *list, const char *dir, const char *rem)
+int expand(dlist *alts, const char *str)
 {
 	dstring new;
-	int special, len, result = 0;
-	const char *obrace, *cbrace, *ptr;
+	const char *obrace = 0, *cbrace = 0, *ptr, *elt;
+	int len, result = 0;
 
-	dstr_init(&new);
+	for (ptr = str; *ptr && cbrace == 0; ++ptr)
+	{
+		if (*ptr == '\\' && ptr[1])
+			++ptr;
+		else if (*ptr == '{' && obrace == 0)
+			obrace = ptr;
+		else if (*ptr == '}' && obrace)
+			cbrace = ptr;
+	}
 
-	special = 0;
-	obrace = cbrace = 0;
+	if (obrace == 0)
+		return dl_append(alts, str);
 
-	for (ptr = rem; *ptr && (obrace || *ptr != ':'); ++ptr)
-	{
-		switch (*ptr)
-		{
-		case '{':
-			if (obrace == 0)
-				obrace = ptr;
-			break;
+	/* the group doesn't close within this string */
 
-		case '}':
-			if (obrace && cbrace == 0)
-				cbrace = ptr;
-			break;
+	if (cbrace == 0)
+		return 1;
 
-		case '\\':
-			if (*++ptr == 0)
-				--ptr;
+	dstr_init(&new);
 
-		case '*':
-		case '[':
-		case '?':
-			special = 1;
-			break;
-		}
+	if (dstr_append(&new, str, obrace - str) == -1)
+	{
+		dstr_free(&new);
+		return -1;
 	}
+	len = dstr_length(&new);
 
-	if (obrace)
+	for (ptr = obrace; ptr != cbrace && result == 0; )
 	{
-		const char *elt;
+		elt = ++ptr;
 
-		if (cbrace == 0 || dstr_append(&new, rem, obrace - rem) == -1)
-		{
-			dstr_free(&new);
-			return -1;
-		}
-		len = dstr_length(&new);
+		while (ptr != cbrace && *ptr != ',')
+			++ptr;
 
-		for (ptr = obrace; *ptr != '}'; )
-		{
-			elt = ptr + 1;
+		if (dstr_append(&new, elt, ptr - elt) == -1 ||
+				dstr_append(&new, cbrace + 1, -1) == -1)
+			result = -1;
+		else
+			result = expand(alts, dstr_string(&new));
 
-			ptr = elt;
-			while (*ptr != '}' && *ptr != ',')
-				++ptr;
+		dstr_shrink(&new, len);
+	}
 
-			if (dstr_append(&new, elt, ptr - elt) == -1 ||
-					dstr_append(&new, cbrace + 1, -1) == -1 ||
-					doglob(vol, list, dir, dstr_string(&new)) == -1)
-			{
-				dstr_free(&new);
-				return -1;
-			}
+	dstr_free(&new);
 
-			dstr_shrink(&new, len);
-		}
+	return result;
+}
 
-		dstr_free(&new);
-		return 0;
-	}
+static
+int doglob(hfsvol *, dlist *, const char *, const char *);
 
-	if (dstr_append(&new, dir, -1) == -1)
+/*
+ * NAME:	globdir()
+ * DESCRIPTION:	match the alternatives for one path component in one scan
+ */
+static
+int globdir(hfsvol *vol, dlist *list, const char *dir,
+	char **alts, int nalts, const char *next)
+{
+	hfsdirent ents[GLOB_DIRENTS], *ent;
+	globpat **pats;
+	dlist *hits;
+	dstring new;
+	char **names;
+	int special = 0, count, len, i, k, n, result = 0;
+
+	pats = calloc(nalts, sizeof(globpat *));
+	hits = calloc(nalts, sizeof(dlist));
+	if (pats == 0 || hits == 0)
 	{
-		dstr_free(&new);
+		free(pats);
+		free(hits);
 		return -1;
 	}
-	len = dstr_length(&new);
 
-	if (special)
+	/* literal alternatives need neither a pattern nor a directory scan */
+
+	for (k = 0; k < nalts; ++k)
 	{
-		hfsdirent ent;
-		hfsdir *d;
-		dstring pat;
-		int found = 0;
+		if (dl_init(&hits[k]) == -1)
+			result = -1;
 
-		dstr_init(&pat);
-		if (dstr_append(&pat, rem, ptr - rem) == -1)
+		if (strpbrk(alts[k], "*?[\\"))
 		{
-			dstr_free(&pat);
-			dstr_free(&new);
-			return -1;
+			special = 1;
+
+			pats[k] = glob_compile(alts[k]);
+			if (pats[k] == 0)
+				result = -1;
 		}
+	}
+
+	if (result == 0 && special)
+	{
+		hfsdir *d;
 
-		if (*dir == 0 && strchr(rem, ':') == 0)
+		if (*dir == 0 && next == 0)
 			d = hfs_opendir(vol, ":");
 		else
 			d = hfs_opendir(vol, dir);
 
 		if (d == 0)
+			result = -1;
+		else
 		{
-			dstr_free(&pat);
-			dstr_free(&new);
-			return -1;
-		}
-
-		while (hfs_readdir(d, &ent) != -1)
-		{
-			if (ent.fdflags & HFS_FNDR_ISINVISIBLE)
-				continue;
-
-			if (strmatch(ent.name, dstr_string(&pat)))
+			while (result == 0 &&
+				(count = hfs_readdir_many(d, ents, GLOB_DIRENTS)) > 0)
 			{
-				dstr_shrink(&new, len);
-				if (dstr_append(&new, ent.name, -1) == -1)
+				for (i = 0; i < count && result == 0; ++i)
 				{
-					result = -1;
-					break;
-				}
+					ent = &ents[i];
 
-				if (*ptr == 0)
-				{
-					found	= 1;
-					result = dl_append(list, dstr_string(&new));
+					if (ent->fdflags & HFS_FNDR_ISINVISIBLE)
+						continue;
 
-					if (result == -1)
-						break;
-				}
-				else if (ent.flags & HFS_ISDIR)
-				{
-					if (dstr_append(&new, ":", 1) == -1)
-						result = -1;
-					else
+					/* only a directory can lead on to the rest of the path */
+
+					if (next && ! (ent->flags & HFS_ISDIR))
+						continue;
+
+					for (k = 0; k < nalts && result == 0; ++k)
 					{
-						found	= 1;
-						result = doglob(vol, list, dstr_string(&new), ptr + 1);
+						if (pats[k] && glob_match(pats[k], ent->name))
+							result = dl_append(&hits[k], ent->name);
 					}
-
-					if (result == -1)
-						break;
 				}
 			}
+
+			hfs_closedir(d);
 		}
+	}
 
-		hfs_closedir(d);
+	dstr_init(&new);
 
-		if (result == 0 && ! found)
+	if (result == 0 && dstr_append(&new, dir, -1) == -1)
+		result = -1;
+	len = dstr_length(&new);
+
+	for (k = 0; k < nalts && result == 0; ++k)
+	{
+		if (pats[k] == 0)
 		{
+			names = &alts[k];
+			n     = 1;
+		}
+		else
+		{
+			names = dl_array(&hits[k]);
+			n     = dl_size(&hits[k]);
+		}
+
+		if (n == 0)
+		{
+			char *ptr, *rem;
+
+			/* nothing matched; pass the path on without its escapes */
+
 			dstr_shrink(&new, len);
-			if (dstr_append(&new, rem, -1) == -1)
+			if (dstr_append(&new, alts[k], -1) == -1 ||
+				(next && (dstr_append(&new, ":", 1) == -1 ||
+						  dstr_append(&new, next, -1) == -1)))
+			{
 				result = -1;
-			else
+				break;
+			}
+
+			for (rem = dstr_string(&new) + len, ptr = rem; *rem; ++rem, ++ptr)
 			{
-				char *ptr, *rem;
+				if (*rem == '\\')
+					++rem;
 
-				for (rem = dstr_string(&new) + len, ptr = rem; *rem; ++rem, ++ptr)
-				{
-					if (*rem == '\\')
-						++rem;
+				*ptr = *rem;
+			}
+			*ptr = 0;
 
-					*ptr = *rem;
-				}
-				*ptr = 0;
+			result = dl_append(list, dstr_string(&new));
+			continue;
+		}
 
+		for (i = 0; i < n && result == 0; ++i)
+		{
+			dstr_shrink(&new, len);
+			if (dstr_append(&new, names[i], -1) == -1)
+				result = -1;
+			else if (next == 0)
 				result = dl_append(list, dstr_string(&new));
-			}
+			else if (dstr_append(&new, ":", 1) == -1)
+				result = -1;
+			else
+				result = doglob(vol, list, dstr_string(&new), next);
 		}
+	}
 
-		dstr_free(&pat);
-		dstr_free(&new);
+	for (k = 0; k < nalts; ++k)
+	{
+		if (pats[k])
+			glob_free(pats[k]);
 
-		return result;
+		dl_free(&hits[k]);
 	}
 
-	if (dstr_append(&new, rem, ptr - rem) == -1)
-		result = -1;
+	free(pats);
+	free(hits);
+	dstr_free(&new);
+
+	return result;
+}
+
+/*
+ * NAME:	doglob()
+ * DESCRIPTION:	perform recursive depth-first traversal of path to be globbed
+ */
+static
+int doglob(hfsvol *vol, dlist *list, const char *dir, const char *rem)
+{
+	dstring comp;
+	dlist alts;
+	const char *ptr;
+	int brace = 0, i, result;
+
+	for (ptr = rem; *ptr && *ptr != ':'; ++ptr)
+	{
+		if (*ptr == '\\' && ptr[1])
+			++ptr;
+		else if (*ptr == '{')
+			brace = 1;
+	}
+
+	dstr_init(&comp);
+
+	if (dl_init(&alts) == -1 ||
+			dstr_append(&comp, rem, ptr - rem) == -1)
+	{
+		dl_free(&alts);
+		dstr_free(&comp);
+		return -1;
+	}
+
+	if (brace)
+		result = expand(&alts, dstr_string(&comp));
 	else
+		result = dl_append(&alts, dstr_string(&comp));
+
+	if (result == 0)
 	{
-		if (*ptr)
-		{
-			if (dstr_append(&new, ":", 1) == -1)
-				result = -1;
-			else
-				result = doglob(vol, list, dstr_string(&new), ptr + 1);
+		result = globdir(vol, list, dir, dl_array(&alts), dl_size(&alts),
+			*ptr ? ptr + 1 : 0);
+	}
+	else if (result == 1)
+	{
+		/* a brace group spans components; expand the whole path instead */
 
-			dstr_free(&new);
-			return result;
-		}
+		dl_free(&alts);
 
-		result = dl_append(list, dstr_string(&new));
+		if (dl_init(&alts) == -1)
+			result = -1;
+		else if ((result = expand(&alts, rem)) == 0)
+		{
+			for (i = 0; i < dl_size(&alts) && result == 0; ++i)
+				result = doglob(vol, list, dir, dl_array(&alts)[i]);
+		}
+		else
+			result = -1;
 	}
 
-	dstr_free(&new);
+	dl_free(&alts);
+	dstr_free(&comp);
+
 	return result;
 }
 
@@ -17,5 +17,11 @@
  * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 
+typedef struct globpat globpat;
+
+globpat *glob_compile(const char *);
+int glob_match(const globpat *, const char *);
+void glob_free(globpat *);
+
 char **hfs_glob(hfsvol *, int, char *[], int *);
 char **hfs_glob_w(hfsvol *vol, int argc, wchar_t *argv[], int *nelts);
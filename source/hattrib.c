@@ -26,6 +26,7 @@
 # include "hfsutil.h"
 # include "hattrib.h"
 # include "charset.h"
+# include "output.h"
 
 /*
  * NAME:	usage()
@@ -35,7 +36,7 @@ static
 int usage(void)
 {
 	fwprintf(stderr,
-		L"Usage: attrib [-t TYPE] [-c CREA] [-|+i] [-|+l] hfs-path [...]\n"
+		L"Usage: attrib [-t TYPE] [-c CREA] [-|+i] [-|+l] [-J|-0] hfs-path [...]\n"
 		L"			 attrib -b hfs-path\n");
 
 	return 1;
@@ -48,7 +49,7 @@ int usage(void)
 int hattrib_main(int argc, wchar_t *argv[])
 {
 	const wchar_t *type = 0, *crea = 0;
-	int invis = 0, lock = 0, bless = 0;
+	int invis = 0, lock = 0, bless = 0, fmt = OUT_TEXT, update;
 	hfsvol *vol;
 	int fargc;
 	char **fargv;
@@ -99,6 +100,14 @@ int hattrib_main(int argc, wchar_t *argv[])
 				bless = 1;
 				continue;
 
+			case L'J':
+				fmt = OUT_JSON;
+				continue;
+
+			case L'0':
+				fmt = OUT_NUL;
+				continue;
+
 			default:
 				return usage();
 			}
@@ -132,9 +141,11 @@ int hattrib_main(int argc, wchar_t *argv[])
 		return 1;
 	}
 
-	if (bless && (lock || invis || type || crea || argc - i > 1))
+	if (bless && (lock || invis || type || crea || fmt || argc - i > 1))
 		return usage();
 
+	update = (type || crea || invis || lock);
+
 	vol = hfsutil_remount(hcwd_getvol(-1), HFS_MODE_ANY);
 	if (vol == 0)
 		return 1;
@@ -206,11 +217,13 @@ int hattrib_main(int argc, wchar_t *argv[])
 					else if (lock > 0)
 						ent.flags |= HFS_ISLOCKED;
 
-					if (hfs_setattr(vol, fargv[i], &ent) == -1)
+					if (update && hfs_setattr(vol, fargv[i], &ent) == -1)
 					{
 						hfsutil_perrorp(fargv[i]);
 						result = 1;
 					}
+					else if (fmt != OUT_TEXT)
+						out_dirent(fmt, fargv[i], &ent);
 				}
 			}
 		}
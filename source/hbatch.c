@@ -0,0 +1,193 @@
+/*
+ * hfsutils - tools for reading and writing Macintosh HFS volumes
+ * Copyright (C) 1996-1998 Robert Leslie
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+# include <stdio.h>
+# include <stdlib.h>
+# include <string.h>
+# include <io.h>
+# include <fcntl.h>
+
+# include "hfs.h"
+# include "hcwd.h"
+# include "hfsutil.h"
+# include "hbatch.h"
+# include "getopt.h"
+
+# define MAXLINE	4096
+# define MAXARGS	256
+
+/*
+ * NAME:	splitline()
+ * DESCRIPTION:	break a script line into arguments; return count or -1
+ */
+static
+int splitline(wchar_t *line, wchar_t *argv[], int max)
+{
+	wchar_t *in = line, *out;
+	int argc = 0;
+
+	while (1)
+	{
+		while (*in == L' ' || *in == L'\t' || *in == L'\r' || *in == L'\n')
+			++in;
+
+		if (*in == 0 || (argc == 0 && *in == L'#'))
+			break;
+
+		if (argc == max)
+			return -1;
+
+		/* arguments may be double-quoted; quotes are removed */
+
+		argv[argc++] = out = in;
+
+		while (*in && *in != L' ' && *in != L'\t' && *in != L'\r' && *in != L'\n')
+		{
+			if (*in == L'"')
+			{
+				for (++in; *in && *in != L'"'; )
+					*out++ = *in++;
+
+				if (*in == 0)
+					return -1;
+
+				++in;
+			}
+			else
+				*out++ = *in++;
+		}
+
+		if (*in)
+			++in;
+
+		*out = 0;
+	}
+
+	return argc;
+}
+
+/*
+ * NAME:	usage()
+ * DESCRIPTION:	display usage message
+ */
+static
+int usage(void)
+{
+	fwprintf(stderr, L"Usage: batch [-e] [script-file]\n");
+	return 1;
+}
+
+/*
+ * NAME:	hbatch->main()
+ * DESCRIPTION:	implement hbatch command
+ */
+int hbatch_main(int argc, wchar_t *argv[])
+{
+	FILE *script;
+	wchar_t line[MAXLINE], *args[MAXARGS + 2];
+	int nargs, lineno = 0, stop = 0, result = 0;
+
+	optind = 2;
+
+	while (1)
+	{
+		int opt;
+
+		opt = getopt(argc, argv, L"e?");
+		if (opt == EOF)
+			break;
+
+		switch (opt)
+		{
+			case 'e':
+				stop = 1;
+				break;
+
+			case '?':
+				return usage();
+		}
+	}
+
+	if (argc - optind > 1)
+		return usage();
+
+	if (argc - optind == 1 && wcscmp(argv[optind], L"-") != 0)
+	{
+		script = _wfopen(argv[optind], L"r, ccs=UTF-8");
+		if (script == 0)
+		{
+			_wperror(argv[optind]);
+			return 1;
+		}
+	}
+	else
+	{
+		script = stdin;
+		_setmode(_fileno(stdin), _O_U8TEXT);
+	}
+
+	hfsutil_session(1);
+
+	while (fgetws(line, MAXLINE, script))
+	{
+		const wchar_t *op;
+
+		++lineno;
+
+		if (wcslen(line) == MAXLINE - 1 && line[MAXLINE - 2] != L'\n')
+		{
+			fwprintf(stderr, L"%s: line %d: line too long\n", bargv0, lineno);
+			result = 1;
+			break;
+		}
+
+		nargs = splitline(line, args + 1, MAXARGS);
+		if (nargs == -1)
+		{
+			fwprintf(stderr, L"%s: line %d: bad quoting or too many arguments\n",
+				bargv0, lineno);
+			result = 1;
+		}
+		else if (nargs > 0)
+		{
+			op = bargv0;
+
+			args[0]         = argv[0];
+			args[nargs + 1] = 0;
+
+			if (hfsutil_run(nargs + 1, args) != 0)
+				result = 1;
+
+			bargv0 = op;
+		}
+
+		if (result && stop)
+			break;
+	}
+
+	/* unmounting the held volume flushes all changes at once */
+
+	if (hfsutil_session(0) == -1)
+		result = 1;
+
+	if (script != stdin)
+		fclose(script);
+
+	return result;
+}
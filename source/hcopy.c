@@ -23,10 +23,12 @@
 # include <string.h>
 # include <errno.h>
 # include <sys/stat.h>
+# include <windows.h>
 
 # include "hfs.h"
 # include "hcwd.h"
 # include "hfsutil.h"
+# include "darray.h"
 # include "hcopy.h"
 # include "copyin.h"
 # include "copyout.h"
@@ -34,6 +36,25 @@
 # include "charset.h"
 # include "getopt.h"
 
+# define HCOPY_DIRENTS	64	/* catalog records read per call */
+
+enum {
+	T_UNSEEN,		/* not yet placed */
+	T_INSIDE,		/* in the tree being copied */
+	T_OUTSIDE,		/* elsewhere on the volume */
+	T_FAILED		/* in the tree, but couldn't be made */
+};
+
+typedef struct {
+	unsigned long cnid;		/* folder ID */
+	unsigned long parid;		/* parent folder ID */
+	long parent;			/* index of parent, or -1 */
+	int state;			/* T_UNSEEN, T_INSIDE, ... */
+	char *hfspath;			/* path of the folder, once inside */
+	wchar_t *unixpath;		/* path of its copy, once inside */
+	char name[HFS_MAX_FLEN + 1];
+} treedir;
+
 /*
  * NAME: automode_unix()
  * DESCRIPTION: automatically choose copyin transfer mode for UNIX path
@@ -41,6 +62,8 @@
 static
 cpifunc automode_unix(const wchar_t *path)
 {
+	struct _stat64i32 sbuf;
+	wchar_t *side;
 	int i;
 	struct {
 		const wchar_t *ext;
@@ -48,6 +71,7 @@ cpifunc automode_unix(const wchar_t *path)
 	} exts[] = {
 		{ L".bin",  cpi_macb },
 		{ L".hqx",  cpi_binh },
+		{ L".as",   cpi_asgl },
 
 		{ L".txt",  cpi_text },
 		{ L".c",    cpi_text },
@@ -59,6 +83,18 @@ cpifunc automode_unix(const wchar_t *path)
 		{ 0, 0 }
 	};
 
+	/* a file with an AppleDouble header beside it keeps its metadata */
+
+	side = cpi_sidecar(path);
+	if (side)
+	{
+		i = _wstat(side, &sbuf);
+		free(side);
+
+		if (i != -1 && ! S_ISDIR(sbuf.st_mode))
+			return cpi_adbl;
+	}
+
 	path += wcslen(path);
 
 	for (i = 0; exts[i].ext; ++i)
@@ -108,6 +144,14 @@ int do_copyin(hfsvol *vol, int argc, wchar_t *argv[], const char *dest, int mode
 		case 'r':
 			copyfile = cpi_raw;
 			break;
+
+		case 'd':
+			copyfile = cpi_adbl;
+			break;
+
+		case 's':
+			copyfile = cpi_asgl;
+			break;
 	}
 
 	for (i = 0; i < argc; ++i)
@@ -137,6 +181,414 @@ int do_copyin(hfsvol *vol, int argc, wchar_t *argv[], const char *dest, int mode
 	return result;
 }
 
+/*
+ * NAME: hfscat()
+ * DESCRIPTION: return a new HFS path from a folder path and a MacRoman name
+ */
+static
+char *hfscat(const char *dir, const char *name)
+{
+	char *path;
+	size_t len;
+
+	len  = strlen(dir);
+	path = malloc(len + strlen(name) + 2);
+	if (path == 0)
+		return 0;
+
+	strcpy(path, dir);
+
+	if (len == 0 || dir[len - 1] != ':')
+		strcat(path, ":");
+
+	strcat(path, name);
+
+	return path;
+}
+
+/*
+ * NAME: hfsjoin()
+ * DESCRIPTION: return a new HFS path naming an entry within a folder
+ */
+static
+char *hfsjoin(const char *dir, const wchar_t *name)
+{
+	char *macroman, *path;
+
+	macroman = utf16ToMacRoman(name);
+	if (macroman == 0)
+		return 0;
+
+	if (strlen(macroman) > HFS_MAX_FLEN)
+		macroman[HFS_MAX_FLEN] = 0;
+
+	path = hfscat(dir, macroman);
+
+	free(macroman);
+
+	return path;
+}
+
+/*
+ * NAME: unixjoin()
+ * DESCRIPTION: return a new UNIX path naming an entry within a directory
+ */
+static
+wchar_t *unixjoin(const wchar_t *dir, const wchar_t *name)
+{
+	wchar_t *path;
+	size_t len;
+
+	len  = wcslen(dir);
+	path = malloc((len + wcslen(name) + 2) * sizeof(wchar_t));
+	if (path == 0)
+		return 0;
+
+	wcscpy(path, dir);
+
+	if (len > 0 && dir[len - 1] != L'\\' && dir[len - 1] != L'/')
+		wcscat(path, L"\\");
+
+	wcscat(path, name);
+
+	return path;
+}
+
+/*
+ * NAME: isheader()
+ * DESCRIPTION: tell whether a UNIX file is the AppleDouble header of another
+ */
+static
+int isheader(const wchar_t *dir, const wchar_t *name)
+{
+	struct _stat64i32 sbuf;
+	wchar_t *path;
+	int result;
+
+	if (wcsncmp(name, L"._", 2) != 0 || name[2] == 0)
+		return 0;
+
+	path = unixjoin(dir, name + 2);
+	if (path == 0)
+		return 0;
+
+	result = (_wstat(path, &sbuf) != -1 && ! S_ISDIR(sbuf.st_mode));
+	free(path);
+
+	return result;
+}
+
+/*
+ * NAME: addtree()
+ * DESCRIPTION: create HFS folders for a UNIX tree and queue its files
+ */
+static
+int addtree(hfsvol *vol, darray *jobs, const wchar_t *src, const char *dst,
+	cpifunc copyfile)
+{
+	struct _stat64i32 sbuf;
+	WIN32_FIND_DATAW find;
+	HANDLE handle;
+	hfsdirent ent;
+	cpijob job;
+	wchar_t *pattern, *subsrc;
+	char *subdst;
+	int result = 0;
+
+	if (_wstat(src, &sbuf) == -1)
+	{
+		__ERROR(errno, 0);
+		hfsutil_perrorp_w(src);
+
+		return 1;
+	}
+
+	if (! S_ISDIR(sbuf.st_mode))
+	{
+		job.src      = _wcsdup(src);
+		job.dst      = _strdup(dst);
+		job.copyfile = copyfile ? copyfile : automode_unix(src);
+		job.error    = 0;
+		job.errstr   = 0;
+
+		/* raw copies go through the read-ahead pipeline */
+
+		if (job.copyfile == cpi_raw)
+			job.copyfile = 0;
+
+		if (job.src == 0 || job.dst == 0 || darr_append(jobs, &job) == 0)
+		{
+			free(job.src);
+			free(job.dst);
+
+			__ERROR(ENOMEM, 0);
+			hfsutil_perrorp_w(src);
+
+			return 1;
+		}
+
+		return 0;
+	}
+
+	if (hfs_stat(vol, dst, &ent) == -1)
+	{
+		if (hfs_mkdir(vol, dst) == -1)
+		{
+			hfsutil_perrorp(dst);
+			return 1;
+		}
+	}
+	else if (! (ent.flags & HFS_ISDIR))
+	{
+		__ERROR(ENOTDIR, 0);
+		hfsutil_perrorp(dst);
+
+		return 1;
+	}
+
+	pattern = unixjoin(src, L"*");
+	if (pattern == 0)
+	{
+		__ERROR(ENOMEM, 0);
+		hfsutil_perrorp_w(src);
+
+		return 1;
+	}
+
+	handle = FindFirstFileW(pattern, &find);
+	free(pattern);
+
+	if (handle == INVALID_HANDLE_VALUE)
+	{
+		switch (GetLastError())
+		{
+			case ERROR_FILE_NOT_FOUND:	/* nothing in it */
+				return 0;
+
+			case ERROR_ACCESS_DENIED:
+				__ERROR(EACCES, 0);
+				break;
+
+			case ERROR_PATH_NOT_FOUND:
+				__ERROR(ENOENT, 0);
+				break;
+
+			case ERROR_DIRECTORY:
+				__ERROR(ENOTDIR, 0);
+				break;
+
+			case ERROR_NOT_ENOUGH_MEMORY:
+				__ERROR(ENOMEM, 0);
+				break;
+
+			default:
+				__ERROR(EIO, 0);
+				break;
+		}
+
+		hfsutil_perrorp_w(src);
+
+		return 1;
+	}
+
+	do
+	{
+		if (wcscmp(find.cFileName, L".") == 0 ||
+			wcscmp(find.cFileName, L"..") == 0)
+			continue;
+
+		/* AppleDouble header files travel with the file they describe */
+
+		if ((copyfile == 0 || copyfile == cpi_adbl) &&
+			isheader(src, find.cFileName))
+			continue;
+
+		/* don't follow junctions out of (or back into) the tree */
+
+		if ((find.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) &&
+			(find.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT))
+			continue;
+
+		subsrc = unixjoin(src, find.cFileName);
+		subdst = hfsjoin(dst, find.cFileName);
+
+		if (subsrc == 0 || subdst == 0)
+		{
+			__ERROR(ENOMEM, 0);
+			hfsutil_perrorp_w(src);
+
+			result = 1;
+		}
+		else if (addtree(vol, jobs, subsrc, subdst, copyfile))
+			result = 1;
+
+		free(subsrc);
+		free(subdst);
+	}
+	while (FindNextFileW(handle, &find));
+
+	FindClose(handle);
+
+	return result;
+}
+
+/*
+ * NAME: do_copyin_tree()
+ * DESCRIPTION: recursively copy files and directories from UNIX to HFS
+ */
+static
+int do_copyin_tree(hfsvol *vol, int argc, wchar_t *argv[], const char *dest, int mode)
+{
+	hfsdirent ent;
+	darray *jobs;
+	cpijob *job;
+	cpifunc copyfile = 0;
+	wchar_t *full, *name;
+	char *dst;
+	int isdir, n, i, result = 0;
+
+	isdir = (hfs_stat(vol, dest, &ent) != -1 && (ent.flags & HFS_ISDIR));
+
+	if (argc > 1 && ! isdir)
+	{
+		__ERROR(ENOTDIR, 0);
+		hfsutil_perrorp(dest);
+
+		return 1;
+	}
+
+	switch (mode)
+	{
+		case 'm':
+			copyfile = cpi_macb;
+			break;
+
+		case 'b':
+			copyfile = cpi_binh;
+			break;
+
+		case 't':
+			copyfile = cpi_text;
+			break;
+
+		case 'r':
+			copyfile = cpi_raw;
+			break;
+
+		case 'd':
+			copyfile = cpi_adbl;
+			break;
+
+		case 's':
+			copyfile = cpi_asgl;
+			break;
+	}
+
+	jobs = darr_new(sizeof(cpijob));
+	if (jobs == 0)
+	{
+		__ERROR(ENOMEM, 0);
+		hfsutil_perrorp(dest);
+
+		return 1;
+	}
+
+	/* make folders as the trees are walked; files are copied afterward */
+
+	for (i = 0; i < argc; ++i)
+	{
+		if (! isdir)
+			dst = _strdup(dest);
+		else
+		{
+			/* name the copy after the last component of the full path */
+
+			full = _wfullpath(0, argv[i], 0);
+			if (full == 0)
+				dst = 0;
+			else
+			{
+				n = (int) wcslen(full);
+				while (n > 0 && (full[n - 1] == L'\\' || full[n - 1] == L'/'))
+					full[--n] = 0;
+
+				for (name = full + n; name > full &&
+					name[-1] != L'\\' && name[-1] != L'/' && name[-1] != L':'; --name)
+					;
+
+				dst = *name ? hfsjoin(dest, name) : _strdup(dest);
+				free(full);
+			}
+		}
+
+		if (dst == 0)
+		{
+			__ERROR(ENOMEM, 0);
+			hfsutil_perrorp_w(argv[i]);
+
+			result = 1;
+			continue;
+		}
+
+		if (addtree(vol, jobs, argv[i], dst, copyfile))
+			result = 1;
+
+		free(dst);
+	}
+
+	job = darr_array(jobs);
+	n   = darr_size(jobs);
+
+	if (cpi_batch(vol, job, n) == -1)
+	{
+		result = 1;
+
+		/* failures of the batch itself aren't charged to any one file */
+
+		for (i = 0; i < n && job[i].error == 0; ++i)
+			;
+
+		if (i == n)
+		{
+			__ERROR(errno, cpi_error);
+			hfsutil_perrorp(dest);
+		}
+	}
+
+	for (i = 0; i < n; ++i)
+	{
+		if (job[i].error)
+		{
+			__ERROR(job[i].error, job[i].errstr);
+			hfsutil_perrorp_w(job[i].src);
+
+			result = 1;
+		}
+
+		free(job[i].src);
+		free(job[i].dst);
+	}
+
+	darr_free(jobs);
+
+	return result;
+}
+
+/*
+ * NAME: automode_ent()
+ * DESCRIPTION: automatically choose copyout transfer mode for an HFS file
+ */
+static
+cpofunc automode_ent(const hfsdirent *ent)
+{
+	if (strcmp(ent->u.file.type, "TEXT") == 0 || strcmp(ent->u.file.type, "ttro") == 0)
+		return cpo_text;
+	else if (ent->u.file.rsize == 0)
+		return cpo_raw;
+
+	return cpo_macb;
+}
+
 /*
  * NAME: automode_hfs()
  * DESCRIPTION: automatically choose copyout transfer mode for HFS path
@@ -147,12 +599,7 @@ cpofunc automode_hfs(hfsvol *vol, const char *path)
 	hfsdirent ent;
 
 	if (hfs_stat(vol, path, &ent) != -1)
-	{
-		if (strcmp(ent.u.file.type, "TEXT") == 0 || strcmp(ent.u.file.type, "ttro") == 0)
-			return cpo_text;
-		else if (ent.u.file.rsize == 0)
-			return cpo_raw;
-	}
+		return automode_ent(&ent);
 
 	return cpo_macb;
 }
@@ -194,6 +641,14 @@ int do_copyout(hfsvol *vol, int argc, char *argv[], const wchar_t *dest, int mod
 		case 'r':
 			copyfile = cpo_raw;
 			break;
+
+		case 'd':
+			copyfile = cpo_adbl;
+			break;
+
+		case 's':
+			copyfile = cpo_asgl;
+			break;
 	}
 
 	for (i = 0; i < argc; ++i)
@@ -224,6 +679,468 @@ int do_copyout(hfsvol *vol, int argc, char *argv[], const wchar_t *dest, int mod
 	return result;
 }
 
+/*
+ * NAME: unixname()
+ * DESCRIPTION: return a new UNIX file name for an HFS file or folder name
+ */
+static
+wchar_t *unixname(const char *name, cpofunc copyfile)
+{
+	char buf[HFS_MAX_FLEN + 4 + 1], *ptr;
+
+	strcpy(buf, name);
+
+	/* keep the translations of a single copy; other characters Windows won't take */
+
+	for (ptr = buf; *ptr; ++ptr)
+	{
+		if (*ptr == ' ')
+			*ptr = '_';
+		else if ((unsigned char) *ptr < 0x20 || strchr("/\\:*?\"<>|", *ptr))
+			*ptr = '-';
+	}
+
+	if (copyfile == cpo_macb)
+		strcat(buf, ".bin");
+	else if (copyfile == cpo_binh)
+		strcat(buf, ".hqx");
+	else if (copyfile == cpo_asgl)
+		strcat(buf, ".as");
+	else if (copyfile == cpo_text && strchr(buf, '.') == 0)
+		strcat(buf, ".txt");
+
+	return macRomanToUtf16(buf);
+}
+
+/*
+ * NAME: unixfile()
+ * DESCRIPTION: return a new UNIX path for an HFS entry within a directory
+ */
+static
+wchar_t *unixfile(const wchar_t *dir, const char *name, cpofunc copyfile)
+{
+	wchar_t *uname, *path;
+
+	uname = unixname(name, copyfile);
+	if (uname == 0)
+		return 0;
+
+	path = unixjoin(dir, uname);
+	free(uname);
+
+	return path;
+}
+
+/*
+ * NAME: compare_dirs()
+ * DESCRIPTION: order folders by ID
+ */
+static
+int compare_dirs(const treedir *dir1, const treedir *dir2)
+{
+	return (dir1->cnid > dir2->cnid) - (dir1->cnid < dir2->cnid);
+}
+
+/*
+ * NAME: finddir()
+ * DESCRIPTION: locate a folder by ID; return its index or -1
+ */
+static
+long finddir(treedir *dirs, unsigned int ndirs, unsigned long cnid)
+{
+	treedir key, *dir;
+
+	key.cnid = cnid;
+
+	dir = bsearch(&key, dirs, ndirs, sizeof(treedir),
+		(int (*)(const void *, const void *)) compare_dirs);
+
+	return dir ? (long) (dir - dirs) : -1;
+}
+
+/*
+ * NAME: scancat()
+ * DESCRIPTION: collect every folder and file of the volume in one pass
+ */
+static
+int scancat(hfsvol *vol, darray *dirs, darray *files)
+{
+	hfsdir *cat;
+	hfsdirent ents[HCOPY_DIRENTS];
+	treedir dir;
+	int count, i;
+
+	cat = hfs_opencat(vol);
+	if (cat == 0)
+		return -1;
+
+	while ((count = hfs_readdir_many(cat, ents, HCOPY_DIRENTS)) > 0)
+	{
+		for (i = 0; i < count; ++i)
+		{
+			if (ents[i].flags & HFS_ISDIR)
+			{
+				memset(&dir, 0, sizeof(dir));
+
+				dir.cnid   = ents[i].cnid;
+				dir.parid  = ents[i].parid;
+				dir.parent = -1;
+				strcpy(dir.name, ents[i].name);
+
+				if (darr_append(dirs, &dir) == 0)
+					goto nomem;
+			}
+			else if (darr_append(files, &ents[i]) == 0)
+				goto nomem;
+		}
+	}
+
+	if (count == -1)
+		goto fail;
+
+	hfs_closedir(cat);
+
+	return 0;
+
+nomem:
+	__ERROR(ENOMEM, 0);
+
+fail:
+	hfs_closedir(cat);
+	return -1;
+}
+
+/*
+ * NAME: placedir()
+ * DESCRIPTION: decide whether a folder is in the tree being copied, making
+ *		its UNIX directory if so
+ */
+static
+int placedir(treedir *dirs, long n)
+{
+	treedir *dir = &dirs[n], *parent;
+	int state;
+
+	if (dir->state != T_UNSEEN)
+		return dir->state;
+
+	/* a damaged catalog might link folders in a cycle */
+
+	dir->state = T_OUTSIDE;
+
+	if (dir->parent == -1)
+		return T_OUTSIDE;
+
+	/* below a folder that couldn't be made, this one fails too (silently) */
+
+	state = placedir(dirs, dir->parent);
+	if (state != T_INSIDE)
+		return dir->state = state;
+
+	parent = &dirs[dir->parent];
+
+	dir->hfspath  = hfscat(parent->hfspath, dir->name);
+	dir->unixpath = unixfile(parent->unixpath, dir->name, 0);
+
+	if (dir->hfspath == 0 || dir->unixpath == 0)
+	{
+		__ERROR(ENOMEM, 0);
+		hfsutil_perrorp(parent->hfspath);
+
+		return dir->state = T_FAILED;
+	}
+
+	if (_wmkdir(dir->unixpath) == -1 && errno != EEXIST)
+	{
+		__ERROR(errno, 0);
+		hfsutil_perrorp_w(dir->unixpath);
+
+		return dir->state = T_FAILED;
+	}
+
+	return dir->state = T_INSIDE;
+}
+
+/*
+ * NAME: addjob()
+ * DESCRIPTION: queue a file to be copied out; the job takes over the paths
+ */
+static
+int addjob(darray *jobs, char *src, wchar_t *dst, cpofunc copyfile)
+{
+	cpojob job;
+
+	memset(&job, 0, sizeof(job));
+
+	job.src      = src;
+	job.dst      = dst;
+	job.copyfile = copyfile;
+
+	if (src == 0 || dst == 0 || darr_append(jobs, &job) == 0)
+	{
+		free(src);
+		free(dst);
+
+		__ERROR(ENOMEM, 0);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * NAME: do_copyout_tree()
+ * DESCRIPTION: recursively copy files and folders from HFS to UNIX
+ */
+static
+int do_copyout_tree(hfsvol *vol, int argc, char *argv[], const wchar_t *dest, int mode)
+{
+	struct _stat64i32 sbuf;
+	hfsdirent ent, *files = 0;
+	darray *dirarr = 0, *filearr = 0, *jobs;
+	treedir *dirs = 0;
+	cpojob *job;
+	cpofunc copyfile = 0, f;
+	wchar_t *top;
+	unsigned int ndirs = 0, nfiles = 0, j;
+	long n;
+	int isdir, i, result = 0;
+
+	isdir = (_wstat(dest, &sbuf) != -1 && S_ISDIR(sbuf.st_mode));
+
+	if (argc > 1 && ! isdir)
+	{
+		__ERROR(ENOTDIR, 0);
+		hfsutil_perrorp_w(dest);
+
+		return 1;
+	}
+
+	switch (mode)
+	{
+		case 'm':
+			copyfile = cpo_macb;
+			break;
+
+		case 'b':
+			copyfile = cpo_binh;
+			break;
+
+		case 't':
+			copyfile = cpo_text;
+			break;
+
+		case 'r':
+			copyfile = cpo_raw;
+			break;
+
+		case 'd':
+			copyfile = cpo_adbl;
+			break;
+
+		case 's':
+			copyfile = cpo_asgl;
+			break;
+	}
+
+	jobs = darr_new(sizeof(cpojob));
+	if (jobs == 0)
+	{
+		__ERROR(ENOMEM, 0);
+		hfsutil_perrorp_w(dest);
+
+		return 1;
+	}
+
+	for (i = 0; i < argc; ++i)
+	{
+		if (hfs_stat(vol, argv[i], &ent) == -1)
+		{
+			hfsutil_perrorp(argv[i]);
+
+			result = 1;
+			continue;
+		}
+
+		if (! (ent.flags & HFS_ISDIR))
+		{
+			f = copyfile ? copyfile : automode_ent(&ent);
+
+			if (addjob(jobs, _strdup(argv[i]),
+				isdir ? unixfile(dest, ent.name, f) : _wcsdup(dest), f) == -1)
+			{
+				hfsutil_perrorp(argv[i]);
+				result = 1;
+			}
+
+			continue;
+		}
+
+		/* read the whole catalog once, on the first folder to copy */
+
+		if (dirarr == 0)
+		{
+			dirarr  = darr_new(sizeof(treedir));
+			filearr = darr_new(sizeof(hfsdirent));
+
+			if (dirarr == 0 || filearr == 0)
+			{
+				__ERROR(ENOMEM, 0);
+				hfsutil_perrorp(argv[i]);
+
+				result = 1;
+				break;
+			}
+
+			if (scancat(vol, dirarr, filearr) == -1)
+			{
+				hfsutil_perrorp(argv[i]);
+
+				result = 1;
+				break;
+			}
+
+			darr_sort(dirarr, (int (*)(const void *, const void *)) compare_dirs);
+
+			dirs   = darr_array(dirarr);
+			ndirs  = darr_size(dirarr);
+			files  = darr_array(filearr);
+			nfiles = darr_size(filearr);
+
+			for (j = 0; j < ndirs; ++j)
+				dirs[j].parent = finddir(dirs, ndirs, dirs[j].parid);
+		}
+
+		n = finddir(dirs, ndirs, ent.cnid);
+		if (n == -1)
+		{
+			__ERROR(ENOENT, 0);
+			hfsutil_perrorp(argv[i]);
+
+			result = 1;
+			continue;
+		}
+
+		top = isdir ? unixfile(dest, ent.name, 0) : _wcsdup(dest);
+
+		if (top == 0)
+		{
+			__ERROR(ENOMEM, 0);
+			hfsutil_perrorp(argv[i]);
+
+			result = 1;
+			continue;
+		}
+
+		if (_wmkdir(top) == -1 && errno != EEXIST)
+		{
+			__ERROR(errno, 0);
+			hfsutil_perrorp_w(top);
+
+			free(top);
+
+			result = 1;
+			continue;
+		}
+
+		for (j = 0; j < ndirs; ++j)
+		{
+			free(dirs[j].hfspath);
+			free(dirs[j].unixpath);
+
+			dirs[j].hfspath  = 0;
+			dirs[j].unixpath = 0;
+			dirs[j].state    = T_UNSEEN;
+		}
+
+		dirs[n].hfspath  = _strdup(argv[i]);
+		dirs[n].unixpath = top;
+		dirs[n].state    = T_INSIDE;
+
+		if (dirs[n].hfspath == 0)
+		{
+			__ERROR(ENOMEM, 0);
+			hfsutil_perrorp(argv[i]);
+
+			result = 1;
+			continue;
+		}
+
+		/* make the directories of the tree, then queue its files */
+
+		for (j = 0; j < ndirs; ++j)
+		{
+			if (placedir(dirs, j) == T_FAILED)
+				result = 1;
+		}
+
+		for (j = 0; j < nfiles; ++j)
+		{
+			n = finddir(dirs, ndirs, files[j].parid);
+			if (n == -1 || dirs[n].state != T_INSIDE)
+				continue;
+
+			f = copyfile ? copyfile : automode_ent(&files[j]);
+
+			if (addjob(jobs, hfscat(dirs[n].hfspath, files[j].name),
+				unixfile(dirs[n].unixpath, files[j].name, f), f) == -1)
+			{
+				hfsutil_perrorp(dirs[n].hfspath);
+				result = 1;
+			}
+		}
+	}
+
+	job = darr_array(jobs);
+	n   = darr_size(jobs);
+
+	if (cpo_batch(vol, job, n) == -1)
+	{
+		result = 1;
+
+		/* failures of the batch itself aren't charged to any one file */
+
+		for (i = 0; i < n && job[i].error == 0; ++i)
+			;
+
+		if (i == n)
+		{
+			__ERROR(errno, cpo_error);
+			hfsutil_perrorp_w(dest);
+		}
+	}
+
+	for (i = 0; i < n; ++i)
+	{
+		if (job[i].error)
+		{
+			__ERROR(job[i].error, job[i].errstr);
+			hfsutil_perrorp(job[i].src);
+
+			result = 1;
+		}
+
+		free(job[i].src);
+		free(job[i].dst);
+	}
+
+	for (j = 0; j < ndirs; ++j)
+	{
+		free(dirs[j].hfspath);
+		free(dirs[j].unixpath);
+	}
+
+	if (dirarr)
+		darr_free(dirarr);
+
+	if (filearr)
+		darr_free(filearr);
+
+	darr_free(jobs);
+
+	return result;
+}
+
 /*
  * NAME: usage()
  * DESCRIPTION: display usage message
@@ -231,7 +1148,7 @@ int do_copyout(hfsvol *vol, int argc, char *argv[], const wchar_t *dest, int mod
 static
 int usage(void)
 {
-	fwprintf(stderr, L"Usage: copy [-m|-b|-t|-r|-a] source-path [...] target-path\n");
+	fwprintf(stderr, L"Usage: copy [-R] [-m|-b|-t|-r|-d|-s|-a] source-path [...] target-path\n");
 	return 1;
 }
 
@@ -241,7 +1158,7 @@ int usage(void)
  */
 int hcopy_main(int argc, wchar_t *argv[])
 {
-	int nargs, mode = 'a', result = 0;
+	int nargs, mode = 'a', tree = 0, result = 0;
 	const wchar_t *target;
 	int fargc;
 	hfsvol *vol;
@@ -252,12 +1169,16 @@ int hcopy_main(int argc, wchar_t *argv[])
 	{
 		int opt;
 
-		opt = getopt(argc, argv, L"mbtra?");
+		opt = getopt(argc, argv, L"Rmbtrdsa?");
 		if (opt == EOF)
 			break;
 
 		switch (opt)
 		{
+			case 'R':
+				tree = 1;
+				break;
+
 			case '?':
 				return usage();
 			default:
@@ -288,7 +1209,10 @@ int hcopy_main(int argc, wchar_t *argv[])
 		target_macroman = utf16ToMacRoman(target);
 		if (target_macroman != 0)
 		{
-			result = do_copyin(vol, fargc, fargv, target_macroman, mode);
+			if (tree)
+				result = do_copyin_tree(vol, fargc, fargv, target_macroman, mode);
+			else
+				result = do_copyin(vol, fargc, fargv, target_macroman, mode);
 			free(target_macroman);
 		}
 		hfsutil_unmount(vol, &result);
@@ -301,13 +1225,16 @@ int hcopy_main(int argc, wchar_t *argv[])
 		// copy out
 		char **fargv;
 
+
 		vol = hfsutil_remount(hcwd_getvol(-1), HFS_MODE_RDONLY);
 		if (vol == 0)
 			return 1;
 
 		fargv = hfsutil_glob(vol, nargs - 1, &argv[optind], &fargc, &result);
 
-		if (result == 0)
+		if (result == 0 && tree)
+			result = do_copyout_tree(vol, fargc, fargv, target, mode);
+		else if (result == 0)
 			result = do_copyout(vol, fargc, fargv, target, mode);
 
 		hfsutil_unmount(vol, &result);
@@ -209,8 +209,17 @@ int hcwd_finish(void)
 		free(mounts);
 	}
 
+	mounts = 0;
+	mtabsz = nmounts = 0;
+	curvol = -1;
+
 	if (statef && fclose(statef) == EOF)
+	{
+		statef = 0;
 		return -1;
+	}
+
+	statef = 0;
 
 	return 0;
 }
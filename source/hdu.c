@@ -0,0 +1,534 @@
+/*
+ * hfsutils - tools for reading and writing Macintosh HFS volumes
+ * Copyright (C) 1996-1998 Robert Leslie
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+# include <unistd.h>
+# include <stdio.h>
+# include <stdlib.h>
+# include <string.h>
+# include <errno.h>
+
+# include "hfs.h"
+# include "hcwd.h"
+# include "hfsutil.h"
+# include "darray.h"
+# include "hdu.h"
+# include "charset.h"
+# include "getopt.h"
+
+# define HDU_DIRENTS	64	/* catalog records read per call */
+
+# define HDU_SUMMARY	0x0001
+# define HDU_BYSIZE	0x0002
+# define HDU_KBYTES	0x0004
+
+typedef struct {
+	unsigned long long lsize;	/* logical size of both forks */
+	unsigned long long psize;	/* allocated size of both forks */
+	unsigned long files;		/* number of files */
+	unsigned long dirs;		/* number of directories */
+} dutotal;
+
+typedef struct {
+	unsigned long cnid;		/* directory ID */
+	unsigned long parid;		/* parent directory ID */
+	long parent;			/* index of parent, or -1 */
+	int depth;			/* distance from the root */
+	char name[HFS_MAX_FLEN + 1];
+	char *path;
+	dutotal total;
+} dunode;
+
+typedef struct {
+	unsigned long parid;		/* directory the records belong to */
+	dutotal total;			/* its immediate contents */
+} dugroup;
+
+/*
+ * NAME:	usage()
+ * DESCRIPTION:	display usage message
+ */
+static
+int usage(void)
+{
+	fwprintf(stderr, L"Usage: du [-s] [-S] [-k] [hfs-path]\n");
+
+	return 1;
+}
+
+/*
+ * NAME:	compare_cnids()
+ * DESCRIPTION:	order directories by ID
+ */
+static
+int compare_cnids(const dunode *node1, const dunode *node2)
+{
+	return (node1->cnid > node2->cnid) - (node1->cnid < node2->cnid);
+}
+
+/*
+ * NAME:	compare_paths()
+ * DESCRIPTION:	order directories by path
+ */
+static
+int compare_paths(const dunode **node1, const dunode **node2)
+{
+	return strcasecmp((*node1)->path, (*node2)->path);
+}
+
+/*
+ * NAME:	compare_sizes()
+ * DESCRIPTION:	order directories by decreasing allocated size
+ */
+static
+int compare_sizes(const dunode **node1, const dunode **node2)
+{
+	return ((*node1)->total.psize < (*node2)->total.psize) -
+		((*node1)->total.psize > (*node2)->total.psize);
+}
+
+/*
+ * NAME:	find()
+ * DESCRIPTION:	locate a directory by ID; return its index or -1
+ */
+static
+long find(dunode *nodes, unsigned int nnodes, unsigned long cnid)
+{
+	dunode key, *node;
+
+	key.cnid = cnid;
+
+	node = bsearch(&key, nodes, nnodes, sizeof(dunode),
+		(int (*)(const void *, const void *)) compare_cnids);
+
+	return node ? (long) (node - nodes) : -1;
+}
+
+/*
+ * NAME:	add()
+ * DESCRIPTION:	accumulate totals
+ */
+static
+void add(dutotal *total, const dutotal *more)
+{
+	total->lsize += more->lsize;
+	total->psize += more->psize;
+	total->files += more->files;
+	total->dirs  += more->dirs;
+}
+
+/*
+ * NAME:	scan()
+ * DESCRIPTION:	collect every directory and the totals of its immediate contents
+ */
+static
+int scan(hfsvol *vol, darray *nodes, darray *groups)
+{
+	hfsdir *dir;
+	hfsdirent ents[HDU_DIRENTS];
+	hfspsize psizes[HDU_DIRENTS];
+	dugroup group;
+	dunode node;
+	int count, i;
+
+	dir = hfs_opencat(vol);
+	if (dir == 0)
+		return -1;
+
+	memset(&group, 0, sizeof(group));
+
+	/*
+	 * Records are ordered by parent ID, so the contents of each directory
+	 * are summed as they arrive and stored once per directory.
+	 */
+
+	while ((count = hfs_readdir_psize(dir, ents, psizes, HDU_DIRENTS)) > 0)
+	{
+		for (i = 0; i < count; ++i)
+		{
+			hfsdirent *ent = &ents[i];
+
+			if (ent->parid != group.parid)
+			{
+				if (group.parid && darr_append(groups, &group) == 0)
+					goto nomem;
+
+				memset(&group, 0, sizeof(group));
+				group.parid = ent->parid;
+			}
+
+			if (ent->flags & HFS_ISDIR)
+			{
+				node.cnid   = ent->cnid;
+				node.parid  = ent->parid;
+				node.parent = -1;
+				node.depth  = -1;
+				node.path   = 0;
+
+				strcpy(node.name, ent->name);
+				memset(&node.total, 0, sizeof(node.total));
+
+				if (darr_append(nodes, &node) == 0)
+					goto nomem;
+
+				++group.total.dirs;
+			}
+			else
+			{
+				group.total.lsize += ent->u.file.dsize + ent->u.file.rsize;
+				group.total.psize += psizes[i].dpsize + psizes[i].rpsize;
+
+				++group.total.files;
+			}
+		}
+	}
+
+	if (count == -1)
+		goto fail;
+
+	if (group.parid && darr_append(groups, &group) == 0)
+		goto nomem;
+
+	hfs_closedir(dir);
+
+	return 0;
+
+nomem:
+	__ERROR(ENOMEM, 0);
+
+fail:
+	hfs_closedir(dir);
+	return -1;
+}
+
+/*
+ * NAME:	tally()
+ * DESCRIPTION:	link directories to their parents and roll totals up to the root
+ */
+static
+int tally(dunode *nodes, unsigned int nnodes, dugroup *groups, unsigned int ngroups)
+{
+	unsigned int i, steps;
+	long n;
+	int depth, maxdepth = 0;
+
+	for (i = 0; i < ngroups; ++i)
+	{
+		n = find(nodes, nnodes, groups[i].parid);
+		if (n != -1)
+			add(&nodes[n].total, &groups[i].total);
+	}
+
+	for (i = 0; i < nnodes; ++i)
+		nodes[i].parent = find(nodes, nnodes, nodes[i].parid);
+
+	for (i = 0; i < nnodes; ++i)
+	{
+		/* guard against a damaged catalog with a cycle */
+
+		depth = 0;
+		for (n = nodes[i].parent, steps = 0; n != -1 && steps < nnodes;
+				n = nodes[n].parent, ++steps)
+			++depth;
+
+		if (steps == nnodes)
+		{
+			__ERROR(EINVAL, "directory hierarchy is inconsistent");
+			return -1;
+		}
+
+		nodes[i].depth = depth;
+		if (depth > maxdepth)
+			maxdepth = depth;
+	}
+
+	for (depth = maxdepth; depth > 0; --depth)
+	{
+		for (i = 0; i < nnodes; ++i)
+		{
+			if (nodes[i].depth == depth)
+				add(&nodes[nodes[i].parent].total, &nodes[i].total);
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * NAME:	mkpath()
+ * DESCRIPTION:	assemble the path of a directory from its ancestors' names
+ */
+static
+char *mkpath(dunode *nodes, long n)
+{
+	size_t len = 0;
+	long i;
+	char *path, *ptr;
+
+	for (i = n; i != -1; i = nodes[i].parent)
+		len += strlen(nodes[i].name) + 1;
+
+	path = malloc(len + 1);
+	if (path == 0)
+		return 0;
+
+	/* a volume root is written "name:", any other directory "...:name" */
+
+	ptr  = path + len;
+	*ptr = 0;
+
+	if (nodes[n].parent == -1)
+		*--ptr = ':';
+
+	for (i = n; i != -1; i = nodes[i].parent)
+	{
+		size_t nlen = strlen(nodes[i].name);
+
+		ptr -= nlen;
+		memcpy(ptr, nodes[i].name, nlen);
+
+		if (nodes[i].parent != -1)
+			*--ptr = ':';
+	}
+
+	if (ptr != path)
+		memmove(path, ptr, strlen(ptr) + 1);
+
+	return path;
+}
+
+/*
+ * NAME:	within()
+ * DESCRIPTION:	return 1 iff a directory is in the tree rooted at another
+ */
+static
+int within(dunode *nodes, long n, long top)
+{
+	while (n != -1 && nodes[n].depth > nodes[top].depth)
+		n = nodes[n].parent;
+
+	return n == top;
+}
+
+/*
+ * NAME:	show()
+ * DESCRIPTION:	output one line of the summary
+ */
+static
+void show(const dunode *node, int flags)
+{
+	unsigned long long lsize, psize;
+	wchar_t *wpath;
+
+	lsize = node->total.lsize;
+	psize = node->total.psize;
+
+	if (flags & HDU_KBYTES)
+	{
+		lsize = (lsize + 1023) / 1024;
+		psize = (psize + 1023) / 1024;
+	}
+
+	wpath = macRomanToUtf16(node->path);
+	if (wpath == 0)
+		return;
+
+	wprintf(L"%12llu %12llu %8lu %8lu  %s\n", lsize, psize,
+		node->total.files, node->total.dirs, wpath);
+
+	free(wpath);
+}
+
+/*
+ * NAME:	hdu->main()
+ * DESCRIPTION:	implement hdu command
+ */
+int hdu_main(int argc, wchar_t *argv[])
+{
+	hfsvol *vol;
+	darray *nodearr = 0, *grouparr = 0;
+	dunode *nodes, **list = 0;
+	unsigned int nnodes, nlist = 0, i;
+	unsigned long topid;
+	long top;
+	int flags = 0, result = 0;
+
+	optind = 2;
+
+	while (1)
+	{
+		int opt;
+
+		opt = getopt(argc, argv, L"sSk?");
+		if (opt == EOF)
+			break;
+
+		switch (opt)
+		{
+		case 's':
+			flags |= HDU_SUMMARY;
+			break;
+
+		case 'S':
+			flags |= HDU_BYSIZE;
+			break;
+
+		case 'k':
+			flags |= HDU_KBYTES;
+			break;
+
+		case '?':
+			return usage();
+		}
+	}
+
+	if (argc - optind > 1)
+		return usage();
+
+	vol = hfsutil_remount(hcwd_getvol(-1), HFS_MODE_RDONLY);
+	if (vol == 0)
+		return 1;
+
+	if (argc - optind == 1)
+	{
+		char *path;
+		hfsdirent ent;
+
+		path = utf16ToMacRoman(argv[optind]);
+		if (path == 0 || hfs_stat(vol, path, &ent) == -1)
+		{
+			hfsutil_perrorp_w(argv[optind]);
+			result = 1;
+		}
+		else if (! (ent.flags & HFS_ISDIR))
+		{
+			fwprintf(stderr, L"%s: %s: not a directory\n", bargv0, argv[optind]);
+			result = 1;
+		}
+		else
+			topid = ent.cnid;
+
+		free(path);
+	}
+	else
+		topid = hfs_getcwd(vol);
+
+	if (result == 0)
+	{
+		nodearr  = darr_new(sizeof(dunode));
+		grouparr = darr_new(sizeof(dugroup));
+
+		if (nodearr == 0 || grouparr == 0)
+		{
+			fwprintf(stderr, L"%s: not enough memory\n", bargv0);
+			result = 1;
+		}
+	}
+
+	if (result == 0 && scan(vol, nodearr, grouparr) == -1)
+	{
+		hfsutil_perror("Can't read catalog");
+		result = 1;
+	}
+
+	if (result == 0)
+	{
+		darr_sort(nodearr, (int (*)(const void *, const void *)) compare_cnids);
+
+		nodes  = darr_array(nodearr);
+		nnodes = darr_size(nodearr);
+
+		if (tally(nodes, nnodes, darr_array(grouparr), darr_size(grouparr)) == -1)
+		{
+			hfsutil_perror("Can't total directories");
+			result = 1;
+		}
+	}
+
+	if (result == 0)
+	{
+		top = find(nodes, nnodes, topid);
+
+		list = malloc((nnodes ? nnodes : 1) * sizeof(dunode *));
+		if (top == -1)
+		{
+			/* the folder went missing between its lookup and the scan */
+
+			errno     = ENOENT;
+			hfs_error = 0;
+
+			if (argc - optind == 1)
+				hfsutil_perrorp_w(argv[optind]);
+			else
+				hfsutil_perror("Can't find current directory");
+
+			result = 1;
+		}
+		else if (list == 0)
+		{
+			fwprintf(stderr, L"%s: not enough memory\n", bargv0);
+			result = 1;
+		}
+	}
+
+	if (result == 0)
+	{
+		for (i = 0; i < nnodes; ++i)
+		{
+			if ((flags & HDU_SUMMARY) ? (long) i != top : ! within(nodes, i, top))
+				continue;
+
+			nodes[i].path = mkpath(nodes, i);
+			if (nodes[i].path == 0)
+			{
+				fwprintf(stderr, L"%s: not enough memory\n", bargv0);
+				result = 1;
+				break;
+			}
+
+			list[nlist++] = &nodes[i];
+		}
+	}
+
+	if (result == 0)
+	{
+		qsort(list, nlist, sizeof(dunode *),
+			(int (*)(const void *, const void *))
+			((flags & HDU_BYSIZE) ? compare_sizes : compare_paths));
+
+		for (i = 0; i < nlist; ++i)
+			show(list[i], flags);
+	}
+
+	if (list)
+	{
+		for (i = 0; i < nlist; ++i)
+			free(list[i]->path);
+
+		free(list);
+	}
+
+	if (nodearr)
+		darr_free(nodearr);
+	if (grouparr)
+		darr_free(grouparr);
+
+	hfsutil_unmount(vol, &result);
+
+	return result;
+}
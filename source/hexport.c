@@ -0,0 +1,834 @@
+/*
+ * hfsutils - tools for reading and writing Macintosh HFS volumes
+ * Copyright (C) 1996-1998 Robert Leslie
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * The archive is a POSIX (pax) tar stream. Each data fork is a regular
+ * entry; the resource fork, Finder info and dates of a file travel in an
+ * AppleDouble entry named "._name" just before it, as macOS tar writes
+ * them. Names that don't fit a ustar header, or aren't ASCII, get a pax
+ * "path" record. HFS names are converted to UTF-8 with "/" written as ":".
+ */
+
+# include <stdio.h>
+# include <stdlib.h>
+# include <string.h>
+# include <errno.h>
+# include <io.h>
+# include <fcntl.h>
+
+# include "hfs.h"
+# include "hcwd.h"
+# include "hfsutil.h"
+# include "darray.h"
+# include "copyout.h"
+# include "hexport.h"
+# include "charset.h"
+# include "getopt.h"
+
+# define HEXPORT_DIRENTS	64		/* catalog records read per call */
+# define HEXPORT_BUFSZ		(256 * 1024)	/* archive output buffer */
+
+# define TAR_BLOCKSZ		512
+# define TAR_PATHMAX		4096
+
+typedef struct {
+	unsigned long cnid;		/* folder ID */
+	unsigned long parid;		/* parent folder ID */
+	long parent;			/* index of parent, or -1 */
+	int state;			/* T_UNSEEN, T_INSIDE or T_OUTSIDE */
+	char *path;			/* archive path, once inside */
+	hfsdirent ent;
+} exdir;
+
+enum {
+	T_UNSEEN,		/* not yet placed */
+	T_INSIDE,		/* in the tree being exported */
+	T_OUTSIDE		/* elsewhere on the volume */
+};
+
+typedef struct {
+	int fd;			/* archive destination */
+	char *buf;		/* pending output */
+	unsigned long len;
+} tarout;
+
+/*
+ * NAME:	usage()
+ * DESCRIPTION:	display usage message
+ */
+static
+int usage(void)
+{
+	fwprintf(stderr, L"Usage: export [-r] [hfs-path] > archive.tar\n");
+
+	return 1;
+}
+
+/*
+ * NAME:	flush()
+ * DESCRIPTION:	write out pending archive data
+ */
+static
+int flush(tarout *tar)
+{
+	unsigned long done = 0;
+	int bytes;
+
+	while (done < tar->len)
+	{
+		bytes = write(tar->fd, tar->buf + done, tar->len - done);
+		if (bytes <= 0)
+		{
+			__ERROR(bytes == 0 ? EIO : errno, "error writing archive");
+			return -1;
+		}
+
+		done += bytes;
+	}
+
+	tar->len = 0;
+
+	return 0;
+}
+
+/*
+ * NAME:	put()
+ * DESCRIPTION:	add bytes to the archive; a null pointer adds zeros
+ */
+static
+int put(tarout *tar, const void *data, unsigned long len)
+{
+	unsigned long chunk;
+
+	while (len)
+	{
+		if (tar->len == HEXPORT_BUFSZ && flush(tar) == -1)
+			return -1;
+
+		chunk = HEXPORT_BUFSZ - tar->len;
+		if (chunk > len)
+			chunk = len;
+
+		if (data)
+		{
+			memcpy(tar->buf + tar->len, data, chunk);
+			data = (const char *) data + chunk;
+		}
+		else
+			memset(tar->buf + tar->len, 0, chunk);
+
+		tar->len += chunk;
+		len      -= chunk;
+	}
+
+	return 0;
+}
+
+/*
+ * NAME:	pad()
+ * DESCRIPTION:	fill out the last block of an entry of the given size
+ */
+static
+int pad(tarout *tar, unsigned long size)
+{
+	return put(tar, 0, (TAR_BLOCKSZ - size % TAR_BLOCKSZ) % TAR_BLOCKSZ);
+}
+
+/*
+ * NAME:	octal()
+ * DESCRIPTION:	store a number in a tar header field
+ */
+static
+void octal(char *field, int width, unsigned long value)
+{
+	char num[24];
+
+	sprintf(num, "%0*lo", width - 1, value);
+	memcpy(field, num, width - 1);
+}
+
+/*
+ * NAME:	record()
+ * DESCRIPTION:	append a pax extended header record
+ */
+static
+int record(char *buf, const char *key, const char *value)
+{
+	int len, total;
+
+	/* the length counts its own digits */
+
+	len   = 1 + strlen(key) + 1 + strlen(value) + 1;
+	total = len + 1;
+
+	while (sprintf(buf, "%d", total) + len > total)
+		++total;
+
+	return sprintf(buf, "%d %s=%s\n", total, key, value);
+}
+
+/*
+ * NAME:	header()
+ * DESCRIPTION:	write the header block(s) of an archive entry
+ */
+static
+int header(tarout *tar, const char *path, int type, unsigned long size,
+	time_t mtime, int mode)
+{
+	unsigned char block[TAR_BLOCKSZ];
+	char pax[64 + TAR_PATHMAX];
+	const char *ptr, *split = 0;
+	unsigned long sum;
+	size_t len;
+	int i, paxlen = 0, ascii = 1;
+
+	len = strlen(path);
+
+	for (ptr = path; *ptr; ++ptr)
+	{
+		if ((unsigned char) *ptr >= 0x80)
+			ascii = 0;
+	}
+
+	/* a long ASCII path may still fit as ustar prefix and name */
+
+	if (len > 100)
+	{
+		for (ptr = path + len - 1; ptr > path; --ptr)
+		{
+			if (*ptr == '/' && ptr - path <= 155 && len - (ptr - path) - 1 <= 100)
+			{
+				split = ptr;
+				break;
+			}
+		}
+	}
+
+	if (! ascii || (len > 100 && split == 0))
+	{
+		if (len > TAR_PATHMAX)
+		{
+			__ERROR(ENAMETOOLONG, "path too long for archive");
+			return -1;
+		}
+
+		paxlen = record(pax, "path", path);
+	}
+
+	/* ustar can't hold dates before 1970 */
+
+	if (mtime < 0)
+	{
+		char num[24];
+
+		sprintf(num, "%ld", (long) mtime);
+		paxlen += record(pax + paxlen, "mtime", num);
+	}
+
+	if (paxlen)
+	{
+		if (header(tar, "././@PaxHeader", 'x', paxlen, 0, 0644) == -1 ||
+				put(tar, pax, paxlen) == -1 || pad(tar, paxlen) == -1)
+			return -1;
+
+		split = 0;
+		if (len > 100)
+			len = 100;
+	}
+
+	memset(block, 0, sizeof(block));
+
+	if (split)
+	{
+		memcpy(&block[345], path, split - path);
+		memcpy(&block[0], split + 1, len - (split - path) - 1);
+	}
+	else
+		memcpy(&block[0], path, len);
+
+	octal((char *) &block[100], 8, mode);
+	octal((char *) &block[108], 8, 0);
+	octal((char *) &block[116], 8, 0);
+	octal((char *) &block[124], 12, size);
+	octal((char *) &block[136], 12, mtime < 0 ? 0 : (unsigned long) mtime);
+
+	block[156] = type;
+
+	memcpy(&block[257], "ustar", 6);
+	memcpy(&block[263], "00", 2);
+
+	memset(&block[148], ' ', 8);
+
+	for (sum = 0, i = 0; i < TAR_BLOCKSZ; ++i)
+		sum += block[i];
+
+	octal((char *) &block[148], 7, sum);
+
+	return put(tar, block, TAR_BLOCKSZ);
+}
+
+/*
+ * NAME:	putfork()
+ * DESCRIPTION:	read a fork straight into the archive buffer
+ */
+static
+int putfork(tarout *tar, hfsfile *file, int fork, unsigned long size)
+{
+	unsigned long chunk;
+	long bytes;
+
+	if (hfs_setfork(file, fork) == -1)
+		return -1;
+
+	while (size)
+	{
+		if (tar->len == HEXPORT_BUFSZ && flush(tar) == -1)
+			return -1;
+
+		chunk = HEXPORT_BUFSZ - tar->len;
+		if (chunk > size)
+			chunk = size;
+
+		bytes = hfs_read(file, tar->buf + tar->len, chunk);
+		if (bytes == -1)
+			return -1;
+		else if (bytes == 0)
+		{
+			/* the entry size is already in the archive */
+
+			__ERROR(EIO, "inconsistent fork length");
+			return -1;
+		}
+
+		tar->len += bytes;
+		size     -= bytes;
+	}
+
+	return 0;
+}
+
+/*
+ * NAME:	tarname()
+ * DESCRIPTION:	return an archive path for an HFS name within a directory
+ */
+static
+char *tarname(const char *dir, const char *prefix, const char *name, int isdir)
+{
+	char *path, *ptr;
+	int len;
+
+	len = dir ? strlen(dir) : 0;
+
+	path = malloc(len + 1 + strlen(prefix) + 3 * strlen(name) + 2);
+	if (path == 0)
+	{
+		__ERROR(ENOMEM, 0);
+		return 0;
+	}
+
+	if (dir)
+	{
+		strcpy(path, dir);
+		path[len++] = '/';
+	}
+
+	strcpy(path + len, prefix);
+	len += strlen(prefix);
+
+	ptr  = path + len;
+	len += macRomanToUtf8Text(name, strlen(name), ptr);
+
+	/* a slash is legal in HFS names but not in archive paths; CR survives */
+
+	for (; ptr < path + len; ++ptr)
+	{
+		if (*ptr == '/')
+			*ptr = ':';
+		else if (*ptr == '\n')
+			*ptr = '\r';
+	}
+
+	if (isdir)
+		path[len++] = '/';
+
+	path[len] = 0;
+
+	return path;
+}
+
+/*
+ * NAME:	putfile()
+ * DESCRIPTION:	archive one file, with an AppleDouble entry unless raw
+ */
+static
+int putfile(hfsvol *vol, tarout *tar, const char *dir, const char *hfspath,
+	const hfsdirent *ent, int raw)
+{
+	unsigned char head[CPO_ASHEADERMAX];
+	char *path = 0, *side = 0;
+	hfsfile *file;
+	int mode, len, result = -1;
+
+	file = hfs_open(vol, hfspath);
+	if (file == 0)
+		return -1;
+
+	path = tarname(dir, "", ent->name, 0);
+	side = tarname(dir, "._", ent->name, 0);
+
+	if (path == 0 || side == 0)
+		goto done;
+
+	mode = (ent->flags & HFS_ISLOCKED) ? 0444 : 0644;
+
+	/* files with nothing but a data fork need no AppleDouble entry */
+
+	if (! raw && (ent->u.file.rsize ||
+			memcmp(ent->u.file.type, "\0\0\0\0", 4) ||
+			memcmp(ent->u.file.creator, "\0\0\0\0", 4) || ent->fdflags))
+	{
+		len = cpo_asheader(head, ent, 0);
+
+		if (header(tar, side, '0', len + ent->u.file.rsize, ent->mddate, mode) == -1 ||
+				put(tar, head, len) == -1 ||
+				putfork(tar, file, 1, ent->u.file.rsize) == -1 ||
+				pad(tar, len + ent->u.file.rsize) == -1)
+			goto done;
+	}
+
+	if (header(tar, path, '0', ent->u.file.dsize, ent->mddate, mode) == -1 ||
+			putfork(tar, file, 0, ent->u.file.dsize) == -1 ||
+			pad(tar, ent->u.file.dsize) == -1)
+		goto done;
+
+	result = 0;
+
+done:
+	free(path);
+	free(side);
+
+	if (hfs_close(file) == -1)
+		result = -1;
+
+	return result;
+}
+
+/*
+ * NAME:	compare_dirs()
+ * DESCRIPTION:	order folders by ID
+ */
+static
+int compare_dirs(const exdir *dir1, const exdir *dir2)
+{
+	return (dir1->cnid > dir2->cnid) - (dir1->cnid < dir2->cnid);
+}
+
+/*
+ * NAME:	compare_paths()
+ * DESCRIPTION:	order folders by archive path, so parents come first
+ */
+static
+int compare_paths(const exdir **dir1, const exdir **dir2)
+{
+	return strcmp((*dir1)->path, (*dir2)->path);
+}
+
+/*
+ * NAME:	finddir()
+ * DESCRIPTION:	locate a folder by ID; return its index or -1
+ */
+static
+long finddir(exdir *dirs, unsigned int ndirs, unsigned long cnid)
+{
+	exdir key, *dir;
+
+	key.cnid = cnid;
+
+	dir = bsearch(&key, dirs, ndirs, sizeof(exdir),
+		(int (*)(const void *, const void *)) compare_dirs);
+
+	return dir ? (long) (dir - dirs) : -1;
+}
+
+/*
+ * NAME:	scan()
+ * DESCRIPTION:	collect every folder and file of the volume in one pass
+ */
+static
+int scan(hfsvol *vol, darray *dirs, darray *files)
+{
+	hfsdir *cat;
+	hfsdirent ents[HEXPORT_DIRENTS];
+	exdir dir;
+	int count, i;
+
+	cat = hfs_opencat(vol);
+	if (cat == 0)
+		return -1;
+
+	while ((count = hfs_readdir_many(cat, ents, HEXPORT_DIRENTS)) > 0)
+	{
+		for (i = 0; i < count; ++i)
+		{
+			if (ents[i].flags & HFS_ISDIR)
+			{
+				memset(&dir, 0, sizeof(dir));
+
+				dir.cnid   = ents[i].cnid;
+				dir.parid  = ents[i].parid;
+				dir.parent = -1;
+				dir.ent    = ents[i];
+
+				if (darr_append(dirs, &dir) == 0)
+					goto nomem;
+			}
+			else if (darr_append(files, &ents[i]) == 0)
+				goto nomem;
+		}
+	}
+
+	if (count == -1)
+		goto fail;
+
+	hfs_closedir(cat);
+
+	return 0;
+
+nomem:
+	__ERROR(ENOMEM, 0);
+
+fail:
+	hfs_closedir(cat);
+	return -1;
+}
+
+/*
+ * NAME:	place()
+ * DESCRIPTION:	decide whether a folder is in the tree being exported
+ */
+static
+int place(exdir *dirs, long n)
+{
+	exdir *dir = &dirs[n];
+
+	if (dir->state != T_UNSEEN)
+		return dir->state;
+
+	/* a damaged catalog might link folders in a cycle */
+
+	dir->state = T_OUTSIDE;
+
+	if (dir->parent == -1 || place(dirs, dir->parent) != T_INSIDE)
+		return T_OUTSIDE;
+
+	dir->path = tarname(dirs[dir->parent].path, "", dir->ent.name, 0);
+	if (dir->path == 0)
+		return T_OUTSIDE;
+
+	return dir->state = T_INSIDE;
+}
+
+/*
+ * NAME:	dumptree()
+ * DESCRIPTION:	write a folder and everything below it to the archive
+ */
+static
+int dumptree(hfsvol *vol, tarout *tar, const hfsdirent *top, int raw)
+{
+	darray *dirarr, *filearr;
+	exdir *dirs, **list = 0;
+	hfsdirent *files;
+	unsigned int ndirs, nfiles, nlist = 0, i;
+	unsigned long cwd, dirid;
+	char *path, name[HFS_MAX_FLEN + 2];
+	long n;
+	int result = 0;
+
+	cwd = dirid = hfs_getcwd(vol);
+
+	dirarr  = darr_new(sizeof(exdir));
+	filearr = darr_new(sizeof(hfsdirent));
+
+	if (dirarr == 0 || filearr == 0)
+	{
+		__ERROR(ENOMEM, 0);
+		hfsutil_perror("Can't read catalog");
+
+		result = 1;
+		goto done;
+	}
+
+	if (scan(vol, dirarr, filearr) == -1)
+	{
+		hfsutil_perror("Can't read catalog");
+
+		result = 1;
+		goto done;
+	}
+
+	darr_sort(dirarr, (int (*)(const void *, const void *)) compare_dirs);
+
+	dirs   = darr_array(dirarr);
+	ndirs  = darr_size(dirarr);
+	files  = darr_array(filearr);
+	nfiles = darr_size(filearr);
+
+	for (i = 0; i < ndirs; ++i)
+		dirs[i].parent = finddir(dirs, ndirs, dirs[i].parid);
+
+	n = finddir(dirs, ndirs, top->cnid);
+
+	list = malloc((ndirs ? ndirs : 1) * sizeof(exdir *));
+	if (n == -1 || list == 0)
+	{
+		__ERROR(n == -1 ? ENOENT : ENOMEM, 0);
+		hfsutil_perror("Can't read catalog");
+
+		result = 1;
+		goto done;
+	}
+
+	dirs[n].path  = tarname(0, "", top->name, 0);
+	dirs[n].state = T_INSIDE;
+
+	if (dirs[n].path == 0)
+	{
+		hfsutil_perror("Can't export folder");
+
+		result = 1;
+		goto done;
+	}
+
+	for (i = 0; i < ndirs; ++i)
+	{
+		if (place(dirs, i) == T_INSIDE)
+			list[nlist++] = &dirs[i];
+	}
+
+	/* folders first, each after its parent; then files in catalog order */
+
+	qsort(list, nlist, sizeof(exdir *),
+		(int (*)(const void *, const void *)) compare_paths);
+
+	for (i = 0; i < nlist; ++i)
+	{
+		path = malloc(strlen(list[i]->path) + 2);
+		if (path == 0)
+		{
+			__ERROR(ENOMEM, 0);
+			hfsutil_perror("Can't export folder");
+
+			result = 1;
+			goto done;
+		}
+
+		strcpy(path, list[i]->path);
+		strcat(path, "/");
+
+		if (header(tar, path, '5', 0, list[i]->ent.mddate, 0755) == -1)
+		{
+			hfsutil_perror("Can't write archive");
+			free(path);
+
+			result = 1;
+			goto done;
+		}
+
+		free(path);
+	}
+
+	for (i = 0; i < nfiles; ++i)
+	{
+		n = finddir(dirs, ndirs, files[i].parid);
+		if (n == -1 || dirs[n].state != T_INSIDE)
+			continue;
+
+		/* files are opened by name within their folder */
+
+		if (files[i].parid != dirid)
+		{
+			if (hfs_setcwd(vol, files[i].parid) == -1)
+			{
+				hfsutil_perror("Can't export file");
+
+				result = 1;
+				goto done;
+			}
+
+			dirid = files[i].parid;
+		}
+
+		name[0] = ':';
+		strcpy(name + 1, files[i].name);
+
+		if (putfile(vol, tar, dirs[n].path, name, &files[i], raw) == -1)
+		{
+			hfsutil_perror("Can't export file");
+
+			/* a partial entry leaves the archive unusable */
+
+			result = 1;
+			goto done;
+		}
+	}
+
+done:
+	if (dirid != cwd && hfs_setcwd(vol, cwd) == -1 && result == 0)
+	{
+		hfsutil_perror("Can't restore current directory");
+		result = 1;
+	}
+
+	if (dirarr)
+	{
+		dirs  = darr_array(dirarr);
+		ndirs = darr_size(dirarr);
+
+		for (i = 0; i < ndirs; ++i)
+			free(dirs[i].path);
+
+		darr_free(dirarr);
+	}
+
+	if (filearr)
+		darr_free(filearr);
+
+	free(list);
+
+	return result;
+}
+
+/*
+ * NAME:	hexport->main()
+ * DESCRIPTION:	implement hexport command
+ */
+int hexport_main(int argc, wchar_t *argv[])
+{
+	hfsvol *vol;
+	hfsdirent ent;
+	tarout tar;
+	int raw = 0, result = 0;
+
+	optind = 2;
+
+	while (1)
+	{
+		int opt;
+
+		opt = getopt(argc, argv, L"r?");
+		if (opt == EOF)
+			break;
+
+		switch (opt)
+		{
+		case 'r':
+			raw = 1;
+			break;
+
+		case '?':
+			return usage();
+		}
+	}
+
+	if (argc - optind > 1)
+		return usage();
+
+	if (_isatty(_fileno(stdout)))
+	{
+		fwprintf(stderr, L"%s: refusing to write an archive to a terminal\n", bargv0);
+		return 1;
+	}
+
+	vol = hfsutil_remount(hcwd_getvol(-1), HFS_MODE_RDONLY);
+	if (vol == 0)
+		return 1;
+
+	if (argc - optind == 1)
+	{
+		char *path;
+
+		path = utf16ToMacRoman(argv[optind]);
+		if (path == 0 || hfs_stat(vol, path, &ent) == -1)
+		{
+			hfsutil_perrorp_w(argv[optind]);
+			result = 1;
+		}
+
+		free(path);
+	}
+	else if (hfs_stat(vol, ":", &ent) == -1)
+	{
+		hfsutil_perror("Can't find current directory");
+		result = 1;
+	}
+
+	tar.buf = 0;
+
+	if (result == 0)
+	{
+		tar.buf = malloc(HEXPORT_BUFSZ);
+		tar.len = 0;
+		tar.fd  = _fileno(stdout);
+
+		if (tar.buf == 0)
+		{
+			fwprintf(stderr, L"%s: not enough memory\n", bargv0);
+			result = 1;
+		}
+	}
+
+	if (result == 0)
+	{
+		fflush(stdout);
+		_setmode(tar.fd, _O_BINARY);
+
+		if (ent.flags & HFS_ISDIR)
+			result = dumptree(vol, &tar, &ent, raw);
+		else
+		{
+			char *path;
+
+			path = utf16ToMacRoman(argv[optind]);
+			if (path == 0 || putfile(vol, &tar, 0, path, &ent, raw) == -1)
+			{
+				hfsutil_perrorp_w(argv[optind]);
+				result = 1;
+			}
+
+			free(path);
+		}
+
+		/* an archive ends with two empty blocks */
+
+		if (result == 0 &&
+				(put(&tar, 0, 2 * TAR_BLOCKSZ) == -1 || flush(&tar) == -1))
+		{
+			hfsutil_perror("Can't write archive");
+			result = 1;
+		}
+
+		_setmode(tar.fd, _O_U8TEXT);
+	}
+
+	free(tar.buf);
+
+	hfsutil_unmount(vol, &result);
+
+	return result;
+}
@@ -0,0 +1,601 @@
+/*
+ * hfsutils - tools for reading and writing Macintosh HFS volumes
+ * Copyright (C) 1996-1998 Robert Leslie
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+# include <stdio.h>
+# include <stdlib.h>
+# include <string.h>
+# include <time.h>
+# include <errno.h>
+
+# include "hfs.h"
+# include "hcwd.h"
+# include "hfsutil.h"
+# include "glob.h"
+# include "output.h"
+# include "hfind.h"
+# include "charset.h"
+
+# define HFIND_DIRENTS	64	/* catalog records read per call */
+
+# define DAY		(24L * 60L * 60L)
+
+enum {
+	P_NAME,		/* -name pattern */
+	P_KIND,		/* -type f|d */
+	P_FTYPE,	/* -ftype TYPE */
+	P_CREATOR,	/* -creator CREA */
+	P_FDFLAGS,	/* -fdflags mask (also -invisible, -alias, ...) */
+	P_LOCKED,	/* -locked */
+	P_SIZE,		/* -size [+-]n[kM] (both forks) */
+	P_DSIZE,	/* -dsize [+-]n[kM] */
+	P_RSIZE,	/* -rsize [+-]n[kM] */
+	P_MTIME,	/* -mtime [+-]days */
+	P_CTIME,	/* -ctime [+-]days */
+	P_DATA,		/* -data: data fork is not empty */
+	P_RSRC,		/* -rsrc: resource fork is not empty */
+	P_EMPTY		/* -empty */
+};
+
+typedef struct {
+	int kind;
+	int negate;		/* preceded by ! */
+	int cmp;		/* -1: less than, 0: equal, 1: greater than */
+	unsigned long long num;
+	char *str;		/* MacOS Standard Roman pattern or code */
+	globpat *pat;	/* compiled -name pattern */
+} pred;
+
+static const struct {
+	const wchar_t *name;
+	int mask;
+} fdnames[] = {
+	{ L"-invisible",  HFS_FNDR_ISINVISIBLE },
+	{ L"-alias",      HFS_FNDR_ISALIAS },
+	{ L"-stationery", HFS_FNDR_ISSTATIONERY },
+	{ L"-customicon", HFS_FNDR_HASCUSTOMICON },
+	{ L"-bundle",     HFS_FNDR_HASBUNDLE },
+	{ L"-inited",     HFS_FNDR_HASBEENINITED },
+	{ 0,              0 }
+};
+
+/*
+ * NAME:	usage()
+ * DESCRIPTION:	display usage message
+ */
+static
+int usage(void)
+{
+	fwprintf(stderr,
+		L"Usage: find [hfs-path] [[!] predicate ...] [-print0 | -json]\n"
+		L"Predicates: -name PATTERN, -type f|d, -ftype TYPE, -creator CREA,\n"
+		L"  -fdflags MASK, -invisible, -alias, -stationery, -customicon, -bundle,\n"
+		L"  -inited, -locked, -size|-dsize|-rsize [+|-]N[k|M], -mtime|-ctime [+|-]DAYS,\n"
+		L"  -data, -rsrc, -empty\n");
+
+	return 1;
+}
+
+/*
+ * NAME:	getnum()
+ * DESCRIPTION:	parse a [+|-]N[k|M] argument; return -1 if malformed
+ */
+static
+int getnum(const wchar_t *arg, pred *p, int units)
+{
+	wchar_t *end;
+
+	p->cmp = 0;
+
+	if (*arg == L'+')
+		p->cmp = 1, ++arg;
+	else if (*arg == L'-')
+		p->cmp = -1, ++arg;
+
+	if (*arg < L'0' || *arg > L'9')
+		return -1;
+
+	p->num = wcstoull(arg, &end, 10);
+
+	if (units && (*end == L'k' || *end == L'K'))
+		p->num *= 1024, ++end;
+	else if (units && *end == L'M')
+		p->num *= 1024 * 1024, ++end;
+
+	return *end ? -1 : 0;
+}
+
+/*
+ * NAME:	compare()
+ * DESCRIPTION:	test a value against a numeric predicate
+ */
+static
+int compare(unsigned long long val, const pred *p)
+{
+	switch (p->cmp)
+	{
+	case -1:
+		return val < p->num;
+
+	case 1:
+		return val > p->num;
+
+	default:
+		return val == p->num;
+	}
+}
+
+/*
+ * NAME:	days()
+ * DESCRIPTION:	return the number of whole days since a date
+ */
+static
+unsigned long long days(time_t now, time_t when)
+{
+	return (when >= now) ? 0 : (unsigned long long) (now - when) / DAY;
+}
+
+/*
+ * NAME:	test()
+ * DESCRIPTION:	return 1 iff an entry satisfies a predicate
+ */
+static
+int test(const hfsdirent *ent, const pred *p, time_t now)
+{
+	int isdir = ent->flags & HFS_ISDIR;
+
+	switch (p->kind)
+	{
+	case P_NAME:
+		return glob_match(p->pat, ent->name);
+
+	case P_KIND:
+		return (p->num != 0) == (isdir != 0);
+
+	case P_FTYPE:
+		return ! isdir && memcmp(ent->u.file.type, p->str, 4) == 0;
+
+	case P_CREATOR:
+		return ! isdir && memcmp(ent->u.file.creator, p->str, 4) == 0;
+
+	case P_FDFLAGS:
+		return ((unsigned short) ent->fdflags & p->num) == p->num;
+
+	case P_LOCKED:
+		return (ent->flags & HFS_ISLOCKED) != 0;
+
+	case P_SIZE:
+		return ! isdir &&
+			compare((unsigned long long) ent->u.file.dsize + ent->u.file.rsize, p);
+
+	case P_DSIZE:
+		return ! isdir && compare(ent->u.file.dsize, p);
+
+	case P_RSIZE:
+		return ! isdir && compare(ent->u.file.rsize, p);
+
+	case P_MTIME:
+		return compare(days(now, ent->mddate), p);
+
+	case P_CTIME:
+		return compare(days(now, ent->crdate), p);
+
+	case P_DATA:
+		return ! isdir && ent->u.file.dsize != 0;
+
+	case P_RSRC:
+		return ! isdir && ent->u.file.rsize != 0;
+
+	case P_EMPTY:
+		return isdir ? ent->u.dir.valence == 0 :
+			(ent->u.file.dsize == 0 && ent->u.file.rsize == 0);
+	}
+
+	return 0;
+}
+
+/*
+ * NAME:	matches()
+ * DESCRIPTION:	return 1 iff an entry satisfies every predicate
+ */
+static
+int matches(const hfsdirent *ent, const pred *preds, int npreds, time_t now)
+{
+	int i;
+
+	for (i = 0; i < npreds; ++i)
+	{
+		if (test(ent, &preds[i], now) == preds[i].negate)
+			return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * NAME:	parse()
+ * DESCRIPTION:	translate the expression; return number of predicates or -1
+ */
+static
+int parse(int argc, wchar_t *argv[], pred *preds, int *fmt)
+{
+	int i, j, n = 0, negate = 0;
+
+	for (i = 0; i < argc; ++i)
+	{
+		const wchar_t *arg = argv[i], *val = 0;
+		pred *p = &preds[n];
+
+		if (wcscmp(arg, L"!") == 0)
+		{
+			negate = ! negate;
+			continue;
+		}
+
+		if (wcscmp(arg, L"-print0") == 0 || wcscmp(arg, L"-json") == 0)
+		{
+			if (negate)
+				return -1;
+
+			*fmt = (arg[1] == L'j') ? OUT_JSON : OUT_NUL;
+			continue;
+		}
+
+		memset(p, 0, sizeof(pred));
+		p->negate = negate;
+		negate = 0;
+
+		for (j = 0; fdnames[j].name; ++j)
+		{
+			if (wcscmp(arg, fdnames[j].name) == 0)
+				break;
+		}
+
+		if (fdnames[j].name)
+		{
+			p->kind = P_FDFLAGS;
+			p->num  = fdnames[j].mask;
+		}
+		else if (wcscmp(arg, L"-locked") == 0)
+			p->kind = P_LOCKED;
+		else if (wcscmp(arg, L"-data") == 0)
+			p->kind = P_DATA;
+		else if (wcscmp(arg, L"-rsrc") == 0)
+			p->kind = P_RSRC;
+		else if (wcscmp(arg, L"-empty") == 0)
+			p->kind = P_EMPTY;
+		else
+		{
+			/* the remaining predicates take an argument */
+
+			if (i + 1 == argc)
+				return -1;
+
+			val = argv[++i];
+
+			if (wcscmp(arg, L"-name") == 0)
+				p->kind = P_NAME;
+			else if (wcscmp(arg, L"-ftype") == 0)
+				p->kind = P_FTYPE;
+			else if (wcscmp(arg, L"-creator") == 0)
+				p->kind = P_CREATOR;
+			else if (wcscmp(arg, L"-type") == 0)
+			{
+				if (wcscmp(val, L"f") != 0 && wcscmp(val, L"d") != 0)
+					return -1;
+
+				p->kind = P_KIND;
+				p->num  = (*val == L'd');
+			}
+			else if (wcscmp(arg, L"-fdflags") == 0)
+			{
+				p->kind = P_FDFLAGS;
+				p->num  = wcstoul(val, 0, 0);
+			}
+			else if (wcscmp(arg, L"-size") == 0 ||
+					 wcscmp(arg, L"-dsize") == 0 || wcscmp(arg, L"-rsize") == 0)
+			{
+				p->kind = (arg[1] == L's') ? P_SIZE : (arg[1] == L'd') ? P_DSIZE : P_RSIZE;
+				if (getnum(val, p, 1) == -1)
+					return -1;
+			}
+			else if (wcscmp(arg, L"-mtime") == 0 || wcscmp(arg, L"-ctime") == 0)
+			{
+				p->kind = (arg[1] == L'm') ? P_MTIME : P_CTIME;
+				if (getnum(val, p, 0) == -1)
+					return -1;
+			}
+			else
+				return -1;
+
+			if (p->kind == P_NAME || p->kind == P_FTYPE || p->kind == P_CREATOR)
+			{
+				p->str = utf16ToMacRoman(val);
+				if (p->str == 0)
+					return -1;
+
+				if (p->kind != P_NAME && strlen(p->str) != 4)
+				{
+					fwprintf(stderr, L"%s: %s: codes must be 4 characters\n", bargv0, val);
+					free(p->str);
+					p->str = 0;
+					return -1;
+				}
+
+				if (p->kind == P_NAME)
+				{
+					p->pat = glob_compile(p->str);
+					if (p->pat == 0)
+						return -1;
+				}
+			}
+		}
+
+		++n;
+	}
+
+	return negate ? -1 : n;
+}
+
+/*
+ * NAME:	report()
+ * DESCRIPTION:	output a matching entry
+ */
+static
+void report(const char *path, const hfsdirent *ent, int fmt)
+{
+	wchar_t *wpath;
+
+	if (fmt == OUT_JSON)
+	{
+		out_dirent(fmt, path, ent);
+		return;
+	}
+
+	wpath = macRomanToUtf16(path);
+	if (wpath == 0)
+		return;
+
+	fputws(wpath, stdout);
+	putwchar(fmt == OUT_NUL ? L'\0' : L'\n');
+
+	free(wpath);
+}
+
+/*
+ * NAME:	join()
+ * DESCRIPTION:	form "dir:name" (or "dir:" if name is 0) in a growable buffer
+ */
+static
+int join(char **buf, size_t *size, const char *dir, const char *name)
+{
+	size_t len;
+
+	len = strlen(dir) + (name ? strlen(name) : 0) + 2;
+	if (len > *size)
+	{
+		char *new;
+
+		new = realloc(*buf, len);
+		if (new == 0)
+		{
+			__ERROR(ENOMEM, 0);
+			return -1;
+		}
+
+		*buf  = new;
+		*size = len;
+	}
+
+	strcpy(*buf, dir);
+
+	if (name == 0)
+		strcat(*buf, ":");
+	else if (*name)
+	{
+		strcat(*buf, ":");
+		strcat(*buf, name);
+	}
+
+	return 0;
+}
+
+/*
+ * NAME:	search()
+ * DESCRIPTION:	evaluate the expression over every catalog record in one pass
+ */
+static
+int search(hfsvol *vol, unsigned long topid, const pred *preds, int npreds, int fmt)
+{
+	hfsdir *dir;
+	hfsdirent ents[HFIND_DIRENTS];
+	unsigned long parid = 0;
+	char *root, *path = 0, *full = 0;
+	size_t rlen, fsize = 0;
+	int count, i, state = 0, result = 0;
+	time_t now;
+
+	now = time(0);
+
+	root = hfsutil_getpath(vol, topid);
+	if (root == 0)
+		return -1;
+
+	rlen = strlen(root);
+
+	dir = hfs_opencat(vol);
+	if (dir == 0)
+	{
+		free(root);
+		return -1;
+	}
+
+	/*
+	 * Records arrive grouped by parent ID. The parent's path is looked up
+	 * (by ID, through the directory threads) only when a group has a match.
+	 * state: 0 = not yet known, 1 = inside the tree, -1 = outside it.
+	 */
+
+	while ((count = hfs_readdir_many(dir, ents, HFIND_DIRENTS)) > 0)
+	{
+		for (i = 0; i < count; ++i)
+		{
+			const hfsdirent *ent = &ents[i];
+
+			if (ent->parid != parid)
+			{
+				parid = ent->parid;
+				state = 0;
+			}
+
+			if ((state == -1 && ent->cnid != topid) ||
+					! matches(ent, preds, npreds, now))
+				continue;
+
+			if (ent->cnid == topid)
+			{
+				/* a volume's root directory is written "name:" */
+
+				if (join(&full, &fsize, root, strchr(root, ':') ? "" : 0) == -1)
+				{
+					result = -1;
+					goto done;
+				}
+
+				report(full, ent, fmt);
+				continue;
+			}
+
+			if (state == 0)
+			{
+				free(path);
+
+				path  = (parid == HFS_CNID_ROOTPAR) ? 0 : hfsutil_getpath(vol, parid);
+				state = (path && strncmp(path, root, rlen) == 0 &&
+					(path[rlen] == 0 || path[rlen] == ':')) ? 1 : -1;
+
+				if (path == 0 && parid != HFS_CNID_ROOTPAR)
+					result = -1;
+
+				if (state == -1)
+					continue;
+			}
+
+			if (join(&full, &fsize, path, ent->name) == -1)
+			{
+				result = -1;
+				goto done;
+			}
+
+			report(full, ent, fmt);
+		}
+	}
+
+	if (count == -1)
+		result = -1;
+
+done:
+	hfs_closedir(dir);
+
+	free(full);
+	free(path);
+	free(root);
+
+	return result;
+}
+
+/*
+ * NAME:	hfind->main()
+ * DESCRIPTION:	implement hfind command
+ */
+int hfind_main(int argc, wchar_t *argv[])
+{
+	hfsvol *vol;
+	pred *preds;
+	unsigned long topid;
+	int i, first = 2, npreds, fmt = OUT_TEXT, result = 0;
+
+	if (argc > 2 && argv[2][0] != L'-' && wcscmp(argv[2], L"!") != 0)
+		first = 3;
+
+	preds = calloc(argc, sizeof(pred));
+	if (preds == 0)
+	{
+		fwprintf(stderr, L"%s: not enough memory\n", bargv0);
+		return 1;
+	}
+
+	npreds = parse(argc - first, &argv[first], preds, &fmt);
+	if (npreds == -1)
+	{
+		result = usage();
+		goto done;
+	}
+
+	vol = hfsutil_remount(hcwd_getvol(-1), HFS_MODE_RDONLY);
+	if (vol == 0)
+	{
+		result = 1;
+		goto done;
+	}
+
+	topid = hfs_getcwd(vol);
+
+	if (first == 3)
+	{
+		char *path;
+		hfsdirent ent;
+
+		path = utf16ToMacRoman(argv[2]);
+		if (path == 0 || hfs_stat(vol, path, &ent) == -1)
+		{
+			hfsutil_perrorp_w(argv[2]);
+			result = 1;
+		}
+		else if (! (ent.flags & HFS_ISDIR))
+		{
+			fwprintf(stderr, L"%s: %s: not a directory\n", bargv0, argv[2]);
+			result = 1;
+		}
+		else
+			topid = ent.cnid;
+
+		free(path);
+	}
+
+	if (result == 0 && search(vol, topid, preds, npreds, fmt) == -1)
+	{
+		hfsutil_perror("Can't search catalog");
+		result = 1;
+	}
+
+	hfsutil_unmount(vol, &result);
+
+done:
+	for (i = 0; i < argc; ++i)
+	{
+		free(preds[i].str);
+
+		if (preds[i].pat)
+			glob_free(preds[i].pat);
+	}
+
+	free(preds);
+
+	return result;
+}
@@ -35,9 +35,14 @@
 # include "version.h"
 
 # include "hattrib.h"
+# include "hbatch.h"
 # include "hcd.h"
 # include "hcopy.h"
 # include "hdel.h"
+# include "hdu.h"
+# include "hexport.h"
+# include "himport.h"
+# include "hfind.h"
 # include "hformat.h"
 # include "hls.h"
 # include "hmkdir.h"
@@ -45,45 +50,105 @@
 # include "hpwd.h"
 # include "hrename.h"
 # include "hrmdir.h"
+# include "hserve.h"
 # include "humount.h"
 # include "hvol.h"
 # include "charset.h"
+# include "getopt.h"
 
 const wchar_t *argv0, *bargv0;
 
+static struct
+{
+	const wchar_t *name;
+	int(*func)(int, wchar_t *[]);
+	int state;	/* load working directory state around operation */
+} ops[] = {
+	{ L"attrib", hattrib_main, 1 },
+	{ L"batch",  hbatch_main,  0 },
+	{ L"cd",     hcd_main,     1 },
+	{ L"copy",   hcopy_main,   1 },
+	{ L"del",    hdel_main,    1 },
+	{ L"dir",    hls_main,     1 },
+	{ L"du",     hdu_main,     1 },
+	{ L"export", hexport_main, 1 },
+	{ L"find",   hfind_main,   1 },
+	{ L"format", hformat_main, 1 },
+	{ L"import", himport_main, 1 },
+	{ L"ls",     hls_main,     1 },
+	{ L"mkdir",  hmkdir_main,  1 },
+	{ L"mount",  hmount_main,  1 },
+	{ L"pwd",    hpwd_main,    1 },
+	{ L"rename", hrename_main, 1 },
+	{ L"rmdir",  hrmdir_main,  1 },
+	{ L"serve",  hserve_main,  0 },
+	{ L"umount", humount_main, 1 },
+	{ L"vol",    hvol_main,    1 },
+	{ 0,         0,            0 }
+};
+
+static int session = 0;		/* keep volumes mounted between operations */
+static hfsvol *heldvol = 0;	/* volume held mounted by the session */
+static wchar_t *heldpath = 0;
+static int heldpart = -1;
+
+/*
+ * NAME:	localop()
+ * DESCRIPTION:	tell whether an operation must run in this process
+ */
+static
+int localop(int argc, wchar_t *argv[])
+{
+	int i;
+
+	/* archives, scripts and "-" are binary or read stdin */
+
+	if (wcscmp(argv[1], L"export") == 0 || wcscmp(argv[1], L"import") == 0 ||
+			wcscmp(argv[1], L"batch") == 0)
+		return 1;
+
+	if (wcscmp(argv[1], L"copy") == 0)
+	{
+		for (i = 2; i < argc; ++i)
+		{
+			if (wcscmp(argv[i], L"-") == 0)
+				return 1;
+		}
+	}
+
+	return 0;
+}
+
 /*
  * NAME:	main()
  * DESCRIPTION:	program entry dispatch
  */
 int wmain(int argc, wchar_t *argv[])
 {
-	int i, len;
-	const wchar_t *dot;
-
-	struct
-	{
-		const wchar_t *name;
-		int(*func)(int, wchar_t *[]);
-	} list[] = {
-		{ L"attrib", hattrib_main },
-		{ L"cd",     hcd_main     },
-		{ L"copy",   hcopy_main   },
-		{ L"del",    hdel_main    },
-		{ L"dir",    hls_main     },
-		{ L"format", hformat_main },
-		{ L"ls",     hls_main     },
-		{ L"mkdir",  hmkdir_main  },
-		{ L"mount",  hmount_main  },
-		{ L"pwd",    hpwd_main    },
-		{ L"rename", hrename_main },
-		{ L"rmdir",  hrmdir_main  },
-		{ L"umount", humount_main },
-		{ L"vol",    hvol_main    },
-		{ 0,         0            }
-	};
+	int result;
 
 	suid_init();
 
+	/*
+	 * Hand the operation to a running server, if there is one. The server
+	 * has neither the client's stdin nor a binary stdout, so operations
+	 * that need them refuse to run while a server holds the volume: it
+	 * would not see their changes, or they its unflushed ones.
+	 */
+
+	if (argc >= 2 && localop(argc, argv))
+	{
+		if (hserve_running())
+		{
+			fwprintf(stderr, L"%s: volume is held by a server; stop it with \"serve -k\" first\n",
+				argv[1]);
+			return 1;
+		}
+	}
+	else if (argc >= 2 && argv[1][0] != L'-' && wcscmp(argv[1], L"serve") != 0 &&
+			hserve_forward(argc, argv, &result) == 0)
+		return result;
+
 	// force UTF-8
 	setlocale(LC_CTYPE, "UTF-8");
 	_setmode(_fileno(stdout), _O_U8TEXT);
@@ -112,39 +177,154 @@ int wmain(int argc, wchar_t *argv[])
 	}
 
 	argv0 = argv[0];
+
+	return hfsutil_run(argc, argv);
+}
+
+/*
+ * NAME:	resetopt()
+ * DESCRIPTION:	discard getopt() state left over from a previous operation
+ */
+static
+void resetopt(void)
+{
+	static wchar_t *noargs[] = { L"hfs", 0 };
+
+	optind = 0;
+	getopt(1, noargs, L"");
+}
+
+/*
+ * NAME:	release()
+ * DESCRIPTION:	unmount the volume held by the session, if any
+ */
+static
+int release(void)
+{
+	int result = 0;
+
+	if (heldvol == 0)
+		return 0;
+
+	/* this is where the session's changes reach the medium */
+
+	if (hfs_umount(heldvol) == -1)
+	{
+		hfsutil_perror("Error closing HFS volume");
+		result = -1;
+	}
+
+	free(heldpath);
+
+	heldvol  = 0;
+	heldpath = 0;
+	heldpart = -1;
+
+	return result;
+}
+
+/*
+ * NAME:	hold()
+ * DESCRIPTION:	keep a newly mounted volume mounted for the session
+ */
+static
+void hold(hfsvol *vol, mountent *ment)
+{
+	heldpath = wcsdup(ment->path);
+	if (heldpath == 0)
+		return;
+
+	heldvol  = vol;
+	heldpart = ment->partno;
+}
+
+/*
+ * NAME:	hfsutil->run()
+ * DESCRIPTION:	look up and perform a single operation
+ */
+int hfsutil_run(int argc, wchar_t *argv[])
+{
+	int i, result;
+
 	bargv0 = argv[1];
 
-	for (i = 0; list[i].name; ++i)
+	for (i = 0; ops[i].name; ++i)
 	{
-		//if (wcsncmp(bargv0, list[i].name, len) == 0)
-		if (wcscmp(bargv0, list[i].name) == 0)
-		{
-			int result;
+		if (wcscmp(bargv0, ops[i].name) != 0)
+			continue;
 
-			bargv0 = list[i].name;
+		bargv0 = ops[i].name;
 
-			if (hcwd_init() == -1)
+		if (session)
+		{
+			if (! ops[i].state)
 			{
-			  _wperror(L"Failed to initialize HFS working directories");
-			  return 1;
+				fwprintf(stderr, L"%s: not available in this mode\n", bargv0);
+				return 1;
 			}
 
-			result = list[i].func(argc, argv);
+			resetopt();
 
-			if (hcwd_finish() == -1)
-			{
-			  _wperror(L"Failed to save working directory state");
-			  return 1;
-			}
+			/* these may replace or rewrite the medium under a held volume */
+
+			if ((ops[i].func == hformat_main ||
+					ops[i].func == hmount_main ||
+					ops[i].func == humount_main) && release() == -1)
+				return 1;
+		}
 
-			return result;
+		if (ops[i].state && hcwd_init() == -1)
+		{
+			_wperror(L"Failed to initialize HFS working directories");
+			return 1;
 		}
+
+		result = ops[i].func(argc, argv);
+
+		if (ops[i].state && hcwd_finish() == -1)
+		{
+			_wperror(L"Failed to save working directory state");
+			return 1;
+		}
+
+		return result;
 	}
 
 	fwprintf(stderr, L"Unknown operation: %s\n", bargv0);
 	return 1;
 }
 
+/*
+ * NAME:	hfsutil->sync()
+ * DESCRIPTION:	flush pending changes to the volume held by the session
+ */
+int hfsutil_sync(void)
+{
+	if (heldvol && hfs_flush(heldvol) == -1)
+	{
+		hfsutil_perror("Error flushing HFS volume");
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * NAME:	hfsutil->session()
+ * DESCRIPTION:	begin or end keeping the current volume mounted
+ */
+int hfsutil_session(int enable)
+{
+	int result = 0;
+
+	if (! enable)
+		result = release();
+
+	session = enable;
+
+	return result;
+}
+
 /*
  * NAME:	hfsutil->perror()
  * DESCRIPTION:	output an HFS error
@@ -213,14 +393,28 @@ hfsvol *hfsutil_remount(mountent *ment, int flags)
 		return 0;
 	}
 
-	suid_enable();
-	vol = hfs_mount(ment->path, ment->partno, flags);
-	suid_disable();
+	if (session)
+	{
+		if (heldvol && (heldpart != ment->partno || wcscmp(heldpath, ment->path) != 0) &&
+				release() == -1)
+			return 0;
+
+		flags = HFS_MODE_ANY;
+	}
 
-	if (vol == 0)
+	if (session && heldvol)
+		vol = heldvol;
+	else
 	{
-		hfsutil_perror_w(ment->path);
-		return 0;
+		suid_enable();
+		vol = hfs_mount(ment->path, ment->partno, flags);
+		suid_disable();
+
+		if (vol == 0)
+		{
+			hfsutil_perror_w(ment->path);
+			return 0;
+		}
 	}
 
 	hfs_vstat(vol, &vent);
@@ -236,12 +430,19 @@ hfsvol *hfsutil_remount(mountent *ment, int flags)
 		fwprintf(stderr, L"%s: Expected volume \"%s\" not found\n", bargv0, ment->vname);
 		fwprintf(stderr, L"%s: Replace media on %s or use `hmount'\n", bargv0, ment->path);
 
-		hfs_umount(vol);
+		if (vol == heldvol)
+			release();
+		else
+			hfs_umount(vol);
 		free(macroman);
 		return 0;
 	}
 
 	free(macroman);
+
+	if (session && heldvol == 0)
+		hold(vol, ment);
+
 	macroman = utf16ToMacRoman(ment->cwd);
 	if (macroman == 0)
 	{
@@ -263,6 +464,11 @@ hfsvol *hfsutil_remount(mountent *ment, int flags)
  */
 void hfsutil_unmount(hfsvol *vol, int *result)
 {
+	/* a volume held by the session stays mounted until the session ends */
+
+	if (vol == heldvol)
+		return;
+
 	if (hfs_umount(vol) == -1 && *result == 0)
 	{
 		hfsutil_perror("Error closing HFS volume");
@@ -306,34 +512,17 @@ char **hfsutil_glob(hfsvol *vol, int argc, wchar_t *argv[], int *nelts, int *res
 }
 
 /*
- * NAME:	hfsutil->getcwd()
- * DESCRIPTION:	return full path to current directory (must be free()'d)
+ * NAME:	hfsutil->getpath()
+ * DESCRIPTION:	return full path to a directory (must be free()'d)
  */
-char *hfsutil_getcwd(hfsvol *vol)
+char *hfsutil_getpath(hfsvol *vol, unsigned long id)
 {
-	char *path, name[HFS_MAX_FLEN + 1 + 1];
-	long cwd;
-	int pathlen;
-
-	path    = malloc(1);
-	path[0] = 0;
-	pathlen = 0;
-	cwd     = hfs_getcwd(vol);
+	char *path = 0, *new;
+	unsigned int size;
 
-	while (cwd != HFS_CNID_ROOTPAR)
+	for (size = 256; ; size *= 2)
 	{
-		char *new;
-			int namelen, i;
-
-		if (hfs_dirinfo(vol, &cwd, name) == -1)
-			return 0;
-
-		if (pathlen)
-			strcat(name, ":");
-
-		namelen = strlen(name);
-
-		new = realloc(path, namelen + pathlen + 1);
+		new = realloc(path, size);
 		if (new == 0)
 		{
 			free(path);
@@ -341,23 +530,27 @@ char *hfsutil_getcwd(hfsvol *vol)
 			return 0;
 		}
 
-		if (pathlen == 0)
-			new[0] = 0;
-
 		path = new;
 
-		/* push string down to make room for path prefix (memmove()-ish) */
+		if (hfs_getpath(vol, id, path, size) == 0)
+			return path;
 
-		i = pathlen + 1;
-		for (new = path + namelen + pathlen; i--; new--)
-			*new = *(new - namelen);
+		if (errno != ERANGE)
+			break;
+	}
 
-		memcpy(path, name, namelen);
+	free(path);
 
-		pathlen += namelen;
-	}
+	return 0;
+}
 
-	return path;
+/*
+ * NAME:	hfsutil->getcwd()
+ * DESCRIPTION:	return full path to current directory (must be free()'d)
+ */
+char *hfsutil_getcwd(hfsvol *vol)
+{
+	return hfsutil_getpath(vol, hfs_getcwd(vol));
 }
 
 /*
@@ -30,6 +30,10 @@ void hfsutil_perror_w(const wchar_t *msg);
 void hfsutil_perrorp(const char *);
 void hfsutil_perrorp_w(const wchar_t *);
 
+int hfsutil_run(int, wchar_t *[]);
+int hfsutil_session(int);
+int hfsutil_sync(void);
+
 hfsvol *hfsutil_remount(mountent *, int);
 void hfsutil_unmount(hfsvol *, int *);
 
@@ -38,6 +42,7 @@ void hfsutil_pinfo(hfsvolent *);
 //char **hfsutil_glob(hfsvol *, int, char *[], int *, int *);
 char **hfsutil_glob(hfsvol *, int, wchar_t *[], int *, int *);
 
+char *hfsutil_getpath(hfsvol *, unsigned long);
 char *hfsutil_getcwd(hfsvol *);
 
 int hfsutil_samepath(const char *, const char *);
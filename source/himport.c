@@ -0,0 +1,995 @@
+/*
+ * hfsutils - tools for reading and writing Macintosh HFS volumes
+ * Copyright (C) 1996-1998 Robert Leslie
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * Reads the tar streams hexport writes, and those of other tar programs:
+ * ustar, pax and GNU long names. An AppleDouble entry "._name" supplies
+ * the resource fork, type, creator, Finder flags and dates of the file
+ * "name", whether it comes before or after that file's data. Each fork
+ * is allocated at its full size before it is written.
+ */
+
+# include <stdio.h>
+# include <stdlib.h>
+# include <string.h>
+# include <errno.h>
+# include <io.h>
+# include <fcntl.h>
+
+# include "hfs.h"
+# include "hcwd.h"
+# include "hfsutil.h"
+# include "data.h"
+# include "himport.h"
+# include "charset.h"
+# include "getopt.h"
+
+# define HIMPORT_BUFSZ		(256 * 1024)	/* archive input buffer */
+
+# define TAR_BLOCKSZ		512
+# define TAR_PATHMAX		4096
+# define TAR_PAXMAX		(64 * 1024)	/* largest pax header read */
+
+# define RAW_TYPE		"????"
+# define RAW_CREA		"UNIX"
+
+# define AD_MAGIC		0x00051607
+# define AS_VERSION1		0x00010000
+# define AS_VERSION		0x00020000
+
+# define AS_RSRC		2
+# define AS_DATES		8
+# define AS_FINFO		9
+
+# define AS_HEADERSZ		26
+# define AS_MAXENTRIES		64
+# define AS_EPOCH		946684800L	/* 2000-01-01 00:00 GMT */
+# define AS_NODATE		0x80000000UL
+
+typedef struct {
+	int fd;			/* archive source */
+	char *buf;
+	unsigned long pos, len;	/* unread input is buf[pos..len) */
+	unsigned long left;	/* data of the current entry not yet read */
+	unsigned long pad;	/* padding that follows it */
+} tarin;
+
+typedef struct {
+	char path[TAR_PATHMAX + 1];
+	int type;
+	unsigned long size;
+	time_t mtime;
+} tarent;
+
+typedef struct {
+	unsigned long dirid;	/* folder of the file, or 0 if none */
+	char name[HFS_MAX_FLEN + 1];
+	char type[5], creator[5];
+	short fdflags;
+	int finfo;		/* Finder info was present */
+	unsigned long crdate, mddate;	/* AppleDouble dates, or AS_NODATE */
+} adinfo;
+
+typedef struct {
+	unsigned long id, offset, length;
+} addesc;
+
+typedef struct {
+	int n;			/* folders of the previous entry's path */
+	char names[TAR_PATHMAX / 2][HFS_MAX_FLEN + 1];
+	unsigned long ids[TAR_PATHMAX / 2];
+} dircache;
+
+/*
+ * NAME:	usage()
+ * DESCRIPTION:	display usage message
+ */
+static
+int usage(void)
+{
+	fwprintf(stderr, L"Usage: import [-r] [hfs-path] < archive.tar\n");
+
+	return 1;
+}
+
+/*
+ * NAME:	fill()
+ * DESCRIPTION:	make more archive input available; return 0 at EOF
+ */
+static
+int fill(tarin *tar)
+{
+	int bytes;
+
+	if (tar->pos < tar->len)
+		return 1;
+
+	bytes = read(tar->fd, tar->buf, HIMPORT_BUFSZ);
+	if (bytes == -1)
+	{
+		__ERROR(errno, "error reading archive");
+		return -1;
+	}
+
+	tar->pos = 0;
+	tar->len = bytes;
+
+	return bytes > 0;
+}
+
+/*
+ * NAME:	take()
+ * DESCRIPTION:	consume archive bytes; a null pointer discards them
+ */
+static
+int take(tarin *tar, void *data, unsigned long len)
+{
+	unsigned long chunk;
+	int avail;
+
+	while (len)
+	{
+		avail = fill(tar);
+		if (avail == -1)
+			return -1;
+		else if (avail == 0)
+		{
+			__ERROR(EIO, "unexpected end of archive");
+			return -1;
+		}
+
+		chunk = tar->len - tar->pos;
+		if (chunk > len)
+			chunk = len;
+
+		if (data)
+		{
+			memcpy(data, tar->buf + tar->pos, chunk);
+			data = (char *) data + chunk;
+		}
+
+		tar->pos += chunk;
+		len      -= chunk;
+	}
+
+	return 0;
+}
+
+/*
+ * NAME:	get()
+ * DESCRIPTION:	read data of the current entry
+ */
+static
+int get(tarin *tar, void *data, unsigned long len)
+{
+	if (len > tar->left)
+	{
+		__ERROR(EINVAL, "entry shorter than its contents");
+		return -1;
+	}
+
+	tar->left -= len;
+
+	return take(tar, data, len);
+}
+
+/*
+ * NAME:	endent()
+ * DESCRIPTION:	skip what remains of the current entry
+ */
+static
+int endent(tarin *tar)
+{
+	unsigned long len;
+
+	len = tar->left + tar->pad;
+
+	tar->left = tar->pad = 0;
+
+	return take(tar, 0, len);
+}
+
+/*
+ * NAME:	number()
+ * DESCRIPTION:	parse a numeric tar header field
+ */
+static
+unsigned long number(const unsigned char *field, int width)
+{
+	unsigned long value = 0;
+	int i = 0;
+
+	/* GNU tar stores large values in base 256 */
+
+	if (field[0] & 0x80)
+	{
+		value = field[0] & 0x7f;
+		for (i = 1; i < width; ++i)
+			value = (value << 8) | field[i];
+
+		return value;
+	}
+
+	while (i < width && field[i] == ' ')
+		++i;
+
+	for (; i < width && field[i] >= '0' && field[i] <= '7'; ++i)
+		value = (value << 3) | (field[i] - '0');
+
+	return value;
+}
+
+/*
+ * NAME:	paxrecords()
+ * DESCRIPTION:	apply the records of a pax extended header
+ */
+static
+int paxrecords(char *pax, unsigned long len, tarent *ent, int *haspath)
+{
+	char *rec, *key, *value, *end;
+	unsigned long reclen;
+
+	for (rec = pax; rec < pax + len; rec += reclen)
+	{
+		reclen = strtoul(rec, &key, 10);
+		if (reclen == 0 || reclen > (unsigned long) (pax + len - rec) ||
+				*key != ' ' || rec[reclen - 1] != '\n')
+		{
+			__ERROR(EINVAL, "invalid pax header");
+			return -1;
+		}
+
+		++key;
+		end = rec + reclen - 1;
+
+		value = memchr(key, '=', end - key);
+		if (value == 0)
+			continue;
+
+		*value++ = 0;
+		*end     = 0;
+
+		if (strcmp(key, "path") == 0 && end - value <= TAR_PATHMAX)
+		{
+			strcpy(ent->path, value);
+			*haspath = 1;
+		}
+		else if (strcmp(key, "mtime") == 0)
+			ent->mtime = strtol(value, 0, 10);
+		else if (strcmp(key, "size") == 0)
+			ent->size = strtoul(value, 0, 10);
+	}
+
+	return 0;
+}
+
+/*
+ * NAME:	nextent()
+ * DESCRIPTION:	read the header(s) of the next entry; return 0 at the end
+ */
+static
+int nextent(tarin *tar, tarent *ent)
+{
+	unsigned char block[TAR_BLOCKSZ];
+	unsigned long sum, ssum, size;
+	int i, avail, haspath = 0, hassize = 0, hastime = 0;
+	char *data;
+	tarent ext;
+
+	while (1)
+	{
+		/* a missing end-of-archive marker is tolerated */
+
+		avail = fill(tar);
+		if (avail <= 0)
+			return avail;
+
+		if (take(tar, block, TAR_BLOCKSZ) == -1)
+			return -1;
+
+		for (i = 0; i < TAR_BLOCKSZ && block[i] == 0; ++i)
+			;
+
+		if (i == TAR_BLOCKSZ)
+			return 0;
+
+		for (sum = ssum = 0, i = 0; i < TAR_BLOCKSZ; ++i)
+		{
+			int byte = (i >= 148 && i < 156) ? ' ' : block[i];
+
+			sum  += byte;
+			ssum += (signed char) byte;
+		}
+
+		if (number(&block[148], 8) != sum && number(&block[148], 8) != ssum)
+		{
+			__ERROR(EINVAL, "invalid archive header (bad checksum)");
+			return -1;
+		}
+
+		size = number(&block[124], 12);
+
+		tar->left = size;
+		tar->pad  = (TAR_BLOCKSZ - size % TAR_BLOCKSZ) % TAR_BLOCKSZ;
+
+		switch (block[156])
+		{
+		case 'x':	/* pax header for the next entry */
+		case 'L':	/* GNU long name for the next entry */
+			if (size > (block[156] == 'x' ? TAR_PAXMAX : TAR_PATHMAX))
+			{
+				__ERROR(EINVAL, "archive header too long");
+				return -1;
+			}
+
+			data = malloc(size + 1);
+			if (data == 0)
+			{
+				__ERROR(ENOMEM, 0);
+				return -1;
+			}
+
+			if (get(tar, data, size) == -1 || endent(tar) == -1)
+			{
+				free(data);
+				return -1;
+			}
+
+			data[size] = 0;
+
+			if (block[156] == 'L')
+			{
+				strcpy(ext.path, data);
+				haspath = 1;
+			}
+			else
+			{
+				ext.size  = (unsigned long) -1;
+				ext.mtime = -1;
+
+				if (paxrecords(data, size, &ext, &haspath) == -1)
+				{
+					free(data);
+					return -1;
+				}
+
+				if (ext.size != (unsigned long) -1)
+					hassize = 1;
+				if (ext.mtime != -1)
+					hastime = 1;
+			}
+
+			free(data);
+			continue;
+
+		case 'g':	/* pax global header */
+		case 'K':	/* GNU long link name */
+			if (endent(tar) == -1)
+				return -1;
+
+			continue;
+		}
+
+		break;
+	}
+
+	ent->type  = block[156];
+	ent->size  = hassize ? ext.size : size;
+	ent->mtime = hastime ? ext.mtime : (time_t) number(&block[136], 12);
+
+	if (hassize)
+	{
+		tar->left = ent->size;
+		tar->pad  = (TAR_BLOCKSZ - ent->size % TAR_BLOCKSZ) % TAR_BLOCKSZ;
+	}
+
+	if (haspath)
+		strcpy(ent->path, ext.path);
+	else
+	{
+		int plen = 0, nlen;
+
+		/* only POSIX ustar has the prefix field */
+
+		if (memcmp(&block[257], "ustar\0", 6) == 0 && block[345])
+		{
+			plen = strnlen((char *) &block[345], 155);
+
+			memcpy(ent->path, &block[345], plen);
+			ent->path[plen++] = '/';
+		}
+
+		nlen = strnlen((char *) &block[0], 100);
+
+		memcpy(ent->path + plen, &block[0], nlen);
+		ent->path[plen + nlen] = 0;
+	}
+
+	return 1;
+}
+
+/*
+ * NAME:	splitpath()
+ * DESCRIPTION:	break an archive path into HFS names; return the count or -1
+ */
+static
+int splitpath(const char *path, char names[][HFS_MAX_FLEN + 1], int max)
+{
+	const char *comp, *end;
+	char out[TAR_PATHMAX + 1], *ptr;
+	utf8state state;
+	int n = 0, len;
+
+	for (comp = path; *comp; comp = end)
+	{
+		end = strchr(comp, '/');
+		if (end == 0)
+			end = comp + strlen(comp);
+
+		len = end - comp;
+
+		if (*end)
+			++end;
+
+		if (len == 0 || (len == 1 && comp[0] == '.'))
+			continue;
+
+		/* nothing may land outside the target folder */
+
+		if ((len == 2 && comp[0] == '.' && comp[1] == '.') || n == max)
+			return -1;
+
+		utf8StateInit(&state);
+
+		len  = utf8ToMacRomanText(&state, comp, len, out);
+		len += utf8ToMacRomanEnd(&state, out + len);
+
+		if (len > HFS_MAX_FLEN)
+			len = HFS_MAX_FLEN;
+
+		/* the reverse of the ":" hexport writes for "/" */
+
+		for (ptr = out; ptr < out + len; ++ptr)
+		{
+			if (*ptr == ':')
+				*ptr = '/';
+		}
+
+		memcpy(names[n], out, len);
+		names[n++][len] = 0;
+	}
+
+	return n;
+}
+
+/*
+ * NAME:	relname()
+ * DESCRIPTION:	make a path for an HFS name within the current folder
+ */
+static
+void relname(char *buf, const char *name)
+{
+	buf[0] = ':';
+	strcpy(buf + 1, name);
+}
+
+/*
+ * NAME:	mkdirs()
+ * DESCRIPTION:	find or make the folders of a path; return the last one's ID
+ */
+static
+unsigned long mkdirs(hfsvol *vol, unsigned long topid,
+	char names[][HFS_MAX_FLEN + 1], int n, dircache *dirs)
+{
+	hfsdirent ent;
+	unsigned long dirid = topid;
+	char path[HFS_MAX_FLEN + 2];
+	int i;
+
+	/*
+	 * Archives list the entries of a folder together, so the folders the
+	 * previous entry's path shares with this one are known already. Only
+	 * the rest are looked up, or made, and then remembered.
+	 */
+
+	for (i = 0; i < n && i < dirs->n && strcmp(names[i], dirs->names[i]) == 0; ++i)
+		dirid = dirs->ids[i];
+
+	dirs->n = i;
+
+	for (; i < n; ++i)
+	{
+		if (hfs_setcwd(vol, dirid) == -1)
+			return 0;
+
+		relname(path, names[i]);
+
+		if (hfs_stat(vol, path, &ent) == -1)
+		{
+			if (errno != ENOENT ||
+					hfs_mkdir(vol, path) == -1 ||
+					hfs_stat(vol, path, &ent) == -1)
+				return 0;
+		}
+		else if (! (ent.flags & HFS_ISDIR))
+		{
+			__ERROR(ENOTDIR, 0);
+			return 0;
+		}
+
+		dirid = ent.cnid;
+
+		strcpy(dirs->names[i], names[i]);
+		dirs->ids[i] = dirid;
+		dirs->n = i + 1;
+	}
+
+	return dirid;
+}
+
+/*
+ * NAME:	openfile()
+ * DESCRIPTION:	create a file in the current folder, or open it if asked
+ */
+static
+hfsfile *openfile(hfsvol *vol, const char *name, int reuse)
+{
+	hfsfile *file;
+	char path[HFS_MAX_FLEN + 2];
+
+	relname(path, name);
+
+	/* creating first saves a lookup for every file that is new */
+
+	file = hfs_create(vol, path, RAW_TYPE, RAW_CREA);
+	if (file || errno != EEXIST)
+		return file;
+
+	if (reuse)
+		return hfs_open(vol, path);
+
+	if (hfs_delete(vol, path) == -1)
+		return 0;
+
+	return hfs_create(vol, path, RAW_TYPE, RAW_CREA);
+}
+
+/*
+ * NAME:	putfork()
+ * DESCRIPTION:	stream entry data into a fork allocated to its full size
+ */
+static
+int putfork(tarin *tar, hfsfile *file, int fork, unsigned long size)
+{
+	unsigned long chunk, bytes;
+	int avail;
+
+	if (size > tar->left)
+	{
+		__ERROR(EINVAL, "entry shorter than its contents");
+		return -1;
+	}
+
+	if (hfs_setfork(file, fork) == -1 ||
+			hfs_seek(file, 0, HFS_SEEK_SET) == (unsigned long) -1 ||
+			hfs_allocate(file, size) == -1)
+		return -1;
+
+	while (size)
+	{
+		avail = fill(tar);
+		if (avail == -1)
+			return -1;
+		else if (avail == 0)
+		{
+			__ERROR(EIO, "unexpected end of archive");
+			return -1;
+		}
+
+		chunk = tar->len - tar->pos;
+		if (chunk > size)
+			chunk = size;
+
+		bytes = hfs_write(file, tar->buf + tar->pos, chunk);
+		if (bytes == (unsigned long) -1)
+			return -1;
+
+		tar->pos  += chunk;
+		tar->left -= chunk;
+		size      -= chunk;
+	}
+
+	/* an existing fork may have been longer */
+
+	return hfs_truncate(file, hfs_seek(file, 0, HFS_SEEK_CUR));
+}
+
+/*
+ * NAME:	setinfo()
+ * DESCRIPTION:	apply AppleDouble metadata, or a modification date, to a file
+ */
+static
+int setinfo(hfsfile *file, const adinfo *info, time_t mtime)
+{
+	hfsdirent ent;
+
+	if (hfs_fstat(file, &ent) == -1)
+		return -1;
+
+	ent.mddate = mtime;
+
+	if (info)
+	{
+		if (info->finfo)
+		{
+			memcpy(ent.u.file.type,    info->type,    5);
+			memcpy(ent.u.file.creator, info->creator, 5);
+
+			ent.fdflags = info->fdflags &
+				~(HFS_FNDR_ISONDESK | HFS_FNDR_HASBEENINITED | HFS_FNDR_RESERVED);
+		}
+
+		if (info->crdate != AS_NODATE)
+			ent.crdate = (long) info->crdate + AS_EPOCH;
+		if (info->mddate != AS_NODATE)
+			ent.mddate = (long) info->mddate + AS_EPOCH;
+	}
+
+	return hfs_fsetattr(file, &ent);
+}
+
+/*
+ * NAME:	compare_descs()
+ * DESCRIPTION:	order AppleDouble entries by offset
+ */
+static
+int compare_descs(const addesc *desc1, const addesc *desc2)
+{
+	return (desc1->offset > desc2->offset) - (desc1->offset < desc2->offset);
+}
+
+/*
+ * NAME:	putdouble()
+ * DESCRIPTION:	import an AppleDouble entry for a file in the current folder
+ */
+static
+int putdouble(hfsvol *vol, tarin *tar, const tarent *ent, const char *name,
+	adinfo *info)
+{
+	unsigned char head[AS_HEADERSZ], buf[32];
+	addesc descs[AS_MAXENTRIES];
+	unsigned long at;
+	hfsfile *file = 0;
+	int count, i;
+
+	memset(info, 0, sizeof(*info));
+
+	strcpy(info->type,    RAW_TYPE);
+	strcpy(info->creator, RAW_CREA);
+
+	info->crdate = info->mddate = AS_NODATE;
+
+	if (get(tar, head, AS_HEADERSZ) == -1)
+		return -1;
+
+	if (d_getul(&head[0]) != AD_MAGIC ||
+			(d_getul(&head[4]) != AS_VERSION && d_getul(&head[4]) != AS_VERSION1))
+	{
+		__ERROR(EINVAL, "unknown, unsupported, or corrupt AppleDouble entry");
+		return -1;
+	}
+
+	count = d_getuw(&head[24]);
+	if (count > AS_MAXENTRIES)
+	{
+		__ERROR(EINVAL, "invalid AppleDouble entry (too many entries)");
+		return -1;
+	}
+
+	for (i = 0; i < count; ++i)
+	{
+		if (get(tar, buf, 12) == -1)
+			return -1;
+
+		descs[i].id     = d_getul(&buf[0]);
+		descs[i].offset = d_getul(&buf[4]);
+		descs[i].length = d_getul(&buf[8]);
+	}
+
+	/* the entry is a stream, so its parts are visited in order */
+
+	qsort(descs, count, sizeof(addesc),
+		(int (*)(const void *, const void *)) compare_descs);
+
+	at = AS_HEADERSZ + count * 12;
+
+	file = openfile(vol, name, 1);
+	if (file == 0)
+		return -1;
+
+	for (i = 0; i < count; ++i)
+	{
+		if (descs[i].offset < at)
+			continue;
+
+		if (get(tar, 0, descs[i].offset - at) == -1)
+			goto fail;
+
+		at = descs[i].offset;
+
+		switch (descs[i].id)
+		{
+		case AS_RSRC:
+			if (putfork(tar, file, 1, descs[i].length) == -1)
+				goto fail;
+
+			at += descs[i].length;
+			break;
+
+		case AS_DATES:
+			if (descs[i].length < 8)
+				break;
+
+			if (get(tar, buf, 8) == -1)
+				goto fail;
+
+			info->crdate = d_getul(&buf[0]);
+			info->mddate = d_getul(&buf[4]);
+
+			at += 8;
+			break;
+
+		case AS_FINFO:
+			if (descs[i].length < 10)
+				break;
+
+			if (get(tar, buf, 10) == -1)
+				goto fail;
+
+			memcpy(info->type,    &buf[0], 4);
+			memcpy(info->creator, &buf[4], 4);
+			info->fdflags = d_getsw(&buf[8]);
+			info->finfo   = 1;
+
+			at += 10;
+			break;
+		}
+	}
+
+	if (setinfo(file, info, ent->mtime) == -1)
+		goto fail;
+
+	return hfs_close(file);
+
+fail:
+	hfs_close(file);
+	return -1;
+}
+
+/*
+ * NAME:	putentry()
+ * DESCRIPTION:	import one archive entry below the target folder
+ */
+static
+int putentry(hfsvol *vol, tarin *tar, const tarent *ent, unsigned long topid,
+	int raw, adinfo *pending, dircache *dirs)
+{
+	static char names[TAR_PATHMAX / 2][HFS_MAX_FLEN + 1];
+	unsigned long dirid;
+	const char *name;
+	hfsfile *file;
+	int n, isdir, reuse;
+
+	isdir = (ent->type == '5' ||
+		(ent->path[0] && ent->path[strlen(ent->path) - 1] == '/'));
+
+	if (! isdir && ent->type != '0' && ent->type != 0 && ent->type != '7')
+	{
+		fwprintf(stderr, L"%s: skipping \"%hs\": unsupported entry type\n",
+			bargv0, ent->path);
+		return 0;
+	}
+
+	n = splitpath(ent->path, names, TAR_PATHMAX / 2);
+	if (n == -1)
+	{
+		__ERROR(EINVAL, "path leaves the target folder");
+		return -1;
+	}
+	else if (n == 0)
+		return 0;
+
+	dirid = mkdirs(vol, topid, names, isdir ? n : n - 1, dirs);
+	if (dirid == 0 || isdir)
+		return dirid ? 0 : -1;
+
+	if (hfs_getcwd(vol) != dirid && hfs_setcwd(vol, dirid) == -1)
+		return -1;
+
+	name = names[n - 1];
+
+	if (! raw && strncmp(name, "._", 2) == 0 && name[2])
+	{
+		if (putdouble(vol, tar, ent, name + 2, pending) == -1)
+		{
+			pending->dirid = 0;
+			return -1;
+		}
+
+		pending->dirid = dirid;
+		strcpy(pending->name, name + 2);
+
+		return 0;
+	}
+
+	/* data that follows its AppleDouble entry joins the file it made */
+
+	reuse = (pending->dirid == dirid && strcmp(pending->name, name) == 0);
+
+	file = openfile(vol, name, reuse);
+	if (file == 0)
+		return -1;
+
+	if (putfork(tar, file, 0, ent->size) == -1 ||
+			setinfo(file, reuse ? pending : 0, ent->mtime) == -1)
+	{
+		hfs_close(file);
+		return -1;
+	}
+
+	pending->dirid = 0;
+
+	return hfs_close(file);
+}
+
+/*
+ * NAME:	himport->main()
+ * DESCRIPTION:	implement himport command
+ */
+int himport_main(int argc, wchar_t *argv[])
+{
+	hfsvol *vol;
+	hfsdirent dir;
+	tarin tar;
+	tarent *ent = 0;
+	adinfo pending;
+	dircache *dirs = 0;
+	unsigned long cwd;
+	int raw = 0, found, result = 0;
+
+	optind = 2;
+
+	while (1)
+	{
+		int opt;
+
+		opt = getopt(argc, argv, L"r?");
+		if (opt == EOF)
+			break;
+
+		switch (opt)
+		{
+		case 'r':
+			raw = 1;
+			break;
+
+		case '?':
+			return usage();
+		}
+	}
+
+	if (argc - optind > 1)
+		return usage();
+
+	if (_isatty(_fileno(stdin)))
+	{
+		fwprintf(stderr, L"%s: refusing to read an archive from a terminal\n", bargv0);
+		return 1;
+	}
+
+	vol = hfsutil_remount(hcwd_getvol(-1), HFS_MODE_ANY);
+	if (vol == 0)
+		return 1;
+
+	cwd = hfs_getcwd(vol);
+
+	if (argc - optind == 1)
+	{
+		char *path;
+
+		path = utf16ToMacRoman(argv[optind]);
+		if (path == 0 || hfs_stat(vol, path, &dir) == -1)
+		{
+			hfsutil_perrorp_w(argv[optind]);
+			result = 1;
+		}
+		else if (! (dir.flags & HFS_ISDIR))
+		{
+			fwprintf(stderr, L"%s: %s: not a directory\n", bargv0, argv[optind]);
+			result = 1;
+		}
+
+		free(path);
+	}
+	else
+		dir.cnid = cwd;
+
+	tar.buf = 0;
+
+	if (result == 0)
+	{
+		tar.buf  = malloc(HIMPORT_BUFSZ);
+		ent      = malloc(sizeof(tarent));
+		dirs     = malloc(sizeof(dircache));
+		tar.fd   = _fileno(stdin);
+		tar.pos  = tar.len = 0;
+		tar.left = tar.pad = 0;
+
+		if (tar.buf == 0 || ent == 0 || dirs == 0)
+		{
+			fwprintf(stderr, L"%s: not enough memory\n", bargv0);
+			result = 1;
+		}
+	}
+
+	if (result == 0)
+	{
+		_setmode(tar.fd, _O_BINARY);
+
+		pending.dirid = 0;
+		dirs->n = 0;
+
+		while ((found = nextent(&tar, ent)) == 1)
+		{
+			/* a failed entry is skipped; a damaged archive ends the import */
+
+			if (putentry(vol, &tar, ent, dir.cnid, raw, &pending, dirs) == -1)
+			{
+				hfsutil_perrorp(ent->path);
+				result = 1;
+			}
+
+			if (endent(&tar) == -1)
+			{
+				found = -1;
+				break;
+			}
+		}
+
+		if (found == -1)
+		{
+			hfsutil_perror("Can't read archive");
+			result = 1;
+		}
+	}
+
+	if (hfs_setcwd(vol, cwd) == -1 && result == 0)
+	{
+		hfsutil_perror("Can't restore current directory");
+		result = 1;
+	}
+
+	free(tar.buf);
+	free(ent);
+	free(dirs);
+
+	hfsutil_unmount(vol, &result);
+
+	return result;
+}
@@ -33,6 +33,7 @@
 # include "dstring.h"
 # include "hls.h"
 # include "charset.h"
+# include "output.h"
 # include "getopt.h"
 
 int ioctl(int, int, ...);
@@ -64,9 +65,17 @@ int ioctl(int, int, ...);
 # define T_CREATE		0x0008
 
 # define S_MASK			0x0030
-# define S_NAME			0x0000
-# define S_TIME			0x0010
-# define S_SIZE			0x0020
+# define S_NONE			0x0000
+# define S_NAME			0x0010
+# define S_TIME			0x0020
+# define S_SIZE			0x0030
+
+# define O_MASK			0x00c0
+# define O_SHIFT		6
+# define O_JSON			(OUT_JSON << O_SHIFT)
+# define O_NUL			(OUT_NUL  << O_SHIFT)
+
+# define HLS_DIRENTS		32	/* directory entries read per call */
 
 # define PATH(ent)	((ent).path ? (ent).path : (ent).dirent.name)
 
@@ -84,6 +93,7 @@ static
 int usage(void)
 {
 	fwprintf(stderr, L"Usage: ls [options] [hfs-path ...]\n");
+	fwprintf(stderr, L"       ls -J | -0 [-adR] [hfs-path ...]\n");
 
 	return 1;
 }
@@ -671,6 +681,326 @@ int showfiles(darray *files, int flags, int options, int width)
 	return result;
 }
 
+/*
+ * NAME:	joinpath()
+ * DESCRIPTION:	form the path of a directory entry
+ */
+static
+int joinpath(dstring *str, const char *path, const char *name)
+{
+	dstr_shrink(str, 0);
+
+	if (strchr(path, ':') == 0 && dstr_append(str, ":", 1) == -1)
+		return -1;
+
+	if (dstr_append(str, path, -1) == -1)
+		return -1;
+
+	if (path[strlen(path) - 1] != ':' && dstr_append(str, ":", 1) == -1)
+		return -1;
+
+	return dstr_append(str, name, -1);
+}
+
+/*
+ * NAME:	streamable()
+ * DESCRIPTION:	return 1 iff a recursive listing can be written in catalog order
+ */
+static
+int streamable(queueent *dirs, int dsz, int flags, int options)
+{
+	int i;
+
+	if (! (flags & HLS_RECURSIVE))
+		return 0;
+
+	if (! (options & O_MASK) && ((options & S_MASK) != S_NONE ||
+			((options & F_MASK) != F_LONG && (options & F_MASK) != F_ONE)))
+		return 0;
+
+	/*
+	 * A catalog pass reads every record on the volume, so it only pays
+	 * off when the whole volume is listed; smaller trees are walked.
+	 */
+
+	for (i = 0; i < dsz; ++i)
+	{
+		if (dirs[i].dirent.cnid != HFS_CNID_ROOTDIR)
+			return 0;
+	}
+
+	return dsz > 0;
+}
+
+/*
+ * NAME:	findid()
+ * DESCRIPTION:	return 1 iff a sorted list of directory IDs contains an ID
+ */
+static
+int findid(darray *ids, unsigned long id)
+{
+	unsigned long *list;
+	unsigned int lo = 0, hi, mid;
+
+	list = darr_array(ids);
+	hi   = darr_size(ids);
+
+	while (lo < hi)
+	{
+		mid = (lo + hi) / 2;
+
+		if (list[mid] == id)
+			return 1;
+		else if (list[mid] < id)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return 0;
+}
+
+/*
+ * NAME:	addid()
+ * DESCRIPTION:	insert a directory ID into a sorted list
+ */
+static
+int addid(darray *ids, unsigned long id)
+{
+	unsigned long *list;
+	unsigned int i;
+
+	if (darr_append(ids, &id) == 0)
+		return -1;
+
+	list = darr_array(ids);
+
+	for (i = darr_size(ids) - 1; i > 0 && list[i - 1] > id; --i)
+		list[i] = list[i - 1];
+
+	list[i] = id;
+
+	return 0;
+}
+
+/*
+ * NAME:	showable()
+ * DESCRIPTION:	return 1 iff every directory of a path is visible
+ */
+static
+int showable(hfsvol *vol, char *path)
+{
+	hfsdirent ent;
+	char *ptr, save;
+
+	for (ptr = strchr(path, ':'); ptr && *ptr; )
+	{
+		ptr = strchr(ptr + 1, ':');
+		if (ptr == 0)
+			ptr = path + strlen(path);
+
+		save = *ptr;
+		*ptr = 0;
+
+		if (hfs_stat(vol, path, &ent) == -1)
+			ent.fdflags = HFS_FNDR_ISINVISIBLE;
+
+		*ptr = save;
+
+		if (ent.fdflags & HFS_FNDR_ISINVISIBLE)
+			return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * NAME:	stream()
+ * DESCRIPTION:	list the whole volume in a single pass over the catalog
+ */
+static
+int stream(hfsvol *vol, queueent *top, darray *files, int flags, int options, int width)
+{
+	hfsdir *dir;
+	hfsdirent dirents[HLS_DIRENTS];
+	queueent ent;
+	dstring str, head;
+	darray *hidden;
+	unsigned long parid = 0, id;
+	char name[HFS_MAX_FLEN + 1], *path = 0, *rel;
+	int fmt, show = 0, count, j, done, result = 0;
+	wchar_t *wpath;
+
+	fmt = (options & O_MASK) >> O_SHIFT;
+
+	hidden = darr_new(sizeof(unsigned long));
+	dir    = hidden ? hfs_opencat(vol) : 0;
+	if (dir == 0)
+	{
+		hfsutil_perrorp(PATH(*top));
+
+		if (hidden)
+			darr_free(hidden);
+
+		return -1;
+	}
+
+	dstr_init(&str);
+	dstr_init(&head);
+	darr_shrink(files, 0);
+
+	/*
+	 * Catalog records are ordered by parent ID, so each directory's
+	 * entries arrive together; they are written a batch at a time.
+	 * Directories found hidden, or inside a hidden one, are remembered
+	 * as their parent's entries go by. A directory whose parent comes
+	 * later in the catalog is checked by path instead.
+	 */
+
+	while ((count = hfs_readdir_many(dir, dirents, HLS_DIRENTS)) > 0)
+	{
+		for (j = 0; j < count; ++j)
+		{
+			ent.dirent = dirents[j];
+			ent.path   = 0;
+			ent.free   = 0;
+
+			if (ent.dirent.parid != parid)
+			{
+				if (darr_size(files) && showfiles(files, flags, options, width) == -1)
+					result = -1;
+
+				darr_shrink(files, 0);
+
+				parid = ent.dirent.parid;
+				free(path);
+				path = 0;
+				show = 0;
+
+				if (parid == HFS_CNID_ROOTPAR)
+					continue;
+
+				path = hfsutil_getpath(vol, parid);
+				if (path == 0)
+				{
+					hfsutil_perror("Can't get HFS directory path");
+					result = -1;
+					continue;
+				}
+
+				id = parid;
+
+				if (parid == HFS_CNID_ROOTDIR || (flags & HLS_ALL_FILES))
+					show = 1;
+				else if (hfs_dirinfo(vol, &id, name) == -1)
+					show = showable(vol, path);
+				else if (id < parid)
+					show = ! findid(hidden, parid);
+				else
+					show = showable(vol, path);
+
+				/* headings and paths are relative to the path given */
+
+				rel = strchr(path, ':');
+				rel = (rel && rel[1]) ? rel + 1 : 0;
+
+				if (rel)
+					done = joinpath(&head, PATH(*top), rel);
+				else
+				{
+					dstr_shrink(&head, 0);
+					done = dstr_append(&head, PATH(*top), -1);
+				}
+
+				if (done == -1)
+				{
+					result = -1;
+					break;
+				}
+
+				if (show && fmt == OUT_TEXT)
+				{
+					if (flags & HLS_SPACE)
+						wprintf(L"\n");
+
+					if (rel || (flags & HLS_NAME))
+					{
+						wpath = macRomanToUtf16(dstr_string(&head));
+						if (wpath != 0)
+						{
+							wprintf(L"%s%s", wpath,
+								wpath[wcslen(wpath) - 1] == L':' ? L"\n" : L":\n");
+							free(wpath);
+						}
+					}
+
+					flags |= HLS_NAME | HLS_SPACE;
+				}
+			}
+
+			if (path == 0)
+				continue;
+
+			if ((ent.dirent.flags & HFS_ISDIR) && ! (flags & HLS_ALL_FILES) &&
+				(! show || (ent.dirent.fdflags & HFS_FNDR_ISINVISIBLE)) &&
+				addid(hidden, ent.dirent.cnid) == -1)
+			{
+				result = -1;
+				break;
+			}
+
+			if (! show)
+				continue;
+
+			if ((ent.dirent.fdflags & HFS_FNDR_ISINVISIBLE) &&
+				! (flags & HLS_ALL_FILES))
+				continue;
+
+			if (fmt != OUT_TEXT)
+			{
+				if (joinpath(&str, dstr_string(&head), ent.dirent.name) == -1)
+				{
+					result = -1;
+					break;
+				}
+
+				out_dirent(fmt, dstr_string(&str), &ent.dirent);
+			}
+			else if (darr_append(files, &ent) == 0)
+			{
+				result = -1;
+				break;
+			}
+		}
+
+		if (j < count)
+		{
+			fwprintf(stderr, L"ls: not enough memory\n");
+			break;
+		}
+
+		if (darr_size(files) && showfiles(files, flags, options, width) == -1)
+			result = -1;
+
+		darr_shrink(files, 0);
+	}
+
+	if (count == -1)
+	{
+		hfsutil_perrorp(PATH(*top));
+		result = -1;
+	}
+
+	hfs_closedir(dir);
+
+	dstr_free(&str);
+	dstr_free(&head);
+	darr_free(hidden);
+	free(path);
+
+	return result;
+}
+
 /*
  * NAME:	process()
  * DESCRIPTION:	sort and display results
@@ -678,15 +1008,27 @@ int showfiles(darray *files, int flags, int options, int width)
 static
 int process(hfsvol *vol, darray *dirs, darray *files, int flags, int options, int width)
 {
-	int i, dsz, fsz;
+	int i, dsz, fsz, fmt;
 	queueent *ents;
 	int result = 0;
 	wchar_t *wpath = 0;
+	dstring str;
 
 	dsz = darr_size(dirs);
 	fsz = darr_size(files);
 
-	if (fsz)
+	fmt = (options & O_MASK) >> O_SHIFT;
+
+	if (fsz && fmt != OUT_TEXT)
+	{
+		/* structured output is written in catalog order as it is read */
+
+		ents = darr_array(files);
+
+		for (i = 0; i < fsz; ++i)
+			out_dirent(fmt, PATH(ents[i]), &ents[i].dirent);
+	}
+	else if (fsz)
 	{
 		sortfiles(files, flags, options);
 		if (showfiles(files, flags, options, width) == -1)
@@ -699,11 +1041,31 @@ int process(hfsvol *vol, darray *dirs, darray *files, int flags, int options, in
 
 	ents = darr_array(dirs);
 
+	if (streamable(ents, dsz, flags, options))
+	{
+		if (fsz)
+			flags |= HLS_SPACE;
+
+		for (i = 0; i < dsz; ++i)
+		{
+			if (stream(vol, &ents[i], files, flags, options, width) == -1)
+				result = -1;
+
+			flags |= HLS_SPACE;
+		}
+
+		return result;
+	}
+
+	dstr_init(&str);
+
 	for (i = 0; i < dsz; ++i)
 	{
 		const char *path;
 		hfsdir *dir;
+		hfsdirent dirents[HLS_DIRENTS];
 		queueent ent;
+		int count, j;
 
 		darr_shrink(files, 0);
 
@@ -716,64 +1078,70 @@ int process(hfsvol *vol, darray *dirs, darray *files, int flags, int options, in
 			continue;
 		}
 
-		while (hfs_readdir(dir, &ent.dirent) != -1)
+		while ((count = hfs_readdir_many(dir, dirents, HLS_DIRENTS)) > 0)
 		{
-			if ((ent.dirent.fdflags & HFS_FNDR_ISINVISIBLE) &&
-				! (flags & HLS_ALL_FILES))
-				continue;
-
-			ent.path = 0;
-			ent.free = 0;
-
-			if (darr_append(files, &ent) == 0)
+			for (j = 0; j < count; ++j)
 			{
-				fwprintf(stderr, L"ls: not enough memory\n");
-				result = -1;
-				break;
-			}
+				ent.dirent = dirents[j];
 
-			if ((ent.dirent.flags & HFS_ISDIR) && (flags & HLS_RECURSIVE))
-			{
-				dstring str;
-
-				dstr_init(&str);
-
-				if (strchr(path, ':') == 0 && dstr_append(&str, ":", 1) == -1)
-					result = -1;
-
-				if (dstr_append(&str, path, -1) == -1)
-					result = -1;
-
-				if (path[strlen(path) - 1] != ':' && dstr_append(&str, ":", 1) == -1)
-					result = -1;
+				if ((ent.dirent.fdflags & HFS_FNDR_ISINVISIBLE) &&
+					! (flags & HLS_ALL_FILES))
+					continue;
 
-				if (dstr_append(&str, ent.dirent.name, -1) == -1)
-					result = -1;
+				ent.path = 0;
+				ent.free = 0;
 
-				ent.path = strdup(dstr_string(&str));
-				if (ent.path)
-					ent.free = dpfree;
-				else
-					result = -1;
-
-				dstr_free(&str);
-
-				if (darr_append(dirs, &ent) == 0)
+				if (fmt != OUT_TEXT)
 				{
-					result = -1;
-					if (ent.path)
-						free(ent.path);
-				}
+					if (joinpath(&str, path, ent.dirent.name) == -1)
+					{
+						fwprintf(stderr, L"ls: not enough memory\n");
+						result = -1;
+						break;
+					}
 
-				if (result)
+					out_dirent(fmt, dstr_string(&str), &ent.dirent);
+				}
+				else if (darr_append(files, &ent) == 0)
 				{
 					fwprintf(stderr, L"ls: not enough memory\n");
+					result = -1;
 					break;
 				}
 
-				dsz	= darr_size(dirs);
-				ents = darr_array(dirs);
+				if ((ent.dirent.flags & HFS_ISDIR) && (flags & HLS_RECURSIVE))
+				{
+					if (joinpath(&str, path, ent.dirent.name) == -1)
+						result = -1;
+					else
+					{
+						ent.path = strdup(dstr_string(&str));
+						if (ent.path)
+							ent.free = dpfree;
+						else
+							result = -1;
+					}
+
+					if (result == 0 && darr_append(dirs, &ent) == 0)
+					{
+						result = -1;
+						free(ent.path);
+					}
+
+					if (result)
+					{
+						fwprintf(stderr, L"ls: not enough memory\n");
+						break;
+					}
+
+					dsz	= darr_size(dirs);
+					ents = darr_array(dirs);
+					path = PATH(ents[i]);
+				}
 			}
+
+			if (j < count)
+				break;
 		}
 
 		hfs_closedir(dir);
@@ -781,6 +1149,9 @@ int process(hfsvol *vol, darray *dirs, darray *files, int flags, int options, in
 		if (result)
 			break;
 
+		if (fmt != OUT_TEXT)
+			continue;
+
 		if (flags & HLS_SPACE)
 			wprintf(L"\n");
 		if (flags & HLS_NAME)
@@ -800,6 +1171,8 @@ int process(hfsvol *vol, darray *dirs, darray *files, int flags, int options, in
 		flags |= HLS_NAME | HLS_SPACE;
 	}
 
+	dstr_free(&str);
+
 	return result;
 }
 
@@ -849,6 +1222,7 @@ int hls_main(int argc, wchar_t *argv[])
 	darray *dirs, *files;
 
 	options = T_MOD | S_NAME;
+	flags	= 0;
 
 	if (isatty(STDOUT_FILENO))
 	{
@@ -880,7 +1254,7 @@ int hls_main(int argc, wchar_t *argv[])
 	{
 		int opt;
 
-		opt = getopt(argc, argv, L"1abcdfilmqrstxw:CFNQRSU?");
+		opt = getopt(argc, argv, L"01abcdfilmqrstxw:CFJNQRSU?");
 		if (opt == EOF)
 			break;
 
@@ -889,6 +1263,10 @@ int hls_main(int argc, wchar_t *argv[])
 		case '?':
 			return usage();
 
+		case '0':
+			options = (options & ~O_MASK) | O_NUL;
+			break;
+
 		case '1':
 			options = (options & ~F_MASK) | F_ONE;
 			break;
@@ -964,6 +1342,10 @@ int hls_main(int argc, wchar_t *argv[])
 			flags |= HLS_INDICATOR;
 			break;
 
+		case 'J':
+			options = (options & ~O_MASK) | O_JSON;
+			break;
+
 		case 'N':
 			flags &= ~(HLS_ESCAPE | HLS_QMARK_CTRL);
 			break;
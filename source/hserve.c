@@ -0,0 +1,433 @@
+/*
+ * hfsutils - tools for reading and writing Macintosh HFS volumes
+ * Copyright (C) 1996-1998 Robert Leslie
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * A server holds the current volume mounted and performs operations sent
+ * to it over a named pipe. A request is a sequence of NUL-terminated
+ * UTF-16 strings: the argument count in decimal, the client's working
+ * directory, then the arguments starting with the operation name. The
+ * server runs the operation in that directory, so relative host paths
+ * mean what they did to the client. The reply is the operation's output
+ * (UTF-8) followed by a trailer of TRAILERSZ bytes: a NUL byte and the
+ * exit status in decimal, padded with leading spaces. Output may contain
+ * NUL bytes itself (-0, -print0), so the client always holds back the
+ * last TRAILERSZ bytes it has received.
+ */
+
+# include <stdio.h>
+# include <stdlib.h>
+# include <string.h>
+# include <io.h>
+# include <direct.h>
+# include <fcntl.h>
+# include <windows.h>
+
+# include "hfs.h"
+# include "hcwd.h"
+# include "hfsutil.h"
+# include "hserve.h"
+# include "getopt.h"
+
+# define DEFPIPE	L"\\\\.\\pipe\\hfsutils"
+# define PIPEBUFSZ	4096
+# define TRAILERSZ	12	/* NUL and exit status ending a reply */
+
+# define MAXREQ		32768	/* request size in wide characters */
+# define MAXARGS	256
+
+/*
+ * NAME:	request()
+ * DESCRIPTION:	send an operation to a server and relay its reply
+ */
+static
+int request(const wchar_t *name, int argc, wchar_t *argv[], int *result)
+{
+	HANDLE pipe;
+	wchar_t count[16], *cwd;
+	char buf[PIPEBUFSZ + TRAILERSZ + 1];
+	DWORD len, held = 0;
+	int n;
+
+	/*
+	 * Only a missing pipe lets the operation run locally. A busy server
+	 * is waited for however long it takes, since it holds the volume
+	 * mounted and a local write would go behind its caches.
+	 */
+
+	while (1)
+	{
+		pipe = CreateFileW(name, GENERIC_READ | GENERIC_WRITE, 0, 0,
+			OPEN_EXISTING, 0, 0);
+		if (pipe != INVALID_HANDLE_VALUE)
+			break;
+
+		if (GetLastError() == ERROR_FILE_NOT_FOUND)
+			return -1;
+
+		if (GetLastError() != ERROR_PIPE_BUSY)
+		{
+			fwprintf(stderr, L"%s: can't connect to server on %s\n", argv[0], name);
+			*result = 1;
+
+			return 0;
+		}
+
+		if (! WaitNamedPipeW(name, NMPWAIT_WAIT_FOREVER) &&
+				GetLastError() == ERROR_FILE_NOT_FOUND)
+			return -1;
+	}
+
+	swprintf(count, 16, L"%d", argc);
+
+	if (! WriteFile(pipe, count, (DWORD) (wcslen(count) + 1) * sizeof(wchar_t), &len, 0))
+		goto fail;
+
+	cwd = _wgetcwd(0, 0);
+	if (cwd == 0)
+	{
+		CloseHandle(pipe);
+
+		fwprintf(stderr, L"%s: can't get current directory\n", argv[0]);
+		*result = 1;
+
+		return 0;
+	}
+
+	n = WriteFile(pipe, cwd, (DWORD) (wcslen(cwd) + 1) * sizeof(wchar_t), &len, 0);
+	free(cwd);
+
+	if (! n)
+		goto fail;
+
+	for (n = 0; n < argc; ++n)
+	{
+		if (! WriteFile(pipe, argv[n],
+				(DWORD) (wcslen(argv[n]) + 1) * sizeof(wchar_t), &len, 0))
+			goto fail;
+	}
+
+	_setmode(_fileno(stdout), _O_BINARY);
+
+	while (ReadFile(pipe, buf + held, PIPEBUFSZ, &len, 0) && len > 0)
+	{
+		held += len;
+
+		if (held > TRAILERSZ)
+		{
+			fwrite(buf, 1, held - TRAILERSZ, stdout);
+			memmove(buf, buf + held - TRAILERSZ, TRAILERSZ);
+
+			held = TRAILERSZ;
+		}
+	}
+
+	fflush(stdout);
+
+	if (held < TRAILERSZ || buf[0] != 0)
+		goto fail;
+
+	buf[TRAILERSZ] = 0;
+	*result = atoi(buf + 1);
+
+	CloseHandle(pipe);
+
+	return 0;
+
+fail:
+	CloseHandle(pipe);
+
+	fflush(stdout);
+	fwprintf(stderr, L"%s: lost connection to server on %s\n", argv[0], name);
+	*result = 1;
+
+	return 0;
+}
+
+/*
+ * NAME:	readreq()
+ * DESCRIPTION:	read a request from a client; return argument count or -1
+ */
+static
+int readreq(HANDLE pipe, wchar_t *req, wchar_t **cwd, wchar_t *argv[])
+{
+	DWORD len, got = 0;
+	wchar_t *ptr, *end;
+	int argc = -1, n = 0;
+
+	ptr = req;
+
+	while (1)
+	{
+		/* scan complete strings received so far */
+
+		end = req + got / sizeof(wchar_t);
+
+		while (ptr < end && wmemchr(ptr, 0, end - ptr))
+		{
+			if (argc == -1)
+			{
+				argc = _wtoi(ptr);
+				if (argc < 1 || argc > MAXARGS - 2)
+					return -1;
+
+				*cwd = 0;
+			}
+			else if (*cwd == 0)
+				*cwd = ptr;
+			else
+				argv[++n] = ptr;
+
+			ptr += wcslen(ptr) + 1;
+
+			if (n == argc)
+			{
+				argv[0]        = L"hfs";
+				argv[argc + 1] = 0;
+
+				return argc + 1;
+			}
+		}
+
+		if (got >= MAXREQ * sizeof(wchar_t) ||
+				! ReadFile(pipe, (char *) req + got,
+					MAXREQ * sizeof(wchar_t) - got, &len, 0) || len == 0)
+			return -1;
+
+		got += len;
+	}
+}
+
+/*
+ * NAME:	serveone()
+ * DESCRIPTION:	perform one operation for a connected client
+ */
+static
+int serveone(HANDLE pipe, int *stop)
+{
+	static wchar_t req[MAXREQ];
+	wchar_t *argv[MAXARGS], *cwd, *home;
+	char status[16];
+	DWORD len;
+	int argc, fd = -1, out, err, result;
+
+	argc = readreq(pipe, req, &cwd, argv);
+	if (argc == -1)
+		return -1;
+
+	if (wcscmp(argv[1], L"serve") == 0)
+	{
+		*stop  = 1;
+		result = 0;
+	}
+	else
+	{
+		fd = _open_osfhandle((intptr_t) pipe, _O_WRONLY);
+		if (fd == -1)
+			return -1;
+
+		/* send the operation's stdout and stderr to the client */
+
+		fflush(stdout);
+		fflush(stderr);
+
+		out = _dup(_fileno(stdout));
+		err = _dup(_fileno(stderr));
+
+		_dup2(fd, _fileno(stdout));
+		_dup2(fd, _fileno(stderr));
+		_setmode(_fileno(stdout), _O_U8TEXT);
+		_setmode(_fileno(stderr), _O_U8TEXT);
+
+		/* resolve host paths against the client's directory */
+
+		home = _wgetcwd(0, 0);
+
+		if (home == 0 || _wchdir(cwd) == -1)
+		{
+			_wperror(cwd);
+			result = 1;
+		}
+		else
+		{
+			result = hfsutil_run(argc, argv);
+
+			if (hfsutil_sync() == -1 && result == 0)
+				result = 1;
+
+			_wchdir(home);
+		}
+
+		free(home);
+
+		fflush(stdout);
+		fflush(stderr);
+
+		_dup2(out, _fileno(stdout));
+		_dup2(err, _fileno(stderr));
+		_close(out);
+		_close(err);
+
+		_setmode(_fileno(stdout), _O_U8TEXT);
+		_setmode(_fileno(stderr), _O_U8TEXT);
+	}
+
+	status[0] = 0;
+	sprintf(status + 1, "%*d", TRAILERSZ - 1, result);
+
+	WriteFile(pipe, status, TRAILERSZ, &len, 0);
+	FlushFileBuffers(pipe);
+	DisconnectNamedPipe(pipe);
+
+	/* the descriptor, once opened, owns the pipe handle */
+
+	if (fd != -1)
+		_close(fd);
+	else
+		CloseHandle(pipe);
+
+	return 0;
+}
+
+/*
+ * NAME:	usage()
+ * DESCRIPTION:	display usage message
+ */
+static
+int usage(void)
+{
+	fwprintf(stderr, L"Usage: serve [-k] [pipe-name]\n");
+	return 1;
+}
+
+/*
+ * NAME:	hserve->main()
+ * DESCRIPTION:	implement hserve command
+ */
+int hserve_main(int argc, wchar_t *argv[])
+{
+	const wchar_t *name = DEFPIPE;
+	wchar_t *stopargv[] = { L"serve", 0 };
+	HANDLE pipe;
+	int quit = 0, stop = 0, result = 0;
+
+	optind = 2;
+
+	while (1)
+	{
+		int opt;
+
+		opt = getopt(argc, argv, L"k?");
+		if (opt == EOF)
+			break;
+
+		switch (opt)
+		{
+			case 'k':
+				quit = 1;
+				break;
+
+			case '?':
+				return usage();
+		}
+	}
+
+	if (argc - optind > 1)
+		return usage();
+
+	if (argc - optind == 1)
+		name = argv[optind];
+
+	if (quit)
+	{
+		if (request(name, 1, stopargv, &result) == -1)
+		{
+			fwprintf(stderr, L"%s: no server is running on %s\n", bargv0, name);
+			return 1;
+		}
+
+		return result;
+	}
+
+	fwprintf(stderr, L"%s: serving on %s\n", bargv0, name);
+
+	hfsutil_session(1);
+
+	while (! stop)
+	{
+		pipe = CreateNamedPipeW(name, PIPE_ACCESS_DUPLEX,
+			PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+			1, PIPEBUFSZ, PIPEBUFSZ, 0, 0);
+		if (pipe == INVALID_HANDLE_VALUE)
+		{
+			fwprintf(stderr, L"%s: can't create pipe %s\n", bargv0, name);
+			result = 1;
+			break;
+		}
+
+		if (! ConnectNamedPipe(pipe, 0) && GetLastError() != ERROR_PIPE_CONNECTED)
+		{
+			CloseHandle(pipe);
+			continue;
+		}
+
+		if (serveone(pipe, &stop) == -1)
+		{
+			DisconnectNamedPipe(pipe);
+			CloseHandle(pipe);
+		}
+	}
+
+	if (hfsutil_session(0) == -1)
+		result = 1;
+
+	return result;
+}
+
+/*
+ * NAME:	hserve->forward()
+ * DESCRIPTION:	pass an operation to the server named by HFSUTILS_PIPE
+ */
+int hserve_forward(int argc, wchar_t *argv[], int *result)
+{
+	const wchar_t *name;
+
+	name = _wgetenv(L"HFSUTILS_PIPE");
+	if (name == 0 || *name == 0)
+		return -1;
+
+	return request(name, argc - 1, argv + 1, result);
+}
+
+/*
+ * NAME:	hserve->running()
+ * DESCRIPTION:	tell whether HFSUTILS_PIPE names a live server
+ */
+int hserve_running(void)
+{
+	const wchar_t *name;
+
+	name = _wgetenv(L"HFSUTILS_PIPE");
+	if (name == 0 || *name == 0)
+		return 0;
+
+	/* a server busy with another client still holds the volume */
+
+	return WaitNamedPipeW(name, NMPWAIT_USE_DEFAULT_WAIT) ||
+		GetLastError() == ERROR_SEM_TIMEOUT;
+}
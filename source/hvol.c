@@ -26,18 +26,51 @@
 # include "hfsutil.h"
 # include "hvol.h"
 # include "charset.h"
+# include "output.h"
+# include "getopt.h"
+
+/*
+ * NAME:	usage()
+ * DESCRIPTION:	display usage message
+ */
+static
+int usage(void)
+{
+	fwprintf(stderr, L"Usage: vol [-J|-0] [volume-name-or-path]\n");
+
+	return 1;
+}
 
 /*
  * NAME:	showvol()
  * DESCRIPTION:	output information about a mounted volume
  */
 static
-int showvol(mountent *ment)
+int showvol(mountent *ment, int fmt)
 {
 	hfsvol *vol;
 	hfsvolent vent;
 	int result = 0;
 
+	if (fmt != OUT_TEXT)
+	{
+		vol = hfsutil_remount(ment, HFS_MODE_ANY);
+		if (vol == 0)
+			return 1;
+
+		if (hfs_vstat(vol, &vent) == -1)
+		{
+			hfsutil_perror("Can't get HFS volume information");
+			result = 1;
+		}
+		else
+			out_volent(fmt, ment, &vent);
+
+		hfsutil_unmount(vol, &result);
+
+		return result;
+	}
+
 	wprintf(L"Current volume is mounted from");
 	if (ment->partno > 0)
 		wprintf(L" partition %d of", ment->partno);
@@ -62,23 +95,45 @@ int showvol(mountent *ment)
  */
 int hvol_main(int argc, wchar_t *argv[])
 {
-	int vnum;
+	int vnum, fmt = OUT_TEXT;
 	mountent *ment;
 
-	if (argc > 3)
+	optind = 2;
+
+	while (1)
 	{
-		fwprintf(stderr, L"Usage: vol [volume-name-or-path]\n");
-		return 1;
+		int opt;
+
+		opt = getopt(argc, argv, L"J0?");
+		if (opt == EOF)
+			break;
+
+		switch (opt)
+		{
+		case 'J':
+			fmt = OUT_JSON;
+			break;
+
+		case '0':
+			fmt = OUT_NUL;
+			break;
+
+		case '?':
+			return usage();
+		}
 	}
 
-	if (argc == 2)
+	if (argc - optind > 1)
+		return usage();
+
+	if (argc == optind)
 	{
 		int output = 0, header = 0;
 
 		ment = hcwd_getvol(-1);
 		if (ment)
 		{
-			showvol(ment);
+			showvol(ment, fmt);
 			output = 1;
 		}
 
@@ -93,6 +148,12 @@ int hvol_main(int argc, wchar_t *argv[])
 			if (ent == ment)
 				continue;
 
+			if (fmt != OUT_TEXT)
+			{
+				out_volent(fmt, ent, 0);
+				continue;
+			}
+
 			if (header == 0)
 			{
 				wprintf(L"%s volumes:\n", ment ? L"\nOther known" : L"Known");
@@ -107,21 +168,21 @@ int hvol_main(int argc, wchar_t *argv[])
 			output = 1;
 		}
 
-		if (output == 0)
+		if (output == 0 && fmt == OUT_TEXT)
 			wprintf(L"No known volumes; use `hmount' to introduce new volumes\n");
 		return 0;
 	}
 
 	for (ment = hcwd_getvol(vnum = 0); ment; ment = hcwd_getvol(++vnum))
 	{
-		if (hfsutil_samepath_w(argv[2], ment->path) || _wcsicmp(argv[2], ment->vname) == 0)
+		if (hfsutil_samepath_w(argv[optind], ment->path) || _wcsicmp(argv[optind], ment->vname) == 0)
 		{
 			hcwd_setvol(vnum);
-			return showvol(ment);
+			return showvol(ment, fmt);
 		}
 	}
 
-	fwprintf(stderr, L"vol: Unknown volume \"%s\"\n", argv[2]);
+	fwprintf(stderr, L"vol: Unknown volume \"%s\"\n", argv[optind]);
 
 	return 1;
 }
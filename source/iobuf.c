@@ -0,0 +1,233 @@
+/*
+ * hfsutils - tools for reading and writing Macintosh HFS volumes
+ * Copyright (C) 1996-1998 Robert Leslie
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * Buffers for the copy routines. Each copy takes its chunk size from
+ * the length of the fork and the volume's allocation block size, and
+ * works in one aligned buffer that is kept from file to file and only
+ * ever grows. A reader fills two halves of it from a host file on its
+ * own thread, so the next read is under way while the volume is being
+ * written. None of this is reentrant; only the thread that owns the
+ * volume may use it.
+ */
+
+# include <stdlib.h>
+# include <errno.h>
+# include <io.h>
+# include <malloc.h>
+# include <windows.h>
+# include <process.h>
+
+# include "hfs.h"
+# include "queue.h"
+# include "iobuf.h"
+
+# define IOBUF_MIN	(64 * 1024)
+# define IOBUF_MAX	(4 * 1024 * 1024)
+# define IOBUF_ALIGN	4096
+
+static char *buffer;
+static unsigned long buffersz;
+
+/*
+ * NAME:	iobuf->size()
+ * DESCRIPTION:	choose a chunk size for copying a fork of a given length
+ */
+unsigned long iobuf_size(hfsvol *vol, unsigned long len)
+{
+	hfsvolent ent;
+	unsigned long unit = HFS_BLOCKSZ, size;
+
+	/* whole allocation blocks keep each chunk on extent boundaries */
+
+	if (vol && hfs_vstat(vol, &ent) != -1 && ent.alblocksz > unit)
+		unit = ent.alblocksz;
+
+	size = len;
+	if (size < IOBUF_MIN)
+		size = IOBUF_MIN;
+	else if (size > IOBUF_MAX)
+		size = IOBUF_MAX;
+
+	return (size + unit - 1) / unit * unit;
+}
+
+/*
+ * NAME:	iobuf->get()
+ * DESCRIPTION:	return the shared buffer, at least a given size
+ */
+char *iobuf_get(unsigned long size)
+{
+	if (size > buffersz)
+	{
+		_aligned_free(buffer);
+
+		buffer   = _aligned_malloc(size, IOBUF_ALIGN);
+		buffersz = buffer ? size : 0;
+
+		if (buffer == 0)
+			errno = ENOMEM;
+	}
+
+	return buffer;
+}
+
+/*
+ * NAME:	readahead()
+ * DESCRIPTION:	reader thread: fill free slots until the end of the file
+ */
+static
+unsigned __stdcall readahead(void *arg)
+{
+	ioreader *r = arg;
+	ioslot *s;
+
+	do
+	{
+		s = q_get(&r->free);
+
+		if (r->stop)
+			s->len = 0;
+		else
+		{
+			s->len = read(r->fd, s->data, r->chunk);
+			if (s->len == -1)
+				s->error = errno;
+		}
+
+		q_put(&r->full, s);
+	}
+	while (s->len > 0);
+
+	return 0;
+}
+
+/*
+ * NAME:	iobuf->startread()
+ * DESCRIPTION:	begin reading a host file ahead; return extra buffer space
+ */
+char *iobuf_startread(ioreader *r, int fd, unsigned long chunk,
+	unsigned long extra)
+{
+	char *buf;
+
+	buf = iobuf_get(2 * chunk + extra);
+	if (buf == 0)
+		return 0;
+
+	r->fd     = fd;
+	r->chunk  = chunk;
+	r->stop   = 0;
+	r->held   = 0;
+	r->thread = 0;
+
+	r->slots[0].data = buf;
+	r->slots[1].data = buf + chunk;
+
+	/* without a thread the reads are simply made in turn */
+
+	if (q_init(&r->free, 2) == -1)
+		return buf + 2 * chunk;
+
+	if (q_init(&r->full, 2) == -1)
+	{
+		q_free(&r->free);
+		return buf + 2 * chunk;
+	}
+
+	q_put(&r->free, &r->slots[0]);
+	q_put(&r->free, &r->slots[1]);
+
+	r->thread = (HANDLE) _beginthreadex(0, 0, readahead, r, 0, 0);
+	if (r->thread == 0)
+	{
+		q_free(&r->full);
+		q_free(&r->free);
+	}
+
+	return buf + 2 * chunk;
+}
+
+/*
+ * NAME:	iobuf->read()
+ * DESCRIPTION:	take the next chunk of a host file; return its length
+ */
+long iobuf_read(ioreader *r, char **data)
+{
+	ioslot *s;
+
+	if (r->thread == 0)
+	{
+		s = &r->slots[0];
+
+		s->len = read(r->fd, s->data, r->chunk);
+		if (s->len == -1)
+			s->error = errno;
+	}
+	else
+	{
+		if (r->held)
+			q_put(&r->free, r->held);
+
+		s = r->held = q_get(&r->full);
+	}
+
+	if (s->len == -1)
+		errno = s->error;
+
+	*data = s->data;
+
+	return s->len;
+}
+
+/*
+ * NAME:	iobuf->endread()
+ * DESCRIPTION:	stop reading ahead and wait for the reader thread
+ */
+void iobuf_endread(ioreader *r)
+{
+	ioslot *s;
+
+	if (r->thread == 0)
+		return;
+
+	/* a consumer that quits early drains what the thread has queued */
+
+	if (r->held == 0 || r->held->len > 0)
+	{
+		r->stop = 1;
+
+		if (r->held)
+			q_put(&r->free, r->held);
+
+		do
+		{
+			s = q_get(&r->full);
+			if (s->len > 0)
+				q_put(&r->free, s);
+		}
+		while (s->len > 0);
+	}
+
+	WaitForSingleObject(r->thread, INFINITE);
+	CloseHandle(r->thread);
+
+	q_free(&r->full);
+	q_free(&r->free);
+}
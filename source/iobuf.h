@@ -0,0 +1,41 @@
+/*
+ * hfsutils - tools for reading and writing Macintosh HFS volumes
+ * Copyright (C) 1996-1998 Robert Leslie
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+typedef struct {
+	char *data;
+	long len;		/* bytes read, 0 at the end, -1 on error */
+	int error;		/* errno of a failed read */
+} ioslot;
+
+typedef struct {
+	int fd;
+	unsigned long chunk;	/* bytes per read */
+	volatile LONG stop;	/* the consumer has gone */
+	ioslot slots[2];
+	ioslot *held;		/* slot the consumer is working on */
+	queue free, full;
+	HANDLE thread;		/* 0 if reading in the calling thread */
+} ioreader;
+
+unsigned long iobuf_size(hfsvol *, unsigned long);
+char *iobuf_get(unsigned long);
+
+char *iobuf_startread(ioreader *, int, unsigned long, unsigned long);
+long iobuf_read(ioreader *, char **);
+void iobuf_endread(ioreader *);
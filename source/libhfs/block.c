@@ -708,6 +708,72 @@ fail:
   return -1;
 }
 
+/*
+ * NAME:	block->readrun()
+ * DESCRIPTION:	read consecutive logical blocks from a volume (bypassing cache)
+ */
+int b_readrun(hfsvol *vol, unsigned long bnum, block *bp, unsigned int blen)
+{
+  bcache *cache = vol->cache;
+  int i;
+
+  if (vol->vlen > 0 && bnum + blen > vol->vlen)
+    __ERROR(EIO, "read nonexistent logical block");
+
+  /* newer data for any of these blocks may still be in the cache */
+
+  if (cache)
+    {
+      for (i = 0; i < HFS_CACHESZ; ++i)
+	{
+	  bucket *b = &cache->chain[i];
+
+	  if (INUSE(b) && DIRTY(b) && b->bnum >= bnum && b->bnum - bnum < blen)
+	    break;
+	}
+
+      if (i < HFS_CACHESZ && b_flush(vol) == -1)
+	goto fail;
+    }
+
+  return b_readpb(vol, vol->vstart + bnum, bp, blen);
+
+fail:
+  return -1;
+}
+
+/*
+ * NAME:	block->writerun()
+ * DESCRIPTION:	write consecutive logical blocks to a volume (bypassing cache)
+ */
+int b_writerun(hfsvol *vol, unsigned long bnum, const block *bp,
+	       unsigned int blen)
+{
+  bcache *cache = vol->cache;
+  int i;
+
+  if (vol->vlen > 0 && bnum + blen > vol->vlen)
+    __ERROR(EIO, "write nonexistent logical block");
+
+  /* cached copies of these blocks, dirty or not, are now stale */
+
+  if (cache)
+    {
+      for (i = 0; i < HFS_CACHESZ; ++i)
+	{
+	  bucket *b = &cache->chain[i];
+
+	  if (INUSE(b) && b->bnum >= bnum && b->bnum - bnum < blen)
+	    b->flags &= ~(HFS_BUCKET_INUSE | HFS_BUCKET_DIRTY);
+	}
+    }
+
+  return b_writepb(vol, vol->vstart + bnum, bp, blen);
+
+fail:
+  return -1;
+}
+
 /*
  * NAME:	block->readab()
  * DESCRIPTION:	read a block from an allocation block from a volume
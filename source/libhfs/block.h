@@ -26,6 +26,8 @@ int b_writepb(hfsvol *, unsigned long, const block *, unsigned int);
 
 int b_readlb(hfsvol *, unsigned long, block *);
 int b_writelb(hfsvol *, unsigned long, const block *);
+int b_readrun(hfsvol *, unsigned long, block *, unsigned int);
+int b_writerun(hfsvol *, unsigned long, const block *, unsigned int);
 
 int b_readab(hfsvol *, unsigned int, unsigned int, block *);
 int b_writeab(hfsvol *, unsigned int, unsigned int, const block *);
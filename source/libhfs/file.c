@@ -134,25 +134,20 @@ void f_getptrs(hfsfile *file, ExtDataRec **extrec,
 }
 
 /*
- * NAME:	file->doblock()
- * DESCRIPTION:	read or write a numbered block from a file
+ * NAME:	locate()
+ * DESCRIPTION:	find the extent holding an allocation block of a file
  */
-int f_doblock(hfsfile *file, unsigned long num, block *bp,
-	      int (*func)(hfsvol *, unsigned int, unsigned int, block *))
+static
+int locate(hfsfile *file, unsigned int *abnum)
 {
-  unsigned int abnum;
-  unsigned int blnum;
   unsigned int fabn;
   int i;
 
-  abnum = num / file->vol->lpa;
-  blnum = num % file->vol->lpa;
-
   /* locate the appropriate extent record */
 
   fabn = file->fabn;
 
-  if (abnum < fabn)
+  if (*abnum < fabn)
     {
       ExtDataRec *extrec;
 
@@ -162,7 +157,7 @@ int f_doblock(hfsfile *file, unsigned long num, block *bp,
       memcpy(&file->ext, extrec, sizeof(ExtDataRec));
     }
   else
-    abnum -= fabn;
+    *abnum -= fabn;
 
   while (1)
     {
@@ -172,11 +167,11 @@ int f_doblock(hfsfile *file, unsigned long num, block *bp,
 	{
 	  n = file->ext[i].xdrNumABlks;
 
-	  if (abnum < n)
-	    return func(file->vol, file->ext[i].xdrStABN + abnum, blnum, bp);
+	  if (*abnum < n)
+	    return i;
 
-	  fabn  += n;
-	  abnum -= n;
+	  fabn   += n;
+	  *abnum -= n;
 	}
 
       if (v_extsearch(file, fabn, &file->ext, 0) <= 0)
@@ -189,6 +184,55 @@ fail:
   return -1;
 }
 
+/*
+ * NAME:	file->doblock()
+ * DESCRIPTION:	read or write a numbered block from a file
+ */
+int f_doblock(hfsfile *file, unsigned long num, block *bp,
+	      int (*func)(hfsvol *, unsigned int, unsigned int, block *))
+{
+  unsigned int abnum;
+  unsigned int blnum;
+  int i;
+
+  abnum = num / file->vol->lpa;
+  blnum = num % file->vol->lpa;
+
+  i = locate(file, &abnum);
+  if (i == -1)
+    return -1;
+
+  return func(file->vol, file->ext[i].xdrStABN + abnum, blnum, bp);
+}
+
+/*
+ * NAME:	file->getrun()
+ * DESCRIPTION:	map a numbered block of a file to a run of logical blocks
+ */
+int f_getrun(hfsfile *file, unsigned long num,
+	     unsigned long *bnum, unsigned long *count)
+{
+  hfsvol *vol = file->vol;
+  unsigned int abnum;
+  unsigned int blnum;
+  int i;
+
+  abnum = num / vol->lpa;
+  blnum = num % vol->lpa;
+
+  i = locate(file, &abnum);
+  if (i == -1)
+    return -1;
+
+  /* the run ends where the extent does */
+
+  *bnum  = vol->mdb.drAlBlSt +
+    (unsigned long) (file->ext[i].xdrStABN + abnum) * vol->lpa + blnum;
+  *count = (unsigned long) (file->ext[i].xdrNumABlks - abnum) * vol->lpa - blnum;
+
+  return 0;
+}
+
 /*
  * NAME:	file->addextent()
  * DESCRIPTION:	add an extent to a file
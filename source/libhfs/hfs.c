@@ -461,6 +461,22 @@ fail:
 	return -1;
 }
 
+/*
+ * NAME:	hfs->getpath()
+ * DESCRIPTION:	given a directory ID, return its full pathname
+ */
+int hfs_getpath(hfsvol *vol, unsigned long id, char *path, unsigned int size)
+{
+	if (getvol(&vol) == -1 ||
+			v_getpath(vol, id, path, size) == -1)
+		goto fail;
+
+	return 0;
+
+fail:
+	return -1;
+}
+
 /*
  * NAME:	hfs->opendir()
  * DESCRIPTION:	prepare to read the contents of a directory
@@ -522,10 +538,54 @@ fail:
 }
 
 /*
- * NAME:	hfs->readdir()
- * DESCRIPTION:	return the next entry in the directory
+ * NAME:	hfs->opencat()
+ * DESCRIPTION:	prepare to read every file and directory in the catalog
  */
-int hfs_readdir(hfsdir *dir, hfsdirent *ent)
+hfsdir *hfs_opencat(hfsvol *vol)
+{
+	hfsdir *dir = 0;
+
+	if (getvol(&vol) == -1)
+		goto fail;
+
+	dir = ALLOC(hfsdir, 1);
+	if (dir == 0)
+		__ERROR(ENOMEM, 0);
+
+	dir->vol	= vol;
+	dir->dirid = HFS_DIR_CATALOG;
+	dir->vptr	= 0;
+
+	/* start from an empty node linked to the first leaf node */
+
+	dir->n.bt	= &vol->cat;
+	dir->n.nnum = 0;
+	dir->n.rnum = 0;
+
+	dir->n.nd.ndFLink = vol->cat.hdr.bthFNode;
+	dir->n.nd.ndNRecs = 0;
+
+	dir->prev = 0;
+	dir->next = vol->dirs;
+
+	if (vol->dirs)
+		vol->dirs->prev = dir;
+
+	vol->dirs = dir;
+
+	return dir;
+
+fail:
+	FREE(dir);
+	return 0;
+}
+
+/*
+ * NAME:	nextdirent()
+ * DESCRIPTION:	fetch the next directory entry; return 1 if found, 0 at end
+ */
+static
+int nextdirent(hfsdir *dir, hfsdirent *ent, hfspsize *psize)
 {
 	CatKeyRec key;
 	CatDataRec data;
@@ -543,7 +603,7 @@ int hfs_readdir(hfsdir *dir, hfsdirent *ent)
 		}
 
 		if (vol == 0)
-			__ERROR(ENOENT, "no more entries");
+			return 0;
 
 		if (v_getdthread(vol, HFS_CNID_ROOTDIR, &data, 0) <= 0 ||
 				v_catsearch(vol, HFS_CNID_ROOTPAR, data.u.dthd.thdCName,
@@ -552,13 +612,16 @@ int hfs_readdir(hfsdir *dir, hfsdirent *ent)
 
 		r_unpackdirent(HFS_CNID_ROOTPAR, cname, &data, ent);
 
+		if (psize)
+			psize->dpsize = psize->rpsize = 0;
+
 		dir->vptr = vol->next;
 
-		goto done;
+		return 1;
 	}
 
 	if (dir->n.rnum == -1)
-		__ERROR(ENOENT, "no more entries");
+		return 0;
 
 	while (1)
 	{
@@ -569,7 +632,7 @@ int hfs_readdir(hfsdir *dir, hfsdirent *ent)
 			if (dir->n.nd.ndFLink == 0)
 			{
 				dir->n.rnum = -1;
-				__ERROR(ENOENT, "no more entries");
+				return 0;
 			}
 
 			if (bt_getnode(&dir->n, dir->n.bt, dir->n.nd.ndFLink) == -1)
@@ -583,22 +646,30 @@ int hfs_readdir(hfsdir *dir, hfsdirent *ent)
 
 		ptr = HFS_NODEREC(dir->n, dir->n.rnum);
 
-		r_unpackcatkey(ptr, &key);
+		/* peek at the packed parent ID and record type before unpacking */
 
-		if (key.ckrParID != dir->dirid)
+		if (dir->dirid != HFS_DIR_CATALOG &&
+				r_catkeyparid(ptr) != dir->dirid)
 		{
 			dir->n.rnum = -1;
-			__ERROR(ENOENT, "no more entries");
+			return 0;
 		}
 
-		r_unpackcatdata(HFS_RECDATA(ptr), &data);
-
-		switch (data.cdrType)
+		switch (r_cattype(HFS_RECDATA(ptr)))
 		{
 			case cdrDirRec:
 			case cdrFilRec:
+				r_unpackcatkey(ptr, &key);
+				r_unpackcatdata(HFS_RECDATA(ptr), &data);
 				r_unpackdirent(key.ckrParID, key.ckrCName, &data, ent);
-				goto done;
+
+				if (psize)
+				{
+					psize->dpsize = (data.cdrType == cdrFilRec) ? data.u.fil.filPyLen : 0;
+					psize->rpsize = (data.cdrType == cdrFilRec) ? data.u.fil.filRPyLen : 0;
+				}
+
+				return 1;
 
 			case cdrThdRec:
 			case cdrFThdRec:
@@ -610,13 +681,76 @@ int hfs_readdir(hfsdir *dir, hfsdirent *ent)
 		}
 	}
 
-done:
+fail:
+	return -1;
+}
+
+/*
+ * NAME:	hfs->readdir()
+ * DESCRIPTION:	return the next entry in the directory
+ */
+int hfs_readdir(hfsdir *dir, hfsdirent *ent)
+{
+	int found;
+
+	found = nextdirent(dir, ent, 0);
+	if (found == -1)
+		goto fail;
+	else if (! found)
+		__ERROR(ENOENT, "no more entries");
+
 	return 0;
 
 fail:
 	return -1;
 }
 
+/*
+ * NAME:	hfs->readdirmany()
+ * DESCRIPTION:	return up to n next entries in the directory; 0 at end
+ */
+int hfs_readdir_many(hfsdir *dir, hfsdirent *ents, int n)
+{
+	int count, found;
+
+	for (count = 0; count < n; ++count)
+	{
+		found = nextdirent(dir, &ents[count], 0);
+		if (found == -1)
+			goto fail;
+		else if (! found)
+			break;
+	}
+
+	return count;
+
+fail:
+	return -1;
+}
+
+/*
+ * NAME:	hfs->readdirpsize()
+ * DESCRIPTION:	as hfs_readdir_many(), also returning allocated fork sizes
+ */
+int hfs_readdir_psize(hfsdir *dir, hfsdirent *ents, hfspsize *psizes, int n)
+{
+	int count, found;
+
+	for (count = 0; count < n; ++count)
+	{
+		found = nextdirent(dir, &ents[count], &psizes[count]);
+		if (found == -1)
+			goto fail;
+		else if (! found)
+			break;
+	}
+
+	return count;
+
+fail:
+	return -1;
+}
+
 /*
  * NAME:	hfs->closedir()
  * DESCRIPTION:	stop reading a directory
@@ -807,7 +941,29 @@ unsigned long hfs_read(hfsfile *file, void *buf, unsigned long len)
 		if (chunk > count)
 			chunk = count;
 
-		if (offs == 0 && chunk == HFS_BLOCKSZ)
+		if (offs == 0 && count >= HFS_RUNMIN * HFS_BLOCKSZ)
+		{
+			unsigned long start, run;
+
+			/* long reads take whole extents straight from the medium */
+
+			if (f_getrun(file, bnum, &start, &run) == -1)
+				goto fail;
+
+			if (run > count >> HFS_BLOCKSZ_BITS)
+				run = count >> HFS_BLOCKSZ_BITS;
+
+			if (run >= HFS_RUNMIN)
+			{
+				if (b_readrun(file->vol, start, (block *) ptr, run) == -1)
+					goto fail;
+
+				chunk = run << HFS_BLOCKSZ_BITS;
+			}
+			else if (f_getblock(file, bnum, (block *) ptr) == -1)
+				goto fail;
+		}
+		else if (offs == 0 && chunk == HFS_BLOCKSZ)
 		{
 			if (f_getblock(file, bnum, (block *) ptr) == -1)
 				goto fail;
@@ -876,7 +1032,33 @@ unsigned long hfs_write(hfsfile *file, const void *buf, unsigned long len)
 				goto fail;
 		}
 
-		if (offs == 0 && chunk == HFS_BLOCKSZ)
+		if (offs == 0 && count >= HFS_RUNMIN * HFS_BLOCKSZ &&
+				file->pos + HFS_RUNMIN * HFS_BLOCKSZ <= *pylen)
+		{
+			unsigned long start, run;
+
+			/*
+			 * Space reserved ahead (see hfs_allocate()) is written in
+			 * runs as long as its extents, straight to the medium.
+			 */
+
+			if (f_getrun(file, bnum, &start, &run) == -1)
+				goto fail;
+
+			if (run > count >> HFS_BLOCKSZ_BITS)
+				run = count >> HFS_BLOCKSZ_BITS;
+
+			if (run >= HFS_RUNMIN)
+			{
+				if (b_writerun(file->vol, start, (const block *) ptr, run) == -1)
+					goto fail;
+
+				chunk = run << HFS_BLOCKSZ_BITS;
+			}
+			else if (f_putblock(file, bnum, (block *) ptr) == -1)
+				goto fail;
+		}
+		else if (offs == 0 && chunk == HFS_BLOCKSZ)
 		{
 			if (f_putblock(file, bnum, (block *) ptr) == -1)
 				goto fail;
@@ -939,6 +1121,145 @@ fail:
 	return -1;
 }
 
+/*
+ * NAME:	hfs->allocate()
+ * DESCRIPTION:	reserve physical space for the current fork up to a length
+ */
+int hfs_allocate(hfsfile *file, unsigned long len)
+{
+	hfsvol *vol = file->vol;
+	unsigned long *pylen, alblksz, count;
+	ExtDescriptor blocks;
+
+	if (vol->flags & HFS_VOL_READONLY)
+		__ERROR(EROFS, 0);
+
+	f_getptrs(file, 0, 0, &pylen);
+
+	alblksz = vol->mdb.drAlBlkSiz;
+
+	/*
+	 * Ask for the whole remainder at once; the allocator returns the
+	 * first free run that fits, or the largest it finds, so a fragmented
+	 * volume takes a few rounds. hfs_close() returns any excess.
+	 */
+
+	while (*pylen < len)
+	{
+		/* the count only fits the 16-bit descriptor once it is checked */
+
+		count = (len - *pylen) / alblksz + ((len - *pylen) % alblksz != 0);
+
+		if (count > vol->mdb.drFreeBks)
+			__ERROR(ENOSPC, "volume full");
+
+		blocks.xdrNumABlks = (unsigned short) count;
+
+		if (bt_space(&vol->ext, 1) == -1 ||
+				v_allocblocks(vol, &blocks) == -1)
+			goto fail;
+
+		if (f_addextent(file, &blocks) == -1)
+		{
+			v_freeblocks(vol, &blocks);
+			goto fail;
+		}
+	}
+
+	return 0;
+
+fail:
+	return -1;
+}
+
+/*
+ * NAME:	hfs->ranges()
+ * DESCRIPTION:	list where the current fork's data lies on the medium
+ */
+int hfs_ranges(hfsfile *file, hfsrange *list, int max)
+{
+	hfsvol *vol = file->vol;
+	ExtDataRec *extrec, ext;
+	hfsrange range;
+	unsigned long *lglen, left, bytes, start;
+	unsigned int fabn = 0, nblocks;
+	int i, count = 0;
+
+	f_getptrs(file, &extrec, &lglen, 0);
+
+	memcpy(&ext, extrec, sizeof(ExtDataRec));
+
+	/*
+	 * Adjacent extents are merged. The return value is the number of
+	 * ranges in the whole fork, even when only max of them are stored.
+	 */
+
+	for (left = *lglen; left; )
+	{
+		nblocks = 0;
+
+		for (i = 0; i < 3 && left; ++i)
+		{
+			nblocks += ext[i].xdrNumABlks;
+
+			if (ext[i].xdrNumABlks == 0)
+				continue;
+
+			start = vol->vstart + vol->mdb.drAlBlSt +
+				(unsigned long) ext[i].xdrStABN * vol->lpa;
+			bytes = (unsigned long) ext[i].xdrNumABlks * vol->mdb.drAlBlkSiz;
+
+			if (bytes > left)
+				bytes = left;
+
+			if (count &&
+					range.start + (range.length >> HFS_BLOCKSZ_BITS) == start &&
+					(range.length & (HFS_BLOCKSZ - 1)) == 0)
+				range.length += bytes;
+			else
+			{
+				range.start  = start;
+				range.length = bytes;
+
+				++count;
+			}
+
+			if (count <= max)
+				list[count - 1] = range;
+
+			left -= bytes;
+		}
+
+		fabn += nblocks;
+
+		if (left && (nblocks == 0 || v_extsearch(file, fabn, &ext, 0) <= 0))
+			__ERROR(EIO, "missing file extents");
+	}
+
+	return count;
+
+fail:
+	return -1;
+}
+
+/*
+ * NAME:	hfs->readblocks()
+ * DESCRIPTION:	read physical blocks from the medium, bypassing the cache
+ */
+int hfs_readblocks(hfsvol *vol, unsigned long bnum, void *buf,
+	unsigned int count)
+{
+	/* pending writes must reach the medium before it is read directly */
+
+	if (b_flush(vol) == -1)
+		goto fail;
+
+	return b_readpb(vol, bnum, buf, count);
+
+fail:
+	return -1;
+}
+
 /*
  * NAME:	hfs->seek()
  * DESCRIPTION:	change file seek pointer
@@ -1146,6 +1467,8 @@ int hfs_rmdir(hfsvol *vol, const char *path)
 
 	/* delete directory record */
 
+	v_uncachedir(vol, data.u.dir.dirDirID);
+
 	r_makecatkey(&key, parid, name);
 	r_packcatkey(&key, pkey, 0);
 
@@ -1344,6 +1667,9 @@ int hfs_rename(hfsvol *vol, const char *srcpath, const char *dstpath)
 
 	/* remove source record */
 
+	if (isdir)
+		v_uncachedir(vol, src.u.dir.dirDirID);
+
 	r_makecatkey(&key, srcid, srcname);
 	r_packcatkey(&key, record, 0);
 
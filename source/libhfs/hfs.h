@@ -88,6 +88,16 @@ typedef struct {
   } u;
 } hfsdirent;
 
+typedef struct {
+  unsigned long dpsize;		/* space allocated to data fork */
+  unsigned long rpsize;		/* space allocated to resource fork */
+} hfspsize;
+
+typedef struct {
+  unsigned long start;		/* first physical block on the medium */
+  unsigned long length;		/* bytes of fork data from there */
+} hfsrange;
+
 # define HFS_ISDIR		0x0001
 # define HFS_ISLOCKED		0x0002
 
@@ -146,9 +156,13 @@ int hfs_chdir(hfsvol *, const char *);
 unsigned long hfs_getcwd(hfsvol *);
 int hfs_setcwd(hfsvol *, unsigned long);
 int hfs_dirinfo(hfsvol *, unsigned long *, char *);
+int hfs_getpath(hfsvol *, unsigned long, char *, unsigned int);
 
 hfsdir *hfs_opendir(hfsvol *, const char *);
+hfsdir *hfs_opencat(hfsvol *);
 int hfs_readdir(hfsdir *, hfsdirent *);
+int hfs_readdir_many(hfsdir *, hfsdirent *, int);
+int hfs_readdir_psize(hfsdir *, hfsdirent *, hfspsize *, int);
 int hfs_closedir(hfsdir *);
 
 hfsfile *hfs_create(hfsvol *, const char *, const char *, const char *);
@@ -158,6 +172,9 @@ int hfs_getfork(hfsfile *);
 unsigned long hfs_read(hfsfile *, void *, unsigned long);
 unsigned long hfs_write(hfsfile *, const void *, unsigned long);
 int hfs_truncate(hfsfile *, unsigned long);
+int hfs_allocate(hfsfile *, unsigned long);
+int hfs_ranges(hfsfile *, hfsrange *, int);
+int hfs_readblocks(hfsvol *, unsigned long, void *, unsigned int);
 unsigned long hfs_seek(hfsfile *, long, int);
 int hfs_close(hfsfile *);
 
@@ -74,6 +74,7 @@ typedef struct _bucket_ {
 # define HFS_CACHESZ		128
 # define HFS_HASHSZ		32
 # define HFS_BLOCKBUFSZ		16
+# define HFS_RUNMIN		HFS_BLOCKBUFSZ	/* shortest run to bypass cache */
 
 typedef struct {
   struct _hfsvol_ *vol;		/* volume to which cache belongs */
@@ -165,6 +166,8 @@ struct _hfsdir_ {
   struct _hfsdir_ *next;
 };
 
+# define HFS_DIR_CATALOG	((unsigned long) -1)	/* scan entire catalog */
+
 typedef void (*keyunpackfunc)(const byte *, void *);
 typedef int (*keycomparefunc)(const void *, const void *);
 
@@ -182,6 +185,14 @@ typedef struct _btree_ {
 
 # define HFS_BT_UPDATE_HDR	0x01
 
+typedef struct {
+  unsigned long parid;		/* parent directory ID */
+  unsigned long dirid;		/* directory ID (0 if slot unused) */
+  char name[HFS_MAX_FLEN + 1];	/* directory name */
+} pathent;
+
+# define HFS_PATHCACHESZ	64
+
 struct _hfsvol_ {
   void *priv;		/* OS-dependent private descriptor data */
   int flags;		/* bit flags */
@@ -202,6 +213,9 @@ struct _hfsvol_ {
 
   unsigned long cwd;	/* directory id of current working directory */
 
+  pathent bynam[HFS_PATHCACHESZ];	/* directories by parent ID and name */
+  pathent byid[HFS_PATHCACHESZ];	/* directory threads by ID */
+
   int refs;		/* number of external references to this volume */
   hfsfile *files;	/* list of open files */
   hfsdir *dirs;		/* list of open directories */
@@ -43,3 +43,38 @@ void r_packextrec(const ExtKeyRec *, const ExtDataRec *,
 void r_packdirent(CatDataRec *, const hfsdirent *);
 void r_unpackdirent(unsigned long, const char *,
 		    const CatDataRec *, hfsdirent *);
+
+/* views of single fields in packed records (big-endian, read in place) */
+
+# include <string.h>
+# include <stdlib.h>
+
+# if defined(_MSC_VER)
+#  define R_BSWAP32(x)		_byteswap_ulong(x)
+# elif defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#  define R_BSWAP32(x)		__builtin_bswap32(x)
+# elif defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#  define R_BSWAP32(x)		(x)
+# endif
+
+static __inline
+unsigned long r_viewul(const unsigned char *ptr)
+{
+# ifdef R_BSWAP32
+  unsigned int x;
+
+  memcpy(&x, ptr, sizeof(x));
+
+  return R_BSWAP32(x);
+# else
+  /* host byte order unknown; assemble the bytes one at a time */
+
+  return ((unsigned long) ptr[0] << 24) | ((unsigned long) ptr[1] << 16) |
+	 ((unsigned long) ptr[2] <<  8) |  (unsigned long) ptr[3];
+# endif
+}
+
+# define r_catkeyparid(pkey)	r_viewul((pkey) + 2)
+
+# define r_cattype(pdata)	(*(const signed char *) (pdata))
+# define r_catdirid(pdata)	r_viewul((pdata) + 6)
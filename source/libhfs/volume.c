@@ -75,6 +75,9 @@ void v_init(hfsvol *vol, int flags)
 
   vol->cwd        = HFS_CNID_ROOTDIR;
 
+  memset(vol->bynam, 0, sizeof(vol->bynam));
+  memset(vol->byid,  0, sizeof(vol->byid));
+
   vol->refs       = 0;
   vol->files      = 0;
   vol->dirs       = 0;
@@ -747,6 +750,80 @@ fail:
   return -1;
 }
 
+/*
+ * NAME:	namehash()
+ * DESCRIPTION:	hash a parent ID and name into the directory cache
+ */
+static
+unsigned int namehash(unsigned long parid, const char *name)
+{
+  unsigned int hash = parid;
+
+  /* fold case the same way catalog keys are compared */
+
+  while (*name)
+    hash = hash * 31 + hfs_charorder[(unsigned char) *name++];
+
+  return hash % HFS_PATHCACHESZ;
+}
+
+/*
+ * NAME:	cachedir()
+ * DESCRIPTION:	remember a directory in a cache slot
+ */
+static
+void cachedir(pathent *ent, unsigned long parid, const char *name,
+	      unsigned long dirid)
+{
+  ent->parid = parid;
+  ent->dirid = dirid;
+  strcpy(ent->name, name);
+}
+
+/*
+ * NAME:	dirthread()
+ * DESCRIPTION:	retrieve a directory thread, consulting the cache first
+ */
+static
+int dirthread(hfsvol *vol, unsigned long dirid, CatDataRec *thread)
+{
+  pathent *ent = &vol->byid[dirid % HFS_PATHCACHESZ];
+  int found;
+
+  if (ent->dirid == dirid)
+    {
+      thread->cdrType = cdrThdRec;
+      thread->u.dthd.thdParID = ent->parid;
+      strcpy(thread->u.dthd.thdCName, ent->name);
+
+      return 1;
+    }
+
+  found = v_getdthread(vol, dirid, thread, 0);
+  if (found == 1)
+    cachedir(ent, thread->u.dthd.thdParID, thread->u.dthd.thdCName, dirid);
+
+  return found;
+}
+
+/*
+ * NAME:	vol->uncachedir()
+ * DESCRIPTION:	forget any cached lookups of a renamed or deleted directory
+ */
+void v_uncachedir(hfsvol *vol, unsigned long dirid)
+{
+  int i;
+
+  if (vol->byid[dirid % HFS_PATHCACHESZ].dirid == dirid)
+    vol->byid[dirid % HFS_PATHCACHESZ].dirid = 0;
+
+  for (i = 0; i < HFS_PATHCACHESZ; ++i)
+    {
+      if (vol->bynam[i].dirid == dirid)
+	vol->bynam[i].dirid = 0;
+    }
+}
+
 /*
  * NAME:	vol->resolve()
  * DESCRIPTION:	translate a pathname; return catalog information
@@ -756,6 +833,7 @@ int v_resolve(hfsvol **vol, const char *path,
 {
   unsigned long dirid;
   char name[HFS_MAX_FLEN + 1], *nptr;
+  pathent *ent;
   int found = 0;
 
   if (*path == 0)
@@ -775,7 +853,7 @@ int v_resolve(hfsvol **vol, const char *path,
 
       if (*path == 0)
 	{
-	  found = v_getdthread(*vol, dirid, data, 0);
+	  found = dirthread(*vol, dirid, data);
 	  if (found == -1)
 	    goto fail;
 
@@ -821,7 +899,7 @@ int v_resolve(hfsvol **vol, const char *path,
 	{
 	  ++path;
 
-	  found = v_getdthread(*vol, dirid, data, 0);
+	  found = dirthread(*vol, dirid, data);
 	  if (found == -1)
 	    goto fail;
 	  else if (! found)
@@ -832,7 +910,7 @@ int v_resolve(hfsvol **vol, const char *path,
 
       if (*path == 0)
 	{
-	  found = v_getdthread(*vol, dirid, data, 0);
+	  found = dirthread(*vol, dirid, data);
 	  if (found == -1)
 	    goto fail;
 
@@ -864,6 +942,20 @@ int v_resolve(hfsvol **vol, const char *path,
       if (parid)
 	*parid = dirid;
 
+      /* intermediate components may be satisfied from the cache */
+
+      if (*path)
+	{
+	  ent = &(*vol)->bynam[namehash(dirid, name)];
+
+	  if (ent->dirid && ent->parid == dirid &&
+	      d_relstring(ent->name, name) == 0)
+	    {
+	      dirid = ent->dirid;
+	      continue;
+	    }
+	}
+
       found = v_catsearch(*vol, dirid, name, data, fname, np);
       if (found == -1)
 	goto fail;
@@ -885,6 +977,9 @@ int v_resolve(hfsvol **vol, const char *path,
 	  if (*path == 0)
 	    goto done;
 
+	  cachedir(&(*vol)->bynam[namehash(dirid, name)],
+		   dirid, name, data->u.dir.dirDirID);
+
 	  dirid = data->u.dir.dirDirID;
 	  break;
 
@@ -906,6 +1001,55 @@ fail:
   return -1;
 }
 
+/*
+ * NAME:	vol->getpath()
+ * DESCRIPTION:	build the full pathname of a directory from its ID
+ */
+int v_getpath(hfsvol *vol, unsigned long id, char *path, unsigned int size)
+{
+  CatDataRec thread;
+  char *ptr;
+  unsigned int len;
+  int found;
+
+  if (size == 0)
+    __ERROR(ERANGE, 0);
+
+  /* assemble the path backwards from the end of the buffer */
+
+  ptr  = path + size - 1;
+  *ptr = 0;
+
+  while (id != HFS_CNID_ROOTPAR)
+    {
+      found = dirthread(vol, id, &thread);
+      if (found == -1)
+	goto fail;
+      else if (! found)
+	__ERROR(ENOENT, "can't find directory thread");
+
+      len = strlen(thread.u.dthd.thdCName);
+
+      if ((unsigned int) (ptr - path) < len + (*ptr != 0))
+	__ERROR(ERANGE, "pathname too long");
+
+      if (*ptr)
+	*--ptr = ':';
+
+      ptr -= len;
+      memcpy(ptr, thread.u.dthd.thdCName, len);
+
+      id = thread.u.dthd.thdParID;
+    }
+
+  memmove(path, ptr, path + size - ptr);
+
+  return 0;
+
+fail:
+  return -1;
+}
+
 /*
  * NAME:	vol->adjvalence()
  * DESCRIPTION:	update a volume's valence counts
@@ -1129,12 +1273,13 @@ int v_scavenge(hfsvol *vol)
 	  if (n.rnum >= n.nd.ndNRecs && n.nd.ndFLink == 0)
 	    break;
 
-	  ptr = HFS_NODEREC(n, n.rnum);
-	  r_unpackcatdata(HFS_RECDATA(ptr), &data);
+	  ptr = HFS_RECDATA(HFS_NODEREC(n, n.rnum));
 
-	  switch (data.cdrType)
+	  switch (r_cattype(ptr))
 	    {
 	    case cdrFilRec:
+	      r_unpackcatdata(ptr, &data);
+
 	      markexts(vbm, &data.u.fil.filExtRec);
 	      markexts(vbm, &data.u.fil.filRExtRec);
 
@@ -1143,8 +1288,8 @@ int v_scavenge(hfsvol *vol)
 	      break;
 
 	    case cdrDirRec:
-	      if (data.u.dir.dirDirID > lastcnid)
-		lastcnid = data.u.dir.dirDirID;
+	      if (r_catdirid(ptr) > lastcnid)
+		lastcnid = r_catdirid(ptr);
 	      break;
 	    }
 
@@ -57,6 +57,8 @@ int v_allocblocks(hfsvol *, ExtDescriptor *);
 int v_freeblocks(hfsvol *, const ExtDescriptor *);
 
 int v_resolve(hfsvol **, const char *, CatDataRec *, long *, char *, node *);
+void v_uncachedir(hfsvol *, unsigned long);
+int v_getpath(hfsvol *, unsigned long, char *, unsigned int);
 
 int v_adjvalence(hfsvol *, unsigned long, int, int);
 int v_mkdir(hfsvol *, unsigned long, const char *);
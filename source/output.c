@@ -0,0 +1,234 @@
+/*
+ * hfsutils - tools for reading and writing Macintosh HFS volumes
+ * Copyright (C) 1996-1998 Robert Leslie
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+# include <stdio.h>
+# include <stdlib.h>
+# include <string.h>
+# include <windows.h>
+
+# include "hfs.h"
+# include "hcwd.h"
+# include "output.h"
+# include "charset.h"
+
+# define WBUFSZ		1024	/* converted string held on the stack */
+
+static int format;	/* OUT_JSON or OUT_NUL for the current record */
+static int nfields;	/* fields written so far in the current record */
+
+/*
+ * NAME:	begin()
+ * DESCRIPTION:	start a record
+ */
+static
+void begin(int fmt)
+{
+	format  = fmt;
+	nfields = 0;
+
+	if (format == OUT_JSON)
+		putwchar(L'{');
+}
+
+/*
+ * NAME:	end()
+ * DESCRIPTION:	finish a record
+ */
+static
+void end(void)
+{
+	if (format == OUT_JSON)
+		fputws(L"}\n", stdout);
+	else
+		putwchar(L'\0');
+}
+
+/*
+ * NAME:	key()
+ * DESCRIPTION:	write the name of the next field
+ */
+static
+void key(const wchar_t *name)
+{
+	if (format == OUT_JSON)
+		wprintf(L"%s\"%s\":", nfields ? L"," : L"", name);
+	else
+		wprintf(L"%s=", name);
+
+	++nfields;
+}
+
+/*
+ * NAME:	next()
+ * DESCRIPTION:	terminate a field value
+ */
+static
+void next(void)
+{
+	if (format == OUT_NUL)
+		putwchar(L'\0');
+}
+
+/*
+ * NAME:	wstr()
+ * DESCRIPTION:	write a string field
+ */
+static
+void wstr(const wchar_t *name, const wchar_t *str)
+{
+	key(name);
+
+	if (format == OUT_JSON)
+	{
+		putwchar(L'\"');
+
+		for (; *str; ++str)
+		{
+			switch (*str)
+			{
+			case L'\"':
+				fputws(L"\\\"", stdout);
+				break;
+
+			case L'\\':
+				fputws(L"\\\\", stdout);
+				break;
+
+			default:
+				if (*str < 0x20 || *str == 0x7f)
+					wprintf(L"\\u%04x", (unsigned int) *str);
+				else
+					putwchar(*str);
+			}
+		}
+
+		putwchar(L'\"');
+	}
+	else
+		fputws(str, stdout);
+
+	next();
+}
+
+/*
+ * NAME:	str()
+ * DESCRIPTION:	write a MacOS Standard Roman string field
+ */
+static
+void str(const wchar_t *name, const char *mstr)
+{
+	wchar_t buf[WBUFSZ], *wstring = buf, *heap = 0;
+
+	if (MultiByteToWideChar(CP_MACCP, 0, mstr, -1, buf, WBUFSZ) == 0)
+	{
+		/* too long for the stack buffer (or not convertible) */
+
+		heap    = macRomanToUtf16(mstr);
+		wstring = heap ? heap : L"";
+	}
+
+	wstr(name, wstring);
+
+	free(heap);
+}
+
+/*
+ * NAME:	num()
+ * DESCRIPTION:	write a numeric field
+ */
+static
+void num(const wchar_t *name, long long val)
+{
+	key(name);
+	wprintf(L"%lld", val);
+	next();
+}
+
+/*
+ * NAME:	output->dirent()
+ * DESCRIPTION:	write a record describing a file or directory
+ */
+void out_dirent(int fmt, const char *path, const hfsdirent *ent)
+{
+	begin(fmt);
+
+	if (path)
+		str(L"path", path);
+
+	str(L"name", ent->name);
+	wstr(L"kind", (ent->flags & HFS_ISDIR) ? L"dir" : L"file");
+
+	num(L"cnid", ent->cnid);
+	num(L"parid", ent->parid);
+	num(L"flags", ent->flags);
+	num(L"fdflags", (unsigned short) ent->fdflags);
+
+	num(L"crdate", ent->crdate);
+	num(L"mddate", ent->mddate);
+	num(L"bkdate", ent->bkdate);
+
+	if (ent->flags & HFS_ISDIR)
+		num(L"valence", ent->u.dir.valence);
+	else
+	{
+		num(L"dsize", ent->u.file.dsize);
+		num(L"rsize", ent->u.file.rsize);
+
+		str(L"type", ent->u.file.type);
+		str(L"creator", ent->u.file.creator);
+	}
+
+	end();
+}
+
+/*
+ * NAME:	output->volent()
+ * DESCRIPTION:	write a record describing a volume; vent may be 0
+ */
+void out_volent(int fmt, const mountent *ment, const hfsvolent *vent)
+{
+	begin(fmt);
+
+	wstr(L"path", ment->path);
+	num(L"partno", ment->partno);
+
+	if (vent == 0)
+		wstr(L"name", ment->vname);
+	else
+	{
+		str(L"name", vent->name);
+
+		num(L"flags", vent->flags);
+
+		num(L"totbytes", vent->totbytes);
+		num(L"freebytes", vent->freebytes);
+		num(L"alblocksz", vent->alblocksz);
+		num(L"clumpsz", vent->clumpsz);
+		num(L"numfiles", vent->numfiles);
+		num(L"numdirs", vent->numdirs);
+
+		num(L"crdate", vent->crdate);
+		num(L"mddate", vent->mddate);
+		num(L"bkdate", vent->bkdate);
+
+		num(L"blessed", vent->blessed);
+	}
+
+	end();
+}
@@ -0,0 +1,32 @@
+/*
+ * hfsutils - tools for reading and writing Macintosh HFS volumes
+ * Copyright (C) 1996-1998 Robert Leslie
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * Structured output for tooling. In OUT_JSON mode each record is one JSON
+ * object on a line of its own; in OUT_NUL mode each field is written as
+ * "key=value" followed by a NUL byte, and a record ends with an empty field
+ * (a second NUL). Names are written as UTF-8, dates as time_t seconds.
+ */
+
+# define OUT_TEXT	0
+# define OUT_JSON	1
+# define OUT_NUL	2
+
+void out_dirent(int, const char *, const hfsdirent *);
+void out_volent(int, const mountent *, const hfsvolent *);
@@ -0,0 +1,100 @@
+/*
+ * hfsutils - tools for reading and writing Macintosh HFS volumes
+ * Copyright (C) 1996-1998 Robert Leslie
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * A queue is a fixed-size FIFO of pointers shared between threads.
+ * Putting to a full queue or getting from an empty one blocks until
+ * another thread makes room or supplies an item.
+ */
+
+# include <stdlib.h>
+# include <windows.h>
+
+# include "queue.h"
+
+/*
+ * NAME:	queue->init()
+ * DESCRIPTION:	initialize a queue holding up to a given number of items
+ */
+int q_init(queue *q, int size)
+{
+	q->items = malloc(size * sizeof(void *));
+	if (q->items == 0)
+		return -1;
+
+	q->size  = size;
+	q->head  = 0;
+	q->count = 0;
+
+	InitializeCriticalSection(&q->lock);
+	InitializeConditionVariable(&q->notempty);
+	InitializeConditionVariable(&q->notfull);
+
+	return 0;
+}
+
+/*
+ * NAME:	queue->free()
+ * DESCRIPTION:	dispose of a queue (but not the items in it)
+ */
+void q_free(queue *q)
+{
+	DeleteCriticalSection(&q->lock);
+	free(q->items);
+}
+
+/*
+ * NAME:	queue->put()
+ * DESCRIPTION:	append an item, waiting while the queue is full
+ */
+void q_put(queue *q, void *item)
+{
+	EnterCriticalSection(&q->lock);
+
+	while (q->count == q->size)
+		SleepConditionVariableCS(&q->notfull, &q->lock, INFINITE);
+
+	q->items[(q->head + q->count++) % q->size] = item;
+
+	LeaveCriticalSection(&q->lock);
+	WakeConditionVariable(&q->notempty);
+}
+
+/*
+ * NAME:	queue->get()
+ * DESCRIPTION:	remove the oldest item, waiting while the queue is empty
+ */
+void *q_get(queue *q)
+{
+	void *item;
+
+	EnterCriticalSection(&q->lock);
+
+	while (q->count == 0)
+		SleepConditionVariableCS(&q->notempty, &q->lock, INFINITE);
+
+	item = q->items[q->head];
+	q->head = (q->head + 1) % q->size;
+	--q->count;
+
+	LeaveCriticalSection(&q->lock);
+	WakeConditionVariable(&q->notfull);
+
+	return item;
+}